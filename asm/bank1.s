@@ -0,0 +1,79 @@
+; Writes each of 64 banks' number at either end of the bank window,
+; reads them back, then runs routines switched in and out of the window
+; by turns.
+;
+; run: --banks
+; expect: B: 0x40
+; expect: C: 0xe0
+; expect: E: 0xd8
+; expect: T-states: 37362
+
+BANK	equ	70h			; Bank register of the window
+WINDOW	equ	3800h			; Where the window starts
+LAST	equ	77ffh			; Its last byte
+
+	org	0000h
+start:	jmp	main			; 0000: c3 40 00
+
+	org	0040h
+main:	mvi	b,0			; 0040: 06 00
+fill:	mov	a,b			; 0042: 78
+	out	BANK			; 0043: d3 70
+	sta	WINDOW			; 0045: 32 00 38
+	sta	LAST			; 0048: 32 ff 77
+	inr	b			; 004b: 04
+	mov	a,b			; 004c: 78
+	cpi	64			; 004d: fe 40
+	jnz	fill			; 004f: c2 42 00
+
+	mvi	b,0			; 0052: 06 00
+	mvi	c,0			; 0054: 0e 00
+check:	mov	a,b			; 0056: 78
+	out	BANK			; 0057: d3 70
+	lda	LAST			; 0059: 3a ff 77
+	cmp	b			; 005c: b8
+	jnz	wrong			; 005d: c2 f0 00
+	lda	WINDOW			; 0060: 3a 00 38
+	add	c			; 0063: 81
+	mov	c,a			; 0064: 4f
+	inr	b			; 0065: 04
+	mov	a,b			; 0066: 78
+	cpi	64			; 0067: fe 40
+	jnz	check			; 0069: c2 56 00
+
+	mvi	a,1			; 006c: 3e 01
+	out	BANK			; 006e: d3 70
+	lxi	h,WINDOW		; 0070: 21 00 38
+	mvi	m,3eh			; 0073: 36 3e
+	inx	h			; 0075: 23
+	mvi	m,11h			; 0076: 36 11
+	inx	h			; 0078: 23
+	mvi	m,0c9h			; 0079: 36 c9
+	mvi	a,2			; 007b: 3e 02
+	out	BANK			; 007d: d3 70
+	lxi	h,WINDOW		; 007f: 21 00 38
+	mvi	m,3eh			; 0082: 36 3e
+	inx	h			; 0084: 23
+	mvi	m,22h			; 0085: 36 22
+	inx	h			; 0087: 23
+	mvi	m,0c9h			; 0088: 36 c9
+
+	mvi	d,200			; 008a: 16 c8
+	mvi	e,0			; 008c: 1e 00
+turns:	mvi	a,1			; 008e: 3e 01
+	out	BANK			; 0090: d3 70
+	call	WINDOW			; 0092: cd 00 38
+	add	e			; 0095: 83
+	mov	e,a			; 0096: 5f
+	mvi	a,2			; 0097: 3e 02
+	out	BANK			; 0099: d3 70
+	call	WINDOW			; 009b: cd 00 38
+	add	e			; 009e: 83
+	mov	e,a			; 009f: 5f
+	dcr	d			; 00a0: 15
+	jnz	turns			; 00a1: c2 8e 00
+	hlt				; 00a4: 76
+
+	org	00f0h
+wrong:	mvi	b,0eeh			; 00f0: 06 ee
+	hlt				; 00f2: 76
@@ -0,0 +1,28 @@
+; Writes a line to the console, then echoes what is typed back to it
+; until a full stop, polling the status port for each character.
+;
+; input: abc\ndef.
+; expect: hi
+; expect: abc
+; expect: A: 0x2e
+; expect: Status: HLT
+
+CSTAT	equ	0			; Console status
+CDATA	equ	1			; Console data
+RXRDY	equ	1			; A character is waiting
+
+start:	mvi	a,'h'			; 0000: 3e 68
+	out	CDATA			; 0002: d3 01
+	mvi	a,'i'			; 0004: 3e 69
+	out	CDATA			; 0006: d3 01
+	mvi	a,0ah			; 0008: 3e 0a
+	out	CDATA			; 000a: d3 01
+poll:	in	CSTAT			; 000c: db 00
+	ani	RXRDY			; 000e: e6 01
+	jz	poll			; 0010: ca 0c 00
+	in	CDATA			; 0013: db 01
+	cpi	'.'			; 0015: fe 2e
+	jz	done			; 0017: ca 1f 00
+	out	CDATA			; 001a: d3 01
+	jmp	poll			; 001c: c3 0c 00
+done:	hlt				; 001f: 76
@@ -0,0 +1,70 @@
+; Reads two sectors from the disk into memory, halting for the interrupt
+; when they are in, then writes the first 128 bytes of the program out
+; to sector 0 and polls until the write is done.
+;
+; Sector 1 starts with 11h and sector 2 ends with 22h.
+; image 0080: 11
+; image 017f: 22
+; image 0180: 3e 77 c9
+; image 01ff: 00
+;
+; expect: B: 0x80
+; expect: C: 0x11
+; expect: D: 0x22
+; expect: E: 0x80
+; expect: Status: HLT  T-states: 700
+
+DISK	equ	30h			; Command when written, status when read
+SECTOR	equ	31h			; Sector, low byte then high byte
+ADDR	equ	33h			; Memory address, low byte then high byte
+COUNT	equ	35h			; Sectors to move
+READ	equ	01h
+WRITE	equ	02h
+FLUSH	equ	03h
+INT	equ	80h			; Interrupt once the command is done
+BUSY	equ	01h
+
+	org	0000h
+start:	jmp	main			; 0000: c3 40 00
+
+	org	0020h
+rst4:	in	DISK			; 0020: db 30
+	mov	b,a			; 0022: 47
+	ei				; 0023: fb
+	ret				; 0024: c9
+
+	org	0040h
+main:	mvi	a,1			; 0040: 3e 01
+	out	SECTOR			; 0042: d3 31
+	mvi	a,00h			; 0044: 3e 00
+	out	ADDR			; 0046: d3 33
+	mvi	a,10h			; 0048: 3e 10
+	out	ADDR+1			; 004a: d3 34
+	mvi	a,2			; 004c: 3e 02
+	out	COUNT			; 004e: d3 35
+	mvi	a,READ+INT		; 0050: 3e 81
+	out	DISK			; 0052: d3 30
+	ei				; 0054: fb
+	hlt				; 0055: 76
+	lda	1000h			; 0056: 3a 00 10
+	mov	c,a			; 0059: 4f
+	lda	10ffh			; 005a: 3a ff 10
+	mov	d,a			; 005d: 57
+
+	xra	a			; 005e: af
+	out	SECTOR			; 005f: d3 31
+	out	ADDR			; 0061: d3 33
+	out	ADDR+1			; 0063: d3 34
+	mvi	a,1			; 0065: 3e 01
+	out	COUNT			; 0067: d3 35
+	mvi	a,WRITE			; 0069: 3e 02
+	out	DISK			; 006b: d3 30
+poll:	in	DISK			; 006d: db 30
+	ani	BUSY			; 006f: e6 01
+	jnz	poll			; 0071: c2 6d 00
+	in	DISK			; 0074: db 30
+	mov	e,a			; 0076: 5f
+	mvi	a,FLUSH			; 0077: 3e 03
+	out	DISK			; 0079: d3 30
+	di				; 007b: f3
+	hlt				; 007c: 76
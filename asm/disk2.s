@@ -0,0 +1,52 @@
+; Calls a routine until it is hot, then reads sector 3 over it and calls
+; it again. The routine read from the disk must be the one that runs,
+; not the one that was there before.
+;
+; Sector 3 starts with mvi a,77h then ret.
+; image 0080: 11
+; image 017f: 22
+; image 0180: 3e 77 c9
+; image 01ff: 00
+;
+; expect: A: 0x77
+; expect: B: 0x01
+; expect: C: 0x77
+; expect: Status: HLT  T-states: 12859
+
+DISK	equ	30h			; Command when written, status when read
+SECTOR	equ	31h			; Sector, low byte then high byte
+ADDR	equ	33h			; Memory address, low byte then high byte
+COUNT	equ	35h			; Sectors to move
+READ	equ	01h
+BUSY	equ	01h
+
+	org	0000h
+start:	jmp	main			; 0000: c3 40 00
+
+	org	0040h
+main:	mvi	c,0			; 0040: 0e 00
+warm:	call	routine			; 0042: cd 00 08
+	dcr	c			; 0045: 0d
+	jnz	warm			; 0046: c2 42 00
+	mov	b,a			; 0049: 47
+
+	mvi	a,3			; 004a: 3e 03
+	out	SECTOR			; 004c: d3 31
+	mvi	a,00h			; 004e: 3e 00
+	out	ADDR			; 0050: d3 33
+	mvi	a,08h			; 0052: 3e 08
+	out	ADDR+1			; 0054: d3 34
+	mvi	a,1			; 0056: 3e 01
+	out	COUNT			; 0058: d3 35
+	mvi	a,READ			; 005a: 3e 01
+	out	DISK			; 005c: d3 30
+poll:	in	DISK			; 005e: db 30
+	ani	BUSY			; 0060: e6 01
+	jnz	poll			; 0062: c2 5e 00
+	call	routine			; 0065: cd 00 08
+	mov	c,a			; 0068: 4f
+	hlt				; 0069: 76
+
+	org	0800h
+routine:	mvi	a,1		; 0800: 3e 01
+	ret				; 0802: c9
@@ -0,0 +1,72 @@
+; Copies a block from memory to memory with the DMA controller, then
+; copies a byte over the block just past it, which repeats the byte
+; through the whole block as a byte at a time copy would.
+;
+; run: --dma
+; expect: B: 0x03
+; expect: C: 0x5a
+; expect: D: 0xa5
+; expect: E: 0xaa
+; expect: L: 0xaa
+; expect: T-states: 4475
+
+CH0ADDR	equ	50h			; Channel 0 address, low byte then high byte
+CH0TC	equ	51h			; Channel 0 terminal count
+CH1ADDR	equ	52h			; Channel 1 address
+MODE	equ	58h			; Mode set when written, status when read
+REQUEST	equ	59h			; Software request
+MEMMEM	equ	08h			; Copies channel 0's block to channel 1's address
+
+	org	0000h
+start:	jmp	main			; 0000: c3 40 00
+
+	org	0040h
+main:	mvi	a,00h			; 0040: 3e 00
+	out	CH0ADDR			; 0042: d3 50
+	mvi	a,10h			; 0044: 3e 10
+	out	CH0ADDR			; 0046: d3 50
+	mvi	a,0ffh			; 0048: 3e ff
+	out	CH0TC			; 004a: d3 51
+	mvi	a,00h			; 004c: 3e 00
+	out	CH0TC			; 004e: d3 51
+	mvi	a,00h			; 0050: 3e 00
+	out	CH1ADDR			; 0052: d3 52
+	mvi	a,20h			; 0054: 3e 20
+	out	CH1ADDR			; 0056: d3 52
+	mvi	a,03h			; 0058: 3e 03
+	out	MODE			; 005a: d3 58
+	mvi	a,MEMMEM		; 005c: 3e 08
+	out	REQUEST			; 005e: d3 59
+	in	MODE			; 0060: db 58
+	mov	b,a			; 0062: 47
+	lda	2000h			; 0063: 3a 00 20
+	mov	c,a			; 0066: 4f
+	lda	20ffh			; 0067: 3a ff 20
+	mov	d,a			; 006a: 57
+
+	mvi	a,0aah			; 006b: 3e aa
+	sta	3000h			; 006d: 32 00 30
+	mvi	a,00h			; 0070: 3e 00
+	out	CH0ADDR			; 0072: d3 50
+	mvi	a,30h			; 0074: 3e 30
+	out	CH0ADDR			; 0076: d3 50
+	mvi	a,0ffh			; 0078: 3e ff
+	out	CH0TC			; 007a: d3 51
+	mvi	a,00h			; 007c: 3e 00
+	out	CH0TC			; 007e: d3 51
+	mvi	a,01h			; 0080: 3e 01
+	out	CH1ADDR			; 0082: d3 52
+	mvi	a,30h			; 0084: 3e 30
+	out	CH1ADDR			; 0086: d3 52
+	mvi	a,MEMMEM		; 0088: 3e 08
+	out	REQUEST			; 008a: d3 59
+	lda	30ffh			; 008c: 3a ff 30
+	mov	e,a			; 008f: 5f
+	lda	3100h			; 0090: 3a 00 31
+	mov	l,a			; 0093: 6f
+	hlt				; 0094: 76
+
+	org	1000h
+block:	db	5ah			; 1000: 5a
+	org	10ffh
+	db	0a5h			; 10ff: a5
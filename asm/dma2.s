@@ -0,0 +1,56 @@
+; Has the DMA test device fill a block on channel 2, then read one back,
+; which waits while the channel is stopped at its terminal count until
+; the channel is enabled again.
+;
+; run: --dma --device=tests/dma.so
+; expect: abcdefghij
+; expect: B: 0x04
+; expect: C: 0x6a
+; expect: D: 0x00
+; expect: E: 0x04
+; expect: T-states: 364
+
+CH2ADDR	equ	54h			; Channel 2 address, low byte then high byte
+CH2TC	equ	55h			; Channel 2 terminal count, the transfer in its top two bits
+MODE	equ	58h			; Mode set when written, status when read
+TCSTOP	equ	40h			; A channel is disabled once its count is done
+DEVICE	equ	60h			; The test device requests the channel written
+
+	org	0000h
+start:	jmp	main			; 0000: c3 40 00
+
+	org	0040h
+main:	mvi	a,00h			; 0040: 3e 00
+	out	CH2ADDR			; 0042: d3 54
+	mvi	a,20h			; 0044: 3e 20
+	out	CH2ADDR			; 0046: d3 54
+	mvi	a,09h			; 0048: 3e 09
+	out	CH2TC			; 004a: d3 55
+	mvi	a,40h			; 004c: 3e 40
+	out	CH2TC			; 004e: d3 55
+	mvi	a,TCSTOP+04h		; 0050: 3e 44
+	out	MODE			; 0052: d3 58
+	mvi	a,2			; 0054: 3e 02
+	out	DEVICE			; 0056: d3 60
+	in	MODE			; 0058: db 58
+	mov	b,a			; 005a: 47
+	lda	2009h			; 005b: 3a 09 20
+	mov	c,a			; 005e: 4f
+
+	mvi	a,00h			; 005f: 3e 00
+	out	CH2ADDR			; 0061: d3 54
+	mvi	a,20h			; 0063: 3e 20
+	out	CH2ADDR			; 0065: d3 54
+	mvi	a,09h			; 0067: 3e 09
+	out	CH2TC			; 0069: d3 55
+	mvi	a,80h			; 006b: 3e 80
+	out	CH2TC			; 006d: d3 55
+	mvi	a,2			; 006f: 3e 02
+	out	DEVICE			; 0071: d3 60
+	in	MODE			; 0073: db 58
+	mov	d,a			; 0075: 57
+	mvi	a,TCSTOP+04h		; 0076: 3e 44
+	out	MODE			; 0078: d3 58
+	in	MODE			; 007a: db 58
+	mov	e,a			; 007c: 5f
+	hlt				; 007d: 76
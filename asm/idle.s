@@ -0,0 +1,36 @@
+; Halts waiting for console input, taking an interrupt for each character
+; and echoing it, until a full stop. The processor sleeps between
+; characters rather than running the halt.
+;
+; input: ab.
+; expect: B: 0x55
+; expect: Status: HLT
+
+CSTAT	equ	0			; Console status
+CDATA	equ	1			; Console data
+RXINT	equ	1			; Interrupt while a character is waiting
+
+	org	0000h
+start:	jmp	main			; 0000: c3 40 00
+
+	org	0008h
+rst1:	jmp	input			; 0008: c3 80 00
+
+	org	0040h
+main:	mvi	a,RXINT			; 0040: 3e 01
+	out	CSTAT			; 0042: d3 00
+	ei				; 0044: fb
+wait:	hlt				; 0045: 76
+	jmp	wait			; 0046: c3 45 00
+
+	org	0080h
+input:	in	CDATA			; 0080: db 01
+	cpi	'.'			; 0082: fe 2e
+	jz	done			; 0084: ca a0 00
+	out	CDATA			; 0087: d3 01
+	ei				; 0089: fb
+	ret				; 008a: c9
+
+	org	00a0h
+done:	mvi	b,55h			; 00a0: 06 55
+	ret				; 00a2: c9
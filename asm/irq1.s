@@ -0,0 +1,39 @@
+; Raises interrupt lines from the test device, with interrupts enabled
+; and then disabled. Without a PIC each line is taken as its RST once
+; interrupts are enabled, and one raised while they are disabled waits.
+;
+; run: --device=tests/irq.so
+; expect: B: 0x02
+; expect: C: 0x02
+; expect: D: 0x01
+; expect: Status: HLT  T-states: 222
+
+RAISE	equ	10h			; Raises the line written
+
+	org	0000h
+start:	jmp	main			; 0000: c3 40 00
+
+	org	0008h
+rst1:	inr	b			; 0008: 04
+	ei				; 0009: fb
+	ret				; 000a: c9
+
+	org	0010h
+rst2:	inr	c			; 0010: 0c
+	ei				; 0011: fb
+	ret				; 0012: c9
+
+	org	0040h
+main:	ei				; 0040: fb
+	mvi	a,1			; 0041: 3e 01
+	out	RAISE			; 0043: d3 10
+	mvi	a,2			; 0045: 3e 02
+	out	RAISE			; 0047: d3 10
+	di				; 0049: f3
+	mvi	a,1			; 004a: 3e 01
+	out	RAISE			; 004c: d3 10
+	mvi	a,2			; 004e: 3e 02
+	out	RAISE			; 0050: d3 10
+	ei				; 0052: fb
+	inr	d			; 0053: 14
+	hlt				; 0054: 76
@@ -0,0 +1,51 @@
+; Raises interrupt lines from the test device through the PIC. A line
+; masked off is not taken, and a line is not taken again until the one
+; being serviced has had its EOI.
+;
+; run: --pic --device=tests/irq.so
+; expect: A: 0x01
+; expect: B: 0x01
+; expect: C: 0x01
+; expect: Status: HLT  T-states: 211
+
+RAISE	equ	10h			; Raises the line written
+PIC	equ	20h			; PIC command
+PICMASK	equ	21h			; PIC interrupt mask
+EOI	equ	20h			; Non-specific end of interrupt
+
+	org	0000h
+start:	jmp	main			; 0000: c3 40 00
+
+	org	0008h
+rst1:	jmp	line1			; 0008: c3 80 00
+
+	org	0010h
+rst2:	jmp	line2			; 0010: c3 90 00
+
+	org	0040h
+main:	ei				; 0040: fb
+	mvi	a,2			; 0041: 3e 02
+	out	RAISE			; 0043: d3 10
+	mvi	a,2			; 0045: 3e 02
+	out	RAISE			; 0047: d3 10
+	mvi	a,1			; 0049: 3e 01
+	out	RAISE			; 004b: d3 10
+	mvi	a,2			; 004d: 3e 02
+	out	PICMASK			; 004f: d3 21
+	mvi	a,1			; 0051: 3e 01
+	out	RAISE			; 0053: d3 10
+	nop				; 0055: 00
+	nop				; 0056: 00
+	hlt				; 0057: 76
+
+	org	0080h
+line1:	inr	b			; 0080: 04
+	mvi	a,EOI			; 0081: 3e 20
+	out	PIC			; 0083: d3 20
+	ei				; 0085: fb
+	ret				; 0086: c9
+
+	org	0090h
+line2:	inr	c			; 0090: 0c
+	ei				; 0091: fb
+	ret				; 0092: c9
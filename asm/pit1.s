@@ -0,0 +1,42 @@
+; Runs counter 0 of the PIT as a rate generator, a tick every 1000 T-states,
+; and polls until ten have been taken. The counter is then latched and
+; read back, low byte first.
+;
+; run: --pit
+; expect: B: 0x0a
+; expect: C: 0x8b
+; expect: D: 0x03
+; expect: T-states: 10191
+
+COUNT0	equ	40h			; Counter 0, IRQ 2
+CTRL	equ	43h			; Control word
+RATE	equ	34h			; Counter 0, low then high byte, mode 2, binary
+LATCH	equ	00h			; Latches counter 0
+
+	org	0000h
+start:	jmp	main			; 0000: c3 40 00
+
+	org	0010h
+tick:	inr	b			; 0010: 04
+	ei				; 0011: fb
+	ret				; 0012: c9
+
+	org	0040h
+main:	mvi	a,RATE			; 0040: 3e 34
+	out	CTRL			; 0042: d3 43
+	mvi	a,0e8h			; 0044: 3e e8
+	out	COUNT0			; 0046: d3 40
+	mvi	a,03h			; 0048: 3e 03
+	out	COUNT0			; 004a: d3 40
+	ei				; 004c: fb
+poll:	mov	a,b			; 004d: 78
+	cpi	10			; 004e: fe 0a
+	jnz	poll			; 0050: c2 4d 00
+	di				; 0053: f3
+	mvi	a,LATCH			; 0054: 3e 00
+	out	CTRL			; 0056: d3 43
+	in	COUNT0			; 0058: db 40
+	mov	c,a			; 005a: 4f
+	in	COUNT0			; 005b: db 40
+	mov	d,a			; 005d: 57
+	hlt				; 005e: 76
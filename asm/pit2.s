@@ -0,0 +1,30 @@
+; Counts 5000 T-states down on counter 0 of the PIT, interrupting on the
+; terminal count, and halts for it. The counter is one-shot so only the
+; one interrupt comes.
+;
+; run: --pit
+; expect: B: 0x01
+; expect: T-states: 5098
+
+COUNT0	equ	40h			; Counter 0, IRQ 2
+CTRL	equ	43h			; Control word
+ONESHOT	equ	30h			; Counter 0, low then high byte, mode 0, binary
+
+	org	0000h
+start:	jmp	main			; 0000: c3 40 00
+
+	org	0010h
+tick:	inr	b			; 0010: 04
+	ret				; 0011: c9
+
+	org	0040h
+main:	mvi	a,ONESHOT		; 0040: 3e 30
+	out	CTRL			; 0042: d3 43
+	mvi	a,88h			; 0044: 3e 88
+	out	COUNT0			; 0046: d3 40
+	mvi	a,13h			; 0048: 3e 13
+	out	COUNT0			; 004a: d3 40
+	ei				; 004c: fb
+	hlt				; 004d: 76
+	di				; 004e: f3
+	hlt				; 004f: 76
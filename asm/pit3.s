@@ -0,0 +1,33 @@
+; Runs counter 0 of the PIT as a square wave, a tick every 1000 T-states,
+; and halts for three of them.
+;
+; run: --pit
+; expect: B: 0x03
+; expect: T-states: 3124
+
+COUNT0	equ	40h			; Counter 0, IRQ 2
+CTRL	equ	43h			; Control word
+SQUARE	equ	36h			; Counter 0, low then high byte, mode 3, binary
+
+	org	0000h
+start:	jmp	main			; 0000: c3 40 00
+
+	org	0010h
+tick:	inr	b			; 0010: 04
+	ei				; 0011: fb
+	ret				; 0012: c9
+
+	org	0040h
+main:	mvi	a,SQUARE		; 0040: 3e 36
+	out	CTRL			; 0042: d3 43
+	mvi	a,0e8h			; 0044: 3e e8
+	out	COUNT0			; 0046: d3 40
+	mvi	a,03h			; 0048: 3e 03
+	out	COUNT0			; 004a: d3 40
+	ei				; 004c: fb
+wait:	hlt				; 004d: 76
+	mov	a,b			; 004e: 78
+	cpi	3			; 004f: fe 03
+	jnz	wait			; 0051: c2 4d 00
+	di				; 0054: f3
+	hlt				; 0055: 76
@@ -0,0 +1,32 @@
+; Loads counter 1 of the PIT with a BCD count of 100, then latches and
+; reads it back a few instructions later. The count read is in BCD too.
+;
+; run: --pit
+; expect: C: 0x71
+; expect: T-states: 127
+
+COUNT1	equ	41h			; Counter 1
+CTRL	equ	43h			; Control word
+RATEBCD	equ	75h			; Counter 1, low then high byte, mode 2, BCD
+LATCH	equ	40h			; Latches counter 1
+
+	org	0000h
+start:	jmp	main			; 0000: c3 40 00
+
+	org	0040h
+main:	mvi	a,RATEBCD		; 0040: 3e 75
+	out	CTRL			; 0042: d3 43
+	mvi	a,00h			; 0044: 3e 00
+	out	COUNT1			; 0046: d3 41
+	mvi	a,01h			; 0048: 3e 01
+	out	COUNT1			; 004a: d3 41
+	nop				; 004c: 00
+	nop				; 004d: 00
+	nop				; 004e: 00
+	mvi	a,LATCH			; 004f: 3e 40
+	out	CTRL			; 0051: d3 43
+	in	COUNT1			; 0053: db 41
+	mov	c,a			; 0055: 4f
+	in	COUNT1			; 0056: db 41
+	mov	d,a			; 0058: 57
+	hlt				; 0059: 76
@@ -0,0 +1,9 @@
+; Spins forever with nothing that could break the loop, no interrupts
+; enabled and no device attached. The loop is seen to be spinning and
+; the run ends, halted, rather than the host spinning with it.
+;
+; expect: A: 0x05
+; expect: Status: HLT  T-states: 667
+
+start:	mvi	a,5			; 0000: 3e 05
+spin:	jmp	spin			; 0002: c3 02 00
@@ -0,0 +1,29 @@
+; Takes five ticks from the test device's timer, halting between them.
+; Each tick wakes the halt, so the run ends once the timer is stopped.
+;
+; run: --device=tests/tick.so
+; expect: B: 0x05
+; expect: Status: HLT  T-states: 50100
+
+PERIOD	equ	12h			; Starts the timer, a tick every 1000 T-states the value
+STOP	equ	13h			; Stops the timer
+
+	org	0000h
+start:	jmp	main			; 0000: c3 40 00
+
+	org	0010h
+tick:	inr	b			; 0010: 04
+	ei				; 0011: fb
+	ret				; 0012: c9
+
+	org	0040h
+main:	mvi	a,10			; 0040: 3e 0a
+	out	PERIOD			; 0042: d3 12
+	ei				; 0044: fb
+wait:	hlt				; 0045: 76
+	mov	a,b			; 0046: 78
+	cpi	5			; 0047: fe 05
+	jnz	wait			; 0049: c2 45 00
+	out	STOP			; 004c: d3 13
+	di				; 004e: f3
+	hlt				; 004f: 76
@@ -0,0 +1,29 @@
+; Takes five ticks from the test device's timer, polling for them in a
+; loop rather than halting. The loop must not be taken for a spin while
+; the timer is set.
+;
+; run: --device=tests/tick.so
+; expect: B: 0x05
+; expect: Status: HLT  T-states: 50118
+
+PERIOD	equ	12h			; Starts the timer, a tick every 1000 T-states the value
+STOP	equ	13h			; Stops the timer
+
+	org	0000h
+start:	jmp	main			; 0000: c3 40 00
+
+	org	0010h
+tick:	inr	b			; 0010: 04
+	ei				; 0011: fb
+	ret				; 0012: c9
+
+	org	0040h
+main:	mvi	a,10			; 0040: 3e 0a
+	out	PERIOD			; 0042: d3 12
+poll:	ei				; 0044: fb
+	mov	a,b			; 0045: 78
+	cpi	5			; 0046: fe 05
+	jnz	poll			; 0048: c2 44 00
+	out	STOP			; 004b: d3 13
+	di				; 004d: f3
+	hlt				; 004e: 76
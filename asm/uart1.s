@@ -0,0 +1,50 @@
+; Echoes what comes in on the USART back out, taking an interrupt for
+; each character and halting between them, until a full stop. The run
+; ends once the last character has gone out.
+;
+; send: hello world.
+; expect: hello world
+; expect: B: 0x2e
+; expect: Status: HLT
+
+UDATA	equ	10h			; USART data
+USTAT	equ	11h			; USART control when written, status when read
+MODE	equ	4eh			; Asynchronous, 16x clock, 8 bits, no parity, 1 stop bit
+ENABLE	equ	05h			; Transmit and receive enabled
+TXRDY	equ	01h
+TXEMPTY	equ	04h
+
+	org	0000h
+start:	jmp	main			; 0000: c3 40 00
+
+	org	0018h
+rst3:	jmp	received		; 0018: c3 80 00
+
+	org	0040h
+main:	mvi	a,MODE			; 0040: 3e 4e
+	out	USTAT			; 0042: d3 11
+	mvi	a,ENABLE		; 0044: 3e 05
+	out	USTAT			; 0046: d3 11
+	ei				; 0048: fb
+wait:	hlt				; 0049: 76
+	jmp	wait			; 004a: c3 49 00
+
+	org	0080h
+received:	in	UDATA		; 0080: db 10
+	mov	b,a			; 0082: 47
+	cpi	'.'			; 0083: fe 2e
+	jz	done			; 0085: ca a0 00
+send:	in	USTAT			; 0088: db 11
+	ani	TXRDY			; 008a: e6 01
+	jz	send			; 008c: ca 88 00
+	mov	a,b			; 008f: 78
+	out	UDATA			; 0090: d3 10
+	ei				; 0092: fb
+	ret				; 0093: c9
+
+	org	00a0h
+done:	in	USTAT			; 00a0: db 11
+	ani	TXEMPTY			; 00a2: e6 04
+	jz	done			; 00a4: ca a0 00
+	di				; 00a7: f3
+	hlt				; 00a8: 76
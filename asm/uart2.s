@@ -0,0 +1,44 @@
+; Echoes what comes in on the USART back out, polling its status for
+; each character, until a full stop. The run ends once the last
+; character has gone out.
+;
+; send: hello world.
+; expect: hello world
+; expect: B: 0x2e
+; expect: Status: HLT
+
+UDATA	equ	10h			; USART data
+USTAT	equ	11h			; USART control when written, status when read
+MODE	equ	4eh			; Asynchronous, 16x clock, 8 bits, no parity, 1 stop bit
+ENABLE	equ	05h			; Transmit and receive enabled
+TXRDY	equ	01h
+RXRDY	equ	02h
+TXEMPTY	equ	04h
+
+	org	0000h
+start:	jmp	main			; 0000: c3 40 00
+
+	org	0040h
+main:	mvi	a,MODE			; 0040: 3e 4e
+	out	USTAT			; 0042: d3 11
+	mvi	a,ENABLE		; 0044: 3e 05
+	out	USTAT			; 0046: d3 11
+poll:	in	USTAT			; 0048: db 11
+	ani	RXRDY			; 004a: e6 02
+	jz	poll			; 004c: ca 48 00
+	in	UDATA			; 004f: db 10
+	mov	b,a			; 0051: 47
+	cpi	'.'			; 0052: fe 2e
+	jz	done			; 0054: ca 70 00
+send:	in	USTAT			; 0057: db 11
+	ani	TXRDY			; 0059: e6 01
+	jz	send			; 005b: ca 57 00
+	mov	a,b			; 005e: 78
+	out	UDATA			; 005f: d3 10
+	jmp	poll			; 0061: c3 48 00
+
+	org	0070h
+done:	in	USTAT			; 0070: db 11
+	ani	TXEMPTY			; 0072: e6 04
+	jz	done			; 0074: ca 70 00
+	hlt				; 0077: 76
@@ -0,0 +1,33 @@
+; Runs each of the undocumented opcodes, which the 8080 takes as the
+; instructions they alias, with the same sizes and T-states.
+;
+; expect: A: 0x01  B: 0x03
+; expect: Status: HLT  T-states: 158
+
+start:	db	08h			; 0000: 08
+	db	10h			; 0001: 10
+	db	18h			; 0002: 18
+	db	20h			; 0003: 20
+	db	28h			; 0004: 28
+	db	30h			; 0005: 30
+	db	38h			; 0006: 38
+	nop				; 0007: 00
+	nop				; 0008: 00
+	nop				; 0009: 00
+	db	0ddh			; 000a: dd
+	dw	routine			; 000b: 20 00
+	inr	a			; 000d: 3c
+	db	0edh			; 000e: ed
+	dw	routine			; 000f: 20 00
+	db	0fdh			; 0011: fd
+	dw	routine			; 0012: 20 00
+	db	0cbh			; 0014: cb
+	dw	done			; 0015: 30 00
+	hlt				; 0017: 76
+
+	org	0020h
+routine:	inr	b		; 0020: 04
+	db	0d9h			; 0021: d9
+
+	org	0030h
+done:	hlt				; 0030: 76
@@ -0,0 +1,36 @@
+#include <stdint.h>
+
+#include "flags.h"
+
+// The tables are filled in by the preprocessor, each ROW macro expanding
+// its entry macro for a run of consecutive indices
+
+#define ROW4(entry, i) entry(i), entry((i) + 1), entry((i) + 2), entry((i) + 3)
+#define ROW16(entry, i) ROW4(entry, i), ROW4(entry, (i) + 4), ROW4(entry, (i) + 8), ROW4(entry, (i) + 12)
+#define ROW64(entry, i) ROW16(entry, i), ROW16(entry, (i) + 16), ROW16(entry, (i) + 32), ROW16(entry, (i) + 48)
+#define ROW256(entry, i) ROW64(entry, i), ROW64(entry, (i) + 64), ROW64(entry, (i) + 128), ROW64(entry, (i) + 192)
+#define ROW1024(entry, i) ROW256(entry, i), ROW256(entry, (i) + 256), ROW256(entry, (i) + 512), ROW256(entry, (i) + 768)
+
+
+#define ODD(v) (((v) ^ ((v) >> 1) ^ ((v) >> 2) ^ ((v) >> 3) ^ ((v) >> 4) ^ ((v) >> 5) ^ ((v) >> 6) ^ ((v) >> 7)) & 0x1)
+
+#define SZP_ENTRY(v) (((v) & FLAG_S) | ((v) == 0 ? FLAG_Z : 0) | (ODD(v) ? 0 : FLAG_P) | FLAG_1)
+
+const uint8_t szpTable[256] = { ROW256(SZP_ENTRY, 0) };
+
+
+#define DAA_A(i) ((i) & 0xFF)
+#define DAA_CY(i) (((i) >> 8) & 0x1)
+#define DAA_AC(i) (((i) >> 9) & 0x1)
+
+// Adds 6 to the low digit if it went past 9 or a carry came out of it, likewise 0x60 for the high digit
+#define DAA_LO(i) (((DAA_A(i) & 0xF) > 0x9 || DAA_AC(i)) ? 0x06 : 0x00)
+#define DAA_HI(i) ((DAA_A(i) > 0x99 || DAA_CY(i)) ? 0x60 : 0x00)
+
+#define DAA_RES(i) ((DAA_A(i) + DAA_LO(i) + DAA_HI(i)) & 0xFF)
+#define DAA_NEWAC(i) (((DAA_A(i) & 0xF) + DAA_LO(i)) > 0xF ? FLAG_AC : 0)
+#define DAA_NEWCY(i) (DAA_HI(i) ? FLAG_CY : 0)
+
+#define DAA_ENTRY(i) ((DAA_RES(i) << 8) | DAA_NEWAC(i) | DAA_NEWCY(i))
+
+const uint16_t daaTable[1024] = { ROW1024(DAA_ENTRY, 0) };
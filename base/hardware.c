@@ -3,65 +3,167 @@
 #include "hardware.h"
 #include "machine.h"
 #include "mem.h"
+#include "flags.h"
 
-extern machine_t guest;
 
-void regarray(bool wr, uint8_t src, uint8_t dst) {
+void regarray(machine_t* m, bool wr, uint8_t src, uint8_t dst) {
 	if (wr) {
-		guest.proc->gpr[dst] = guest.proc->bus.databus;
-	} else guest.proc->bus.databus = guest.proc->gpr[src];
+		m->proc->gpr[dst] = m->proc->bus.databus;
+	} else m->proc->bus.databus = m->proc->gpr[src];
 }
 
-void alu(alu_op_t aluop, bool seteflags) {
-	uint8_t	res = 0;
+void alu(machine_t* m, alu_op_t aluop, bool seteflags) {
+	uint16_t res = 0;
 
-	uint8_t a = guest.proc->alureg[ACC_LATCH];
-	uint8_t b = guest.proc->alureg[TEMP];
+	uint8_t a = m->proc->alureg[ACC_LATCH];
+	uint8_t b = m->proc->alureg[TEMP];
+
+	flag_op_t flagop = FLAGS_NONE;
+	uint8_t eflags = 0x0; // For the operations that set the flag word outright
 
 	switch (aluop)	{
 		case PLUS_OP:
 			res = a + b;
+			flagop = FLAGS_ADD;
+			break;
+		case PLUS_CY_OP:
+			res = a + b + getCY(m);
+			flagop = FLAGS_ADD;
 			break;
 		case MINUS_OP:
 			res = a - b;
+			flagop = FLAGS_SUB;
+			break;
+		case MINUS_CY_OP:
+			res = a - b - getCY(m);
+			flagop = FLAGS_SUB;
+			break;
 		case OR_OP:
 			res = a | b;
+			flagop = FLAGS_LOGIC;
+			break;
 		case XOR_OP:
 			res = a ^ b;
+			flagop = FLAGS_LOGIC;
+			break;
 		case AND_OP:
 			res = a & b;
+			flagop = FLAGS_AND;
+			break;
+		case INC_OP:
+			// Recorded as adding 1, with the carry it leaves alone in bit 8
+			b = 0x1;
+			res = (uint8_t) (a + 1) | (getCY(m) << 8);
+			flagop = FLAGS_ADD;
+			break;
+		case DEC_OP:
+			b = 0x1;
+			res = (uint8_t) (a - 1) | (getCY(m) << 8);
+			flagop = FLAGS_SUB;
+			break;
+		case RLC_OP:
+			res = (uint8_t) ((a << 1) | (a >> 7));
+			if (seteflags) setCY(m, a >> 7);
+			break;
+		case RRC_OP:
+			res = (uint8_t) ((a >> 1) | (a << 7));
+			if (seteflags) setCY(m, a & 0x1);
+			break;
+		case RAL_OP:
+			res = (uint8_t) ((a << 1) | getCY(m));
+			if (seteflags) setCY(m, a >> 7);
+			break;
+		case RAR_OP:
+			res = (uint8_t) ((a >> 1) | (getCY(m) << 7));
+			if (seteflags) setCY(m, a & 0x1);
+			break;
+		case DAA_OP: {
+			eflags = getEflags(m);
+			uint16_t adjust = daaTable[a | ((eflags & FLAG_CY) << 8) | ((eflags & FLAG_AC) << 5)];
+			res = adjust >> 8;
+			eflags = szpTable[res] | (adjust & (FLAG_AC | FLAG_CY));
+			if (seteflags) setEflags(m, eflags);
+			break;
+		}
 		default:
 			break;
 	}
 
-	guest.proc->bus.databus = res;
+	m->proc->bus.databus = (uint8_t) res;
+
+	if (seteflags && flagop != FLAGS_NONE) {
+		m->proc->lazy.op = flagop;
+		m->proc->lazy.a = a;
+		m->proc->lazy.b = b;
+		m->proc->lazy.res = res;
+	}
+}
+
+uint8_t getEflags(machine_t* m) {
+	lazy_flags_t* lazy = &m->proc->lazy;
+
+	if (lazy->op == FLAGS_NONE) return m->proc->eflags;
+
+	uint8_t r = lazy->res & 0xFF;
+	uint8_t cy = (lazy->res >> 8) & FLAG_CY;
 
-	if (seteflags) {
+	// For additions, bit n of a ^ b ^ res is the carry into bit n, so bit 4 is the auxiliary carry
+	// Subtraction is done as addition of the complement, which flips that bit
+	uint8_t carries = lazy->a ^ lazy->b ^ r;
+	uint8_t eflags = szpTable[r] | cy;
 
+	switch (lazy->op) {
+		case FLAGS_ADD:
+			eflags |= carries & FLAG_AC;
+			break;
+		case FLAGS_SUB:
+			eflags |= ~carries & FLAG_AC;
+			break;
+		case FLAGS_AND:
+			// The 8080 sets the auxiliary carry to the OR of bit 3 of the operands
+			eflags |= ((lazy->a | lazy->b) << 1) & FLAG_AC;
+			break;
+		default:
+			break;
 	}
+
+	m->proc->eflags = eflags;
+	lazy->op = FLAGS_NONE;
+
+	return eflags;
+}
+
+void setEflags(machine_t* m, uint8_t eflags) {
+	m->proc->eflags = eflags;
+	m->proc->lazy.op = FLAGS_NONE;
+}
+
+bool getAC(machine_t* m) {
+	return getEflags(m) & FLAG_AC;
 }
 
-void sendStatusToData() {
-	uint8_t d0 = State.statusSigs.INTA;
-	uint8_t d1 = State.statusSigs._WO;
-	uint8_t d2 = State.statusSigs.STACK;
-	uint8_t d3 = State.statusSigs.HLTA;
-	uint8_t d4 = State.statusSigs.OUT;
-	uint8_t d5 = State.statusSigs.M1;
-	uint8_t d6 = State.statusSigs.INP;
-	uint8_t d7 = State.statusSigs.MEMR;
+void sendStatusToData(machine_t* m) {
+	uint8_t d0 = State(m).statusSigs.INTA;
+	uint8_t d1 = State(m).statusSigs._WO;
+	uint8_t d2 = State(m).statusSigs.STACK;
+	uint8_t d3 = State(m).statusSigs.HLTA;
+	uint8_t d4 = State(m).statusSigs.OUT;
+	uint8_t d5 = State(m).statusSigs.M1;
+	uint8_t d6 = State(m).statusSigs.INP;
+	uint8_t d7 = State(m).statusSigs.MEMR;
 
 	uint8_t statusWord = ((d7<<7)|(d6<<6)|(d5<<5)|(d4<<4)|(d3<<3)|(d2<<2)|(d1<<1)|(d0<<0));
 
-	Bus.databus = statusWord;
+	Bus(m).databus = statusWord;
 }
 
-void latchStatus() {
-	static uint8_t statusLatch = 0x0;
-
-	statusLatch = DataBus;
+void latchStatus(machine_t* m) {
+	uint8_t statusLatch = DataBus(m);
 	// printf("Status latch: 0x%x\n", statusLatch);
-	DataBus = 0x0;
+	DataBus(m) = 0x0;
+
+	// A new machine cycle, clear out the previous control signals
+	Bus(m).ctrlbus = 0x0;
 
 	bool INTA = (statusLatch>>0) & 0x1;
 	bool _WO = (statusLatch>>1) & 0x1;
@@ -74,27 +176,201 @@ void latchStatus() {
 
 
 	// Set INTA
-	if (INTA && State.ctrSigs.DBIN) {
+	if (INTA && State(m).ctrSigs.DBIN) {
 		// printf("If INTA and DBIN --> INTA\n");
-		Bus.ctrlbus |= (1<<0);
+		Bus(m).ctrlbus |= (1<<0);
 	}
-	if (MEMR && State.ctrSigs.DBIN) {
+	if (MEMR && State(m).ctrSigs.DBIN) {
 		// printf("If MEMR && DBIN --> MEMR\n");
-		Bus.ctrlbus |= (1<<1);
+		Bus(m).ctrlbus |= (1<<1);
 	}
-	if (!OUT && !State.ctrSigs._WR) {
+	if (!OUT && !State(m).ctrSigs._WR) {
 		// printf("If ~OUT && ~_WR --> MEMW\n");
-		Bus.ctrlbus |= (1<<2);
+		Bus(m).ctrlbus |= (1<<2);
+	}
+	if (INP && State(m).ctrSigs.DBIN) {
+		Bus(m).ctrlbus |= (1<<3);
+	}
+	if (OUT && !State(m).ctrSigs._WR) {
+		Bus(m).ctrlbus |= (1<<4);
 	}
 }
 
-void mem() {
-	State.ctrSigs.WAIT = true;
+void mem(machine_t* m) {
+	// READY is held low for the wait states, each a TW state with WAIT asserted
+	State(m).ctrSigs.WAIT = true;
+	m->proc->cycles += m->waitStates;
 
 	// MEMR
-	if ((((Bus.ctrlbus >> 1) & 0x1) == 0x1) && State.ctrSigs.DBIN) memRead();
-	if (((Bus.ctrlbus >> 0) & 0x1) == 0x1) memWrite();
+	if ((((Bus(m).ctrlbus >> 1) & 0x1) == 0x1) && State(m).ctrSigs.DBIN) memRead(m);
+	// MEMW
+	if (((Bus(m).ctrlbus >> 2) & 0x1) == 0x1) memWrite(m);
 
 
-	State.ctrSigs.WAIT = false;
-}
\ No newline at end of file
+	State(m).ctrSigs.WAIT = false;
+}
+
+void io(machine_t* m) {
+	State(m).ctrSigs.WAIT = true;
+	m->proc->cycles += m->waitStates;
+
+	// The port is on both halves of the address bus
+	// I/OR
+	if ((((Bus(m).ctrlbus >> 3) & 0x1) == 0x1) && State(m).ctrSigs.DBIN) DataBus(m) = portIn(m->ports, AddrBus(m) & 0xFF);
+	// I/OW
+	if (((Bus(m).ctrlbus >> 4) & 0x1) == 0x1) portOut(m->ports, AddrBus(m) & 0xFF, DataBus(m));
+
+	State(m).ctrSigs.WAIT = false;
+}
+
+uint8_t readCycle(machine_t* m, uint16_t addr, bool stack) {
+	State(m).statusSigs.INTA = false;
+	State(m).statusSigs._WO = true;
+	State(m).statusSigs.STACK = stack;
+	State(m).statusSigs.HLTA = false;
+	State(m).statusSigs.OUT = false;
+	State(m).statusSigs.M1 = false;
+	State(m).statusSigs.INP = false;
+	State(m).statusSigs.MEMR = true;
+
+	State(m).ctrSigs._WR = true;
+
+	// T1
+	AddrBus(m) = addr;
+	sendStatusToData(m);
+
+	// T2
+	State(m).ctrSigs.DBIN = true;
+	latchStatus(m);
+
+	// Processor entering TW state
+	mem(m);
+
+	// T3
+	State(m).intdatabus = DataBus(m);
+	State(m).ctrSigs.DBIN = false;
+
+	return State(m).intdatabus;
+}
+
+void writeCycle(machine_t* m, uint16_t addr, uint8_t data, bool stack) {
+	State(m).statusSigs.INTA = false;
+	State(m).statusSigs._WO = false;
+	State(m).statusSigs.STACK = stack;
+	State(m).statusSigs.HLTA = false;
+	State(m).statusSigs.OUT = false;
+	State(m).statusSigs.M1 = false;
+	State(m).statusSigs.INP = false;
+	State(m).statusSigs.MEMR = false;
+
+	State(m).ctrSigs.DBIN = false;
+
+	// T1
+	AddrBus(m) = addr;
+	sendStatusToData(m);
+
+	// T2
+	State(m).ctrSigs._WR = false;
+	latchStatus(m);
+
+	State(m).intdatabus = data;
+	DataBus(m) = State(m).intdatabus;
+
+	// Processor entering TW state
+	mem(m);
+
+	// T3
+	State(m).ctrSigs._WR = true;
+}
+uint8_t inCycle(machine_t* m, uint8_t port) {
+	State(m).statusSigs.INTA = false;
+	State(m).statusSigs._WO = true;
+	State(m).statusSigs.STACK = false;
+	State(m).statusSigs.HLTA = false;
+	State(m).statusSigs.OUT = false;
+	State(m).statusSigs.M1 = false;
+	State(m).statusSigs.INP = true;
+	State(m).statusSigs.MEMR = false;
+
+	State(m).ctrSigs._WR = true;
+
+	// T1
+	AddrBus(m) = (port << 8) | port;
+	sendStatusToData(m);
+
+	// T2
+	State(m).ctrSigs.DBIN = true;
+	latchStatus(m);
+
+	// Processor entering TW state
+	io(m);
+
+	// T3
+	State(m).intdatabus = DataBus(m);
+	State(m).ctrSigs.DBIN = false;
+
+	return State(m).intdatabus;
+}
+
+void outCycle(machine_t* m, uint8_t port, uint8_t data) {
+	State(m).statusSigs.INTA = false;
+	State(m).statusSigs._WO = false;
+	State(m).statusSigs.STACK = false;
+	State(m).statusSigs.HLTA = false;
+	State(m).statusSigs.OUT = true;
+	State(m).statusSigs.M1 = false;
+	State(m).statusSigs.INP = false;
+	State(m).statusSigs.MEMR = false;
+
+	State(m).ctrSigs.DBIN = false;
+
+	// T1
+	AddrBus(m) = (port << 8) | port;
+	sendStatusToData(m);
+
+	// T2
+	State(m).ctrSigs._WR = false;
+	latchStatus(m);
+
+	State(m).intdatabus = data;
+	DataBus(m) = State(m).intdatabus;
+
+	// Processor entering TW state
+	io(m);
+
+	// T3
+	State(m).ctrSigs._WR = true;
+}
+
+uint8_t intaCycle(machine_t* m, uint8_t opcode) {
+	State(m).statusSigs.INTA = true;
+	State(m).statusSigs._WO = true;
+	State(m).statusSigs.STACK = false;
+	State(m).statusSigs.HLTA = false;
+	State(m).statusSigs.OUT = false;
+	State(m).statusSigs.M1 = true;
+	State(m).statusSigs.INP = false;
+	State(m).statusSigs.MEMR = false;
+
+	State(m).ctrSigs._WR = true;
+
+	// T1, the PC goes out but nothing reads memory at it
+	AddrBus(m) = m->proc->PC;
+	sendStatusToData(m);
+
+	// T2
+	State(m).ctrSigs.DBIN = true;
+	latchStatus(m);
+
+	// The interrupting device answers INTA with the opcode
+	State(m).ctrSigs.WAIT = true;
+	m->proc->cycles += m->waitStates;
+	DataBus(m) = opcode;
+	State(m).ctrSigs.WAIT = false;
+
+	// T3
+	State(m).intdatabus = DataBus(m);
+	State(m).ctrSigs.DBIN = false;
+
+	return State(m).intdatabus;
+}
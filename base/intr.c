@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "intr.h"
+#include "machine.h"
+#include "hardware.h"
+
+
+#define ICW1 0x10 // On the command port, starts initialization
+#define ICW1_ICW4 0x01 // ICW4 is to come
+#define ICW1_SINGLE 0x02 // No ICW3, there are no cascaded controllers
+#define OCW3 0x08 // On the command port, with ICW1 clear
+#define OCW3_READ 0x02 // Chooses what the command port reads
+#define OCW3_ISR 0x01 // Reads the lines in service
+#define OCW2_EOI 0x20 // Ends the interrupt in service
+#define OCW2_SPECIFIC 0x40 // The line to end is in the bottom bits, rather than the highest in service
+
+
+/**
+ * Gets the line with the highest priority ready to be taken, the lowest numbered.
+ * @return The line, or -1 if there is none
+ */
+static int nextLine(const intr_t* intr) {
+	uint8_t ready = intr->request & ~intr->mask;
+	if (!ready) return -1;
+
+	int line = __builtin_ctz(ready);
+
+	// The controller holds back anything not above the highest priority in service
+	if (intr->service && line >= __builtin_ctz(intr->service)) return -1;
+
+	return line;
+}
+
+void initInterrupts(machine_t* m) {
+	intr_t* intr = m->intr;
+
+	intr->request = 0x00;
+	intr->mask = 0x00;
+	intr->service = 0x00;
+	intr->pending = false;
+	intr->enabledAt = 0;
+	intr->pic = false;
+	intr->picPort = 0;
+	intr->initWords = 0;
+	intr->readService = false;
+}
+
+void updateInterrupts(machine_t* m) {
+	intr_t* intr = m->intr;
+
+	intr->pending = State(m).ctrSigs.INTE && nextLine(intr) >= 0;
+
+	// Blocks run until the next event, so one due now has them stop after the one running
+	if (intr->pending) m->nextEvent = 0;
+}
+
+void takeInterrupt(machine_t* m) {
+	intr_t* intr = m->intr;
+	int line = nextLine(intr);
+
+	intr->request &= ~(1 << line);
+	if (intr->pic) intr->service |= 1 << line;
+	State(m).ctrSigs.INTE = false;
+	updateInterrupts(m);
+
+	// The RST comes in off the data bus in place of an opcode, it does not move the PC past anything
+	uint8_t opcode = RST_OPCODE(line);
+	m->proc->IR = (m->mode == CYCLE_MODE) ? intaCycle(m, opcode) : opcode;
+
+	insn_t insn;
+	decode(m, &insn);
+
+	// The bus counts the wait states of the acknowledge and the pushes in cycle mode
+	if (m->mode == FAST_MODE) insn.tstates += busCycles(&insn) * m->waitStates;
+	insn.size = 0;
+	execute(m, &insn);
+}
+
+void raiseIrq(machine_t* m, int line) {
+	m->intr->request |= 1 << line;
+	updateInterrupts(m);
+}
+
+void lowerIrq(machine_t* m, int line) {
+	m->intr->request &= ~(1 << line);
+	updateInterrupts(m);
+}
+
+static uint8_t commandIn(void* ctx, uint8_t port) {
+	intr_t* intr = ((machine_t*) ctx)->intr;
+
+	return intr->readService ? intr->service : intr->request;
+}
+
+static void commandOut(void* ctx, uint8_t port, uint8_t data) {
+	machine_t* m = (machine_t*) ctx;
+	intr_t* intr = m->intr;
+
+	if (data & ICW1) {
+		// The vector base and the rest of ICW2 on have no meaning here, line n is always RST n
+		intr->mask = 0x00;
+		intr->service = 0x00;
+		intr->readService = false;
+		intr->initWords = 1 + !(data & ICW1_SINGLE) + (data & ICW1_ICW4);
+	} else if (data & OCW3) {
+		if (data & OCW3_READ) intr->readService = data & OCW3_ISR;
+	} else if (data & OCW2_EOI) {
+		if (data & OCW2_SPECIFIC) intr->service &= ~(1 << (data & 0x7));
+		else intr->service &= intr->service - 1;
+	}
+
+	updateInterrupts(m);
+}
+
+static uint8_t maskIn(void* ctx, uint8_t port) {
+	return ((machine_t*) ctx)->intr->mask;
+}
+
+static void maskOut(void* ctx, uint8_t port, uint8_t data) {
+	machine_t* m = (machine_t*) ctx;
+	intr_t* intr = m->intr;
+
+	if (intr->initWords > 0) {
+		intr->initWords--;
+		return;
+	}
+
+	intr->mask = data;
+	updateInterrupts(m);
+}
+
+void attachPic(machine_t* m, uint8_t port) {
+	intr_t* intr = m->intr;
+
+	intr->pic = true;
+	intr->picPort = port;
+	attachPort(m->ports, port, commandIn, commandOut, m);
+	attachPort(m->ports, port + 1, maskIn, maskOut, m);
+}
@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <dlfcn.h>
+
+#include "io.h"
+#include "machine.h"
+
+
+// Nothing drives the data bus
+static uint8_t noDeviceIn(void* ctx, uint8_t port) {
+	return 0xFF;
+}
+
+// The output goes nowhere
+static void noDeviceOut(void* ctx, uint8_t port, uint8_t data) {
+}
+
+void initPorts(ports_t* ports) {
+	for (int port = 0; port < NUM_PORTS; port++) attachPort(ports, port, NULL, NULL, NULL);
+
+	ports->plugins = NULL;
+}
+
+void attachPort(ports_t* ports, uint8_t port, m80_port_in_t in, m80_port_out_t out, void* ctx) {
+	ports->in[port] = in ? in : noDeviceIn;
+	ports->out[port] = out ? out : noDeviceOut;
+	ports->ctx[port] = ctx;
+}
+
+int loadDevice(machine_t* m, const char* path, const char* args) {
+	void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (!handle) {
+		fprintf(stderr, "%s\n", dlerror());
+		return -1;
+	}
+
+	m80_device_init_t init = (m80_device_init_t) dlsym(handle, M80_DEVICE_INIT);
+	if (!init) {
+		fprintf(stderr, "%s: Not a device plugin!\n", path);
+		dlclose(handle);
+		return -1;
+	}
+
+	void* device = init(m, args, M80_DEVICE_ABI);
+	if (!device) {
+		fprintf(stderr, "%s: Device could not be set up\n", path);
+		dlclose(handle);
+		return -1;
+	}
+
+	plugin_t* plugin = (plugin_t*) malloc(sizeof(plugin_t));
+	plugin->handle = handle;
+	plugin->device = device;
+	plugin->free = (m80_device_free_t) dlsym(handle, M80_DEVICE_FREE);
+	plugin->next = m->ports->plugins;
+	m->ports->plugins = plugin;
+
+	return 0;
+}
+
+void freePorts(ports_t* ports) {
+	while (ports->plugins) {
+		plugin_t* plugin = ports->plugins;
+		ports->plugins = plugin->next;
+
+		if (plugin->free) plugin->free(plugin->device);
+		dlclose(plugin->handle);
+		free(plugin);
+	}
+}
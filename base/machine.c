@@ -1,9 +1,21 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "machine.h"
+#include "hardware.h"
+#include "aef-loadrun.h"
+#include "snapshot.h"
+#include "console.h"
+#include "idle.h"
+#include "pace.h"
+#include "timer.h"
+#include "pit.h"
+#include "uart.h"
+#include "disk.h"
+#include "dma.h"
+#include "bank.h"
 
-extern machine_t guest;
 
 static uint16_t segStarts[] = {
 	0x0000, // text-data starts at 0
@@ -11,43 +23,345 @@ static uint16_t segStarts[] = {
 	0x8800, // stack starts at 0x0+34KB
 };
 
-void initMachine() {
-	guest.name = "m80";
+machine_t* m80_create() {
+	machine_t* m = (machine_t*) malloc(sizeof(machine_t));
 
-	guest.proc = (proc_t*) malloc(sizeof(proc_t));
-	
+	m->name = "m80";
+	m->mode = FAST_MODE;
+	m->waitStates = 0;
+
+	m->proc = (proc_t*) malloc(sizeof(proc_t));
+	m->mem = (mem_t*) malloc(sizeof(mem_t));
+	if (initMem(m->mem) != 0) {
+		free(m->mem);
+		free(m->proc);
+		free(m);
+		return NULL;
+	}
+	m->ports = (ports_t*) malloc(sizeof(ports_t));
+	initPorts(m->ports);
+	m->intr = (intr_t*) malloc(sizeof(intr_t));
+	initInterrupts(m);
+	m->timers = (timers_t*) malloc(sizeof(timers_t));
+	initTimers(m->timers);
+	m->cache = NULL;
+	m->jit = NULL;
+	m->profile = NULL;
+	m->baseline = NULL;
+	m->checkpoint = NULL;
+	m->console = NULL;
+	m->pit = NULL;
+	m->uart = NULL;
+	m->disk = NULL;
+	m->dma = NULL;
+	m->banks = NULL;
+	m->idle = (idle_t*) malloc(sizeof(idle_t));
+	initIdle(m->idle);
+	m->pace = NULL;
+	m->nextEvent = 0;
+
+	m80_reset(m);
+
+	return m;
+}
+
+void m80_reset(machine_t* m) {
 	for (int i = 0; i < 6; i++) {
-		guest.proc->gpr[i] = 0x00;
+		m->proc->gpr[i] = 0x00;
 	}
 	for (int i = 0; i < 3; i++) {
-		guest.proc->alureg[i] = 0x00;
+		m->proc->alureg[i] = 0x00;
 	}
 	for (int i = 0; i < 2; i++) {
-		guest.proc->tempreg[i] = 0x00;
+		m->proc->tempreg[i] = 0x00;
 	}
 
-	guest.proc->IR = 0x0;
-	guest.proc->PC = 0x00;
-	guest.proc->SP = 0x00;
+	m->proc->IR = 0x0;
+	m->proc->PC = 0x00;
+	m->proc->SP = 0x00;
 	
-	AddrBus = 0x00;
-	DataBus = 0x0;
-	CtrlBus = 0x0;
+	AddrBus(m) = 0x00;
+	DataBus(m) = 0x0;
+	CtrlBus(m) = 0x0;
 
-	guest.proc->eflags = PACK_EFLAGS(0,0,0,0,0);
+	m->proc->eflags = PACK_EFLAGS(0,0,0,0,0);
+	m->proc->lazy.op = FLAGS_NONE;
 
-	State.intdatabus = 0x0;
+	// Devices go back to how they were attached, leaving nothing set for the count being started over
+	if (m->pit) resetPit(m);
+	if (m->uart) resetUart(m);
+	if (m->disk) resetDisk(m);
+	if (m->dma) resetDma(m);
+
+	// Only plugins' timers are left, and they stay as far off as they were, as do the run loop's own deadlines
+	rewindTimers(m, m->proc->cycles);
+	if (m->console) {
+		flushConsole(m->console);
+		m->console->pollAt = 0;
+	}
+	m->idle->pollAt = 0;
+	m->intr->enabledAt = 0;
+	if (m->checkpoint) m->checkpoint->next = m->checkpoint->interval;
+	m->nextEvent = 0;
+	m->proc->cycles = 0;
+	m->proc->status = STAT_OK;
 
-	guest.mem = (mem_t*) malloc(sizeof(mem_t));
-	guest.mem->maxAddr = MAX_ADDR;
-	guest.mem->wordSize = WORD_SIZE;
+	// Clears every signal, a halt left over from the last program would stall fetch
+	memset(&State(m), 0, sizeof(state_t));
+
+	m->mem->maxAddr = MAX_ADDR;
+	m->mem->wordSize = WORD_SIZE;
 	for (int i = 0; i <= STACK_SEG; i++) {
-		guest.mem->segStart[i] = segStarts[i];
+		m->mem->segStart[i] = segStarts[i];
 	}
+	// Every window goes back to its own place in the RAM, cleared along with it
+	if (m->banks) resetBanks(m);
+	memset(m->mem->ram, 0x00, MAX_ADDR + 1);
+	memset(m->mem->dirty, DIRTY_ALL, MEM_PAGES);
+	m->mem->imageCurrent = false;
+	m->mem->faultAddr = 0x0000;
+
+	// Requests from before are dropped, the controller stays attached
+	m->intr->request = 0x00;
+	m->intr->service = 0x00;
+	m->intr->pending = false;
+
+	mapSegments(m);
 
 	// Add stack canary
-	guest.mem->ram[guest.mem->segStart[STACK_SEG] - 1] = 0xFE;
-	guest.mem->ram[guest.mem->segStart[STACK_SEG] - 2] = 0xED;
-	guest.mem->ram[guest.mem->segStart[STACK_SEG] - 3] = 0xFA;
-	guest.mem->ram[guest.mem->segStart[STACK_SEG] - 4] = 0xED;
+	m->mem->ram[m->mem->segStart[STACK_SEG] - 1] = 0xFE;
+	m->mem->ram[m->mem->segStart[STACK_SEG] - 2] = 0xED;
+	m->mem->ram[m->mem->segStart[STACK_SEG] - 3] = 0xFA;
+	m->mem->ram[m->mem->segStart[STACK_SEG] - 4] = 0xED;
+}
+
+int m80_load(machine_t* m, const char* filename, uint16_t* entry) {
+	m->mem->imageCurrent = false;
+	return loadAEF(m, filename, entry);
+}
+
+int m80_run(machine_t* m, uint16_t entry) {
+	m->mem->imageCurrent = false;
+	return runAEF(m, entry);
+}
+
+int m80_resume(machine_t* m) {
+	m->mem->imageCurrent = false;
+	return resumeAEF(m);
+}
+
+int m80_save(machine_t* m, const char* filename) {
+	return saveSnapshot(m, filename);
+}
+
+int m80_restore(machine_t* m, const char* filename) {
+	m->mem->imageCurrent = false;
+	return restoreSnapshot(m, filename);
+}
+
+int m80_checkpoint(machine_t* m, const char* filename, uint64_t interval) {
+	if (!filename) {
+		stopCheckpoints(m);
+		return 0;
+	}
+
+	return startCheckpoints(m, filename, interval);
+}
+
+void m80_set_baseline(machine_t* m) {
+	setBaseline(m);
+}
+
+int m80_reset_baseline(machine_t* m) {
+	m->mem->imageCurrent = false;
+	return resetBaseline(m);
+}
+
+void m80_attach_port(machine_t* m, uint8_t port, m80_port_in_t in, m80_port_out_t out, void* ctx) {
+	attachPort(m->ports, port, in, out, ctx);
+}
+
+int m80_load_device(machine_t* m, const char* path, const char* args) {
+	return loadDevice(m, path, args);
+}
+
+void m80_set_wait_states(machine_t* m, uint8_t waitStates) {
+	m->waitStates = waitStates;
+
+	// Decoded blocks count the wait states they were decoded with
+	flushBlocks(m);
+}
+
+uint64_t m80_cycles(machine_t* m) {
+	return m->proc->cycles;
+}
+
+int m80_add_timer(machine_t* m, m80_timer_fn_t fire, void* ctx) {
+	return addTimer(m, fire, ctx);
+}
+
+void m80_set_timer(machine_t* m, int timer, uint64_t at) {
+	setTimer(m, timer, at);
+}
+
+void m80_stop_timer(machine_t* m, int timer) {
+	stopTimer(m, timer);
+}
+
+void m80_set_clock(machine_t* m, uint64_t hz) {
+	setClock(m, hz);
+}
+
+void m80_raise_irq(machine_t* m, int line) {
+	raiseIrq(m, line);
+}
+
+void m80_lower_irq(machine_t* m, int line) {
+	lowerIrq(m, line);
+}
+
+void m80_attach_pic(machine_t* m, uint8_t port) {
+	attachPic(m, port);
+}
+
+int m80_watch_fd(machine_t* m, int fd, m80_ready_t ready, void* ctx) {
+	return watchFd(m, fd, ready, ctx);
+}
+
+void m80_unwatch_fd(machine_t* m, int fd) {
+	unwatchFd(m, fd);
+}
+
+void m80_attach_console(machine_t* m, int in, int out) {
+	attachConsole(m, in, out);
+}
+
+void m80_attach_pit(machine_t* m, uint8_t port, uint32_t tstates) {
+	attachPit(m, port, tstates);
+}
+
+int m80_attach_uart(machine_t* m, uint8_t port, const char* path, uint64_t bitTstates) {
+	return attachUart(m, port, path, bitTstates);
+}
+
+int m80_attach_disk(machine_t* m, uint8_t port, const char* path, uint16_t sectorSize) {
+	return attachDisk(m, port, path, sectorSize);
+}
+
+void m80_attach_dma(machine_t* m, uint8_t port) {
+	attachDma(m, port);
+}
+
+int m80_attach_dma_channel(machine_t* m, int channel, m80_dma_in_t in, m80_dma_out_t out, void* ctx) {
+	return attachDmaChannel(m, channel, in, out, ctx);
+}
+
+void m80_request_dma(machine_t* m, int channel) {
+	requestDma(m, channel);
+}
+
+int m80_attach_banks(machine_t* m, uint8_t port, const uint16_t* windows, int numWindows, uint32_t size, int count) {
+	return attachBanks(m, port, windows, numWindows, size, count);
+}
+
+machine_t* m80_fork(machine_t* m) {
+	machine_t* child = (machine_t*) malloc(sizeof(machine_t));
+
+	child->name = m->name;
+	child->mode = m->mode;
+	child->waitStates = m->waitStates;
+
+	child->proc = (proc_t*) malloc(sizeof(proc_t));
+	*child->proc = *m->proc;
+
+	child->mem = (mem_t*) malloc(sizeof(mem_t));
+	if (forkMem(m->mem, child->mem) != 0) {
+		free(child->mem);
+		free(child->proc);
+		free(child);
+		return NULL;
+	}
+
+	// The devices stay the parent's, for it to unload, but ones handed the machine itself
+	// would act on the parent and are left off
+	child->ports = (ports_t*) malloc(sizeof(ports_t));
+	*child->ports = *m->ports;
+	child->ports->plugins = NULL;
+	for (int port = 0; port < NUM_PORTS; port++) {
+		if (m->ports->ctx[port] == m) attachPort(child->ports, port, NULL, NULL, NULL);
+	}
+
+	// The interrupt state is the processor's own, so the controller is too
+	child->intr = (intr_t*) malloc(sizeof(intr_t));
+	*child->intr = *m->intr;
+	if (m->intr->pic) attachPic(child, m->intr->picPort);
+
+	// Timers are the devices', set as they were
+	child->timers = (timers_t*) malloc(sizeof(timers_t));
+	*child->timers = *m->timers;
+
+	// Blocks are cached and translated again by the child as it runs, only the state is copied
+	child->cache = NULL;
+	child->jit = NULL;
+	child->profile = NULL;
+	child->baseline = NULL;
+	child->checkpoint = NULL;
+	child->console = NULL;
+	if (m->console) forkConsole(child, m);
+	child->pit = NULL;
+	if (m->pit) forkPit(child, m);
+	child->uart = NULL;
+	if (m->uart) forkUart(child, m);
+	child->disk = NULL;
+	if (m->disk) forkDisk(child, m);
+	child->dma = NULL;
+	if (m->dma) forkDma(child, m);
+	child->banks = NULL;
+	if (m->banks) forkBanks(child, m);
+	child->idle = (idle_t*) malloc(sizeof(idle_t));
+	initIdle(child->idle);
+	child->pace = NULL;
+	if (m->pace) setClock(child, m->pace->hz);
+	child->nextEvent = 0;
+	if (m->jit) initJIT(child);
+
+	return child;
+}
+
+void m80_destroy(machine_t* m) {
+	stopCheckpoints(m);
+	freeConsole(m);
+	freePit(m);
+	freeUart(m);
+	freeDisk(m);
+	freeDma(m);
+	freeBanks(m);
+	free(m->idle);
+	free(m->pace);
+	freeJIT(m);
+	freeBaseline(m);
+	free(m->profile);
+	free(m->cache);
+	freeMem(m->mem);
+	free(m->mem);
+	freePorts(m->ports);
+	free(m->ports);
+	free(m->timers);
+	free(m->intr);
+	free(m->proc);
+	free(m);
+}
+
+void dumpProc(machine_t* m) {
+	static const char* statnames[] = { "OK", "HLT", "ADR", "INS" };
+
+	proc_t* proc = m->proc;
+
+	printf("A: 0x%02x  B: 0x%02x  C: 0x%02x  D: 0x%02x  E: 0x%02x  H: 0x%02x  L: 0x%02x\n",
+			proc->alureg[ACC], proc->gpr[REG_B], proc->gpr[REG_C], proc->gpr[REG_D],
+			proc->gpr[REG_E], proc->gpr[REG_H], proc->gpr[REG_L]);
+	printf("PC: 0x%04x  SP: 0x%04x  Flags: S=%d Z=%d AC=%d P=%d CY=%d\n", proc->PC, proc->SP,
+			getS(m), getZ(m), getAC(m), getP(m), getCY(m));
+	printf("Status: %s  T-states: %llu\n", statnames[proc->status], (unsigned long long) proc->cycles);
+	if (proc->status == STAT_ADR) printf("Fault address: 0x%04x\n", m->mem->faultAddr);
 }
\ No newline at end of file
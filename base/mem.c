@@ -1,16 +1,416 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "mem.h"
 #include "machine.h"
+#include "blockcache.h"
+#include "hardware.h"
 
-extern machine_t guest;
 
-void memRead() {
-	// printf("Reading memory at 0x%x\n", AddrBus);
-	DataBus = guest.mem->ram[AddrBus];
+void memRead(machine_t* m) {
+	// printf("Reading memory at 0x%x\n", AddrBus(m));
+	DataBus(m) = readMem(m, AddrBus(m), State(m).statusSigs.STACK);
 }
 
-void memWrite() {
+void memWrite(machine_t* m) {
+	// printf("Writing 0x%x to memory at 0x%x\n", DataBus(m), AddrBus(m));
+	writeMem(m, AddrBus(m), DataBus(m), State(m).statusSigs.STACK);
+}
+
+/**
+ * Stops the program at an access it is not allowed to make. The instruction making it is left to
+ * finish, so its block is dropped for the run loop to stop once it has.
+ */
+static void addressFault(machine_t* m, uint16_t addr) {
+	m->proc->status = STAT_ADR;
+	m->mem->faultAddr = addr;
+
+	// The PC is already past the instruction, so the byte before it is its last
+	if (m->cache) invalidateCode(m, m->proc->PC - 1);
+}
+
+static uint8_t ramRead(machine_t* m, uint16_t addr) {
+	return m->mem->backing[addr >> MEM_PAGE_SHIFT][addr & (MEM_PAGE_SIZE - 1)];
+}
+
+// Writes that could not go straight to the page, as it holds code or is yet to be marked dirty
+static void ramWrite(machine_t* m, uint16_t addr, uint8_t data) {
+	mem_t* mem = m->mem;
+	uint8_t page = addr >> MEM_PAGE_SHIFT;
+
+	mem->backing[page][addr & (MEM_PAGE_SIZE - 1)] = data;
+	if (mem->codePage[page]) invalidateCode(m, addr);
+
+	mem->dirty[page] = DIRTY_ALL;
+	updatePage(mem, page);
+}
+
+static void romWrite(machine_t* m, uint16_t addr, uint8_t data) {
+}
+
+static uint8_t noAccessRead(machine_t* m, uint16_t addr) {
+	addressFault(m, addr);
+
+	// Nothing drives the data bus
+	return 0xFF;
+}
+
+static void noAccessWrite(machine_t* m, uint16_t addr, uint8_t data) {
+	addressFault(m, addr);
+}
+
+static const page_ops_t ramOps = { ramRead, ramWrite };
+static const page_ops_t romOps = { ramRead, romWrite };
+static const page_ops_t noAccessOps = { noAccessRead, noAccessWrite };
+
+uint8_t readPage(machine_t* m, uint16_t addr, bool stack) {
+	return m->mem->tables[stack].ops[addr >> MEM_PAGE_SHIFT]->read(m, addr);
+}
+
+void writePage(machine_t* m, uint16_t addr, uint8_t data, bool stack) {
+	m->mem->tables[stack].ops[addr >> MEM_PAGE_SHIFT]->write(m, addr, data);
+}
+
+void updatePage(mem_t* mem, uint8_t page) {
+	uint8_t* host = mem->backing[page];
+
+	for (int stack = 0; stack < 2; stack++) {
+		page_table_t* table = &mem->tables[stack];
+		page_kind_t kind = table->kind[page];
+
+		table->read[page] = (kind == PAGE_RAM || kind == PAGE_ROM) ? host : NULL;
+
+		// Written straight to only when there is nothing to track
+		bool direct = kind == PAGE_RAM && mem->dirty[page] == DIRTY_ALL && !mem->codePage[page];
+		table->write[page] = direct ? host : NULL;
+	}
+}
+
+uint8_t* hiddenDirty(mem_t* mem, const uint8_t* host) {
+	if (host >= mem->ram && host <= mem->ram + MAX_ADDR) return &mem->ramDirty[(host - mem->ram) >> MEM_PAGE_SHIFT];
+
+	return &mem->extDirty[(host - mem->ext) >> MEM_PAGE_SHIFT];
+}
+
+void mapBacking(machine_t* m, uint8_t first, int count, uint8_t* host) {
+	mem_t* mem = m->mem;
+
+	for (int page = first; page < first + count; page++) {
+		uint8_t* in = host ? host + ((page - first) << MEM_PAGE_SHIFT) : mem->ram + (page << MEM_PAGE_SHIFT);
+		if (in == mem->backing[page]) continue;
+
+		// What was written to each stays with it, so a baseline can put back what is switched out
+		*hiddenDirty(mem, mem->backing[page]) = mem->dirty[page];
+		mem->backing[page] = in;
+		mem->dirty[page] = *hiddenDirty(mem, in) | DIRTY_CHECKPOINT;
+		*hiddenDirty(mem, in) = 0;
+
+		// The code cached from the page is not there any more
+		if (mem->codePage[page]) invalidatePage(m, page);
+		updatePage(mem, page);
+	}
+}
+
+void cleanPages(mem_t* mem, uint8_t flag) {
+	for (int page = 0; page < MEM_PAGES; page++) {
+		mem->dirty[page] &= ~flag;
+		mem->ramDirty[page] &= ~flag;
+		updatePage(mem, page);
+	}
+	for (size_t page = 0; page < mem->extSize >> MEM_PAGE_SHIFT; page++) mem->extDirty[page] &= ~flag;
+}
+
+int copyToMem(machine_t* m, uint16_t addr, const uint8_t* src, size_t len) {
+	mem_t* mem = m->mem;
+	page_table_t* table = &mem->tables[false];
+	int rc = 0;
+
+	while (len > 0) {
+		uint8_t page = addr >> MEM_PAGE_SHIFT;
+		size_t off = addr & (MEM_PAGE_SIZE - 1);
+		size_t run = MEM_PAGE_SIZE - off;
+		if (run > len) run = len;
+
+		switch (table->kind[page]) {
+			case PAGE_RAM:
+				memcpy(table->read[page] + off, src, run);
+
+				// Tracked as the writes through ramWrite would be
+				if (mem->codePage[page]) {
+					for (size_t i = 0; i < run; i++) invalidateCode(m, addr + i);
+				}
+				if (mem->dirty[page] != DIRTY_ALL) {
+					mem->dirty[page] = DIRTY_ALL;
+					updatePage(mem, page);
+				}
+				break;
+			case PAGE_DEVICE:
+				for (size_t i = 0; i < run; i++) table->ops[page]->write(m, addr + i, src[i]);
+				break;
+			case PAGE_ROM:
+				break;
+			default:
+				rc = -1;
+		}
+
+		addr += run;
+		src += run;
+		len -= run;
+	}
+
+	return rc;
+}
+
+int copyFromMem(machine_t* m, uint16_t addr, uint8_t* dst, size_t len) {
+	page_table_t* table = &m->mem->tables[false];
+	int rc = 0;
+
+	while (len > 0) {
+		uint8_t page = addr >> MEM_PAGE_SHIFT;
+		size_t off = addr & (MEM_PAGE_SIZE - 1);
+		size_t run = MEM_PAGE_SIZE - off;
+		if (run > len) run = len;
+
+		switch (table->kind[page]) {
+			case PAGE_RAM:
+			case PAGE_ROM:
+				memcpy(dst, table->read[page] + off, run);
+				break;
+			case PAGE_DEVICE:
+				for (size_t i = 0; i < run; i++) dst[i] = table->ops[page]->read(m, addr + i);
+				break;
+			default:
+				// Nothing drives the data bus
+				memset(dst, 0xFF, run);
+				rc = -1;
+		}
+
+		addr += run;
+		dst += run;
+		len -= run;
+	}
+
+	return rc;
+}
+
+static void setPages(mem_t* mem, int first, int count, page_kind_t kind, const page_ops_t* ops, void* ctx, int stack) {
+	page_table_t* table = &mem->tables[stack];
+
+	for (int page = first; page < first + count; page++) {
+		table->kind[page] = kind;
+		table->ops[page] = ops;
+		table->ctx[page] = ctx;
+		updatePage(mem, page);
+	}
+}
 
-}
\ No newline at end of file
+static const page_ops_t* memoryOps(page_kind_t kind) {
+	switch (kind) {
+		case PAGE_RAM: return &ramOps;
+		case PAGE_ROM: return &romOps;
+		default: return &noAccessOps;
+	}
+}
+
+void mapMemory(machine_t* m, uint8_t first, int count, page_kind_t kind, bool stack) {
+	setPages(m->mem, first, count, kind, memoryOps(kind), NULL, stack);
+
+	// Blocks are decoded from what was mapped before
+	flushBlocks(m);
+}
+
+void mapDevice(machine_t* m, uint8_t first, int count, const page_ops_t* ops, void* ctx) {
+	for (int stack = 0; stack < 2; stack++) setPages(m->mem, first, count, PAGE_DEVICE, ops, ctx, stack);
+
+	flushBlocks(m);
+}
+
+void mapSegments(machine_t* m) {
+	mem_t* mem = m->mem;
+	int noAccess = mem->segStart[NOACCESS_SEG] >> MEM_PAGE_SHIFT;
+	int stack = mem->segStart[STACK_SEG] >> MEM_PAGE_SHIFT;
+
+	setPages(mem, 0, noAccess, PAGE_RAM, &ramOps, NULL, false);
+	setPages(mem, 0, noAccess, PAGE_NOACCESS, &noAccessOps, NULL, true);
+	for (int table = 0; table < 2; table++) {
+		setPages(mem, noAccess, stack - noAccess, PAGE_NOACCESS, &noAccessOps, NULL, table);
+		setPages(mem, stack, MEM_PAGES - stack, PAGE_RAM, &ramOps, NULL, table);
+	}
+
+	flushBlocks(m);
+}
+
+static size_t guardSize() {
+	return (size_t) sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * Reserves room for the RAM between two guard pages, so a bug in the emulator or a device
+ * that has the host run off either end of it crashes there rather than writing over whatever
+ * is next to it. Nothing is accessible until the RAM is mapped.
+ * @return Where the RAM goes, or NULL if the room could not be reserved
+ */
+static uint8_t* reserveMem() {
+	size_t guard = guardSize();
+
+	uint8_t* area = (uint8_t*) mmap(NULL, MAX_ADDR + 1 + 2 * guard, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (area == MAP_FAILED) return NULL;
+
+	return area + guard;
+}
+
+static void releaseMem(uint8_t* ram) {
+	size_t guard = guardSize();
+
+	munmap(ram - guard, MAX_ADDR + 1 + 2 * guard);
+}
+
+int initMem(mem_t* mem) {
+	mem->ram = reserveMem();
+	if (!mem->ram) return -1;
+
+	if (mprotect(mem->ram, MAX_ADDR + 1, PROT_READ | PROT_WRITE) != 0) {
+		releaseMem(mem->ram);
+		return -1;
+	}
+
+	mem->ext = NULL;
+	mem->extSize = 0;
+	mem->extDirty = NULL;
+	memset(mem->ramDirty, 0, sizeof(mem->ramDirty));
+	mem->image = -1;
+	mem->imageCurrent = false;
+	mem->faultAddr = 0x0000;
+	memset(mem->codePage, 0, sizeof(mem->codePage));
+	memset(mem->dirty, DIRTY_ALL, sizeof(mem->dirty));
+	for (int page = 0; page < MEM_PAGES; page++) mem->backing[page] = mem->ram + (page << MEM_PAGE_SHIFT);
+
+	// Everything is RAM until the segments are mapped
+	for (int stack = 0; stack < 2; stack++) setPages(mem, 0, MEM_PAGES, PAGE_RAM, &ramOps, NULL, stack);
+
+	return 0;
+}
+
+static uint8_t* mapExtMem(size_t size) {
+	uint8_t* ext = (uint8_t*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	return (ext == MAP_FAILED) ? NULL : ext;
+}
+
+int initExtMem(mem_t* mem, size_t size) {
+	// Pages of it are only backed by the host once written
+	mem->ext = mapExtMem(size);
+	if (!mem->ext) return -1;
+
+	// Nothing has been checkpointed or set as the baseline with it
+	mem->extDirty = (uint8_t*) malloc(size >> MEM_PAGE_SHIFT);
+	memset(mem->extDirty, DIRTY_ALL, size >> MEM_PAGE_SHIFT);
+	mem->extSize = size;
+	mem->imageCurrent = false;
+
+	return 0;
+}
+
+int clearExtMem(mem_t* mem) {
+	if (!mem->ext) return 0;
+
+	// Mapped again rather than zeroed, so a bank never written costs nothing
+	if (mmap(mem->ext, mem->extSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED) return -1;
+
+	// Every bank has changed, switched out as they all are
+	memset(mem->extDirty, DIRTY_ALL, mem->extSize >> MEM_PAGE_SHIFT);
+
+	return 0;
+}
+
+void freeMem(mem_t* mem) {
+	releaseMem(mem->ram);
+	if (mem->ext) munmap(mem->ext, mem->extSize);
+	free(mem->extDirty);
+	if (mem->image != -1) close(mem->image);
+}
+
+/**
+ * Copies the RAM, then any extended memory, into a new in-memory file and maps them back over
+ * themselves privately, so the file holds them as they are now whatever gets written after.
+ */
+static int freezeMem(mem_t* mem) {
+	int fd = memfd_create("m80-ram", MFD_CLOEXEC);
+	if (fd == -1) return -1;
+
+	if (write(fd, mem->ram, MAX_ADDR + 1) != MAX_ADDR + 1 ||
+			mmap(mem->ram, MAX_ADDR + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	if (mem->ext && (write(fd, mem->ext, mem->extSize) != (ssize_t) mem->extSize ||
+			mmap(mem->ext, mem->extSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, MAX_ADDR + 1) == MAP_FAILED)) {
+		close(fd);
+		return -1;
+	}
+
+	// Machines forked off the old image keep it mapped, so it goes once the last of them does
+	if (mem->image != -1) close(mem->image);
+	mem->image = fd;
+	mem->imageCurrent = true;
+
+	return 0;
+}
+
+int forkMem(mem_t* parent, mem_t* child) {
+	*child = *parent;
+	child->image = -1;
+	child->imageCurrent = false;
+	child->extDirty = NULL;
+	// The child starts with an empty block cache
+	memset(child->codePage, 0, sizeof(child->codePage));
+	// Nothing has been checkpointed or set as the baseline by the child
+	memset(child->dirty, DIRTY_ALL, sizeof(child->dirty));
+
+	// Machines forked one after another from the same state share a single image
+	child->ram = reserveMem();
+	bool shared = child->ram && (parent->imageCurrent || freezeMem(parent) == 0) &&
+			mmap(child->ram, MAX_ADDR + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, parent->image, 0) != MAP_FAILED;
+	if (parent->ext) {
+		child->ext = shared ? (uint8_t*) mmap(NULL, parent->extSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, parent->image, MAX_ADDR + 1) : NULL;
+		if (child->ext == MAP_FAILED) child->ext = NULL;
+		shared = shared && child->ext;
+	}
+
+	// Without an image to share the memory is copied
+	if (!shared) {
+		if (child->ram) releaseMem(child->ram);
+		if (child->ext) munmap(child->ext, parent->extSize);
+		if (initMem(child) != 0) return -1;
+		if (parent->ext && initExtMem(child, parent->extSize) != 0) {
+			freeMem(child);
+			return -1;
+		}
+		memcpy(child->ram, parent->ram, MAX_ADDR + 1);
+		if (parent->ext) memcpy(child->ext, parent->ext, parent->extSize);
+		memcpy(child->tables, parent->tables, sizeof(child->tables));
+	} else if (parent->ext) {
+		child->extDirty = (uint8_t*) malloc(parent->extSize >> MEM_PAGE_SHIFT);
+	}
+
+	// Memory switched out has not been checkpointed or set as the baseline by the child either
+	memset(child->ramDirty, DIRTY_ALL, sizeof(child->ramDirty));
+	if (parent->ext) memset(child->extDirty, DIRTY_ALL, parent->extSize >> MEM_PAGE_SHIFT);
+
+	// The pages are mapped as the parent's are, only pointing at the child's memory
+	for (int page = 0; page < MEM_PAGES; page++) {
+		uint8_t* host = parent->backing[page];
+
+		if (host >= parent->ram && host <= parent->ram + MAX_ADDR) child->backing[page] = child->ram + (host - parent->ram);
+		else child->backing[page] = child->ext + (host - parent->ext);
+		*hiddenDirty(child, child->backing[page]) = 0;
+		updatePage(child, page);
+	}
+
+	return 0;
+}
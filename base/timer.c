@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "timer.h"
+#include "machine.h"
+
+
+#define AT(t, s) ((t)->timers[(t)->heap[s]].at) // When the timer in the heap slot is due
+
+
+// Puts the timer in the slot, keeping track of where it is
+static void place(timers_t* timers, int slot, int timer) {
+	timers->heap[slot] = timer;
+	timers->timers[timer].slot = slot;
+}
+
+// Moves the timer in the slot towards the top until its parent is due no later
+static void siftUp(timers_t* timers, int slot) {
+	int timer = timers->heap[slot];
+	uint64_t at = timers->timers[timer].at;
+
+	while (slot > 0) {
+		int parent = (slot - 1) / 2;
+		if (AT(timers, parent) <= at) break;
+
+		place(timers, slot, timers->heap[parent]);
+		slot = parent;
+	}
+	place(timers, slot, timer);
+}
+
+// Moves the timer in the slot towards the bottom until its children are due no sooner
+static void siftDown(timers_t* timers, int slot) {
+	int timer = timers->heap[slot];
+	uint64_t at = timers->timers[timer].at;
+
+	for (;;) {
+		int child = 2 * slot + 1;
+		if (child >= timers->size) break;
+		if (child + 1 < timers->size && AT(timers, child + 1) < AT(timers, child)) child++;
+		if (at <= AT(timers, child)) break;
+
+		place(timers, slot, timers->heap[child]);
+		slot = child;
+	}
+	place(timers, slot, timer);
+}
+
+void initTimers(timers_t* timers) {
+	timers->count = 0;
+	timers->size = 0;
+}
+
+int addTimer(machine_t* m, m80_timer_fn_t fire, void* ctx) {
+	timers_t* timers = m->timers;
+	if (timers->count == MAX_TIMERS) return -1;
+
+	int timer = timers->count++;
+	timers->timers[timer].fire = fire;
+	timers->timers[timer].ctx = ctx;
+	timers->timers[timer].slot = NO_SLOT;
+
+	return timer;
+}
+
+void setTimer(machine_t* m, int timer, uint64_t at) {
+	timers_t* timers = m->timers;
+	device_timer_t* t = &timers->timers[timer];
+
+	if (t->slot == NO_SLOT) {
+		t->at = at;
+		place(timers, timers->size++, timer);
+		siftUp(timers, t->slot);
+	} else {
+		uint64_t was = t->at;
+		t->at = at;
+		if (at < was) siftUp(timers, t->slot);
+		else siftDown(timers, t->slot);
+	}
+
+	// Blocks run on without looking until the next event, so it has to be no later than this
+	if (at < m->nextEvent) m->nextEvent = at;
+}
+
+void stopTimer(machine_t* m, int timer) {
+	timers_t* timers = m->timers;
+	int slot = timers->timers[timer].slot;
+	if (slot == NO_SLOT) return;
+
+	timers->timers[timer].slot = NO_SLOT;
+
+	// The last one takes its place, going whichever way it has to
+	int last = timers->heap[--timers->size];
+	if (slot == timers->size) return;
+
+	place(timers, slot, last);
+	siftUp(timers, slot);
+	siftDown(timers, timers->timers[last].slot);
+}
+
+void rewindTimers(machine_t* m, uint64_t by) {
+	timers_t* timers = m->timers;
+
+	// Each moves by the same, so the heap stays in order
+	for (int slot = 0; slot < timers->size; slot++) {
+		device_timer_t* t = &timers->timers[timers->heap[slot]];
+		t->at = (t->at > by) ? t->at - by : 0;
+	}
+}
+
+void moveTimer(machine_t* m, int timer, void* ctx) {
+	m->timers->timers[timer].ctx = ctx;
+}
+
+void runTimers(machine_t* m) {
+	timers_t* timers = m->timers;
+
+	while (timers->size && AT(timers, 0) <= m->proc->cycles) {
+		int timer = timers->heap[0];
+		device_timer_t* t = &timers->timers[timer];
+
+		stopTimer(m, timer);
+		t->fire(t->ctx, t->at);
+	}
+}
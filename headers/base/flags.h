@@ -0,0 +1,26 @@
+#ifndef _FLAGS_H_
+#define _FLAGS_H_
+
+#include <stdint.h>
+
+// Masks for each bit of the flag word, see instr.h
+#define FLAG_S 0x80
+#define FLAG_Z 0x40
+#define FLAG_AC 0x10
+#define FLAG_P 0x04
+#define FLAG_1 0x02 // Always set
+#define FLAG_CY 0x01
+
+/**
+ * The sign, zero, and parity flags (along with the always set bit) for every 8-bit result.
+ */
+extern const uint8_t szpTable[256];
+
+/**
+ * The DAA adjustment for every accumulator, carry, and auxiliary carry, indexed by
+ * `A | (CY << 8) | (AC << 9)`. The high byte is the adjusted accumulator and the low byte
+ * holds the new AC and CY flags, the rest coming from `szpTable`.
+ */
+extern const uint16_t daaTable[1024];
+
+#endif
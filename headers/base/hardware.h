@@ -3,18 +3,158 @@
 
 #include "instr.h"
 #include "instr-stages.h"
+#include "machine.h"
+#include "flags.h"
 
-void regarray(bool wr, uint8_t src, uint8_t dst);
 
-void alu(alu_op_t aluop, bool seteflags);
+void regarray(machine_t* m, bool wr, uint8_t src, uint8_t dst);
+
+/**
+ * Performs the operation on the accumulator latch and the temp register, placing
+ * the result on the data bus. Arithmetic and logical operations only record their
+ * operands and result, the flags are worked out once something reads them.
+ * @param m The machine
+ * @param aluop The operation
+ * @param seteflags Whether to update the flags the operation affects
+ */
+void alu(machine_t* m, alu_op_t aluop, bool seteflags);
+
+/**
+ * Evaluates any pending flags into eflags.
+ * @param m The machine
+ * @return The flag word
+ */
+uint8_t getEflags(machine_t* m);
+
+/**
+ * Replaces the flag word, dropping any pending flags.
+ * @param m The machine
+ * @param eflags The flag word
+ */
+void setEflags(machine_t* m, uint8_t eflags);
+
+bool getAC(machine_t* m);
+
+// The remaining flags are read straight from a pending result, they are
+// checked by every conditional branch so they are kept inline
+
+static inline bool getS(machine_t* m) {
+	if (m->proc->lazy.op == FLAGS_NONE) return m->proc->eflags & FLAG_S;
+
+	return m->proc->lazy.res & 0x80;
+}
+
+static inline bool getZ(machine_t* m) {
+	if (m->proc->lazy.op == FLAGS_NONE) return m->proc->eflags & FLAG_Z;
+
+	return (m->proc->lazy.res & 0xFF) == 0;
+}
+
+static inline bool getP(machine_t* m) {
+	if (m->proc->lazy.op == FLAGS_NONE) return m->proc->eflags & FLAG_P;
+
+	return szpTable[m->proc->lazy.res & 0xFF] & FLAG_P;
+}
+
+static inline bool getCY(machine_t* m) {
+	if (m->proc->lazy.op == FLAGS_NONE) return m->proc->eflags & FLAG_CY;
+
+	return (m->proc->lazy.res >> 8) & 0x1;
+}
+
+/**
+ * Sets the carry flag alone, leaving the other flags pending if they are.
+ * @param m The machine
+ * @param cy The carry
+ */
+static inline void setCY(machine_t* m, bool cy) {
+	// The carry of a pending operation is always bit 8 of its result
+	if (m->proc->lazy.op == FLAGS_NONE) m->proc->eflags = (m->proc->eflags & ~FLAG_CY) | cy;
+	else m->proc->lazy.res = (m->proc->lazy.res & 0xFF) | (cy << 8);
+}
+
+/**
+ * Reads a byte of memory, straight from the host when the page allows it.
+ * @param m The machine
+ * @param addr The address
+ * @param stack Whether the address comes from the stack pointer
+ * @return The byte read
+ */
+static inline uint8_t readMem(machine_t* m, uint16_t addr, bool stack) {
+	uint8_t* host = m->mem->tables[stack].read[addr >> MEM_PAGE_SHIFT];
+	if (host) return host[addr & (MEM_PAGE_SIZE - 1)];
+
+	return readPage(m, addr, stack);
+}
+
+/**
+ * Writes a byte of memory, straight to the host when the page allows it.
+ * @param m The machine
+ * @param addr The address
+ * @param data The byte
+ * @param stack Whether the address comes from the stack pointer
+ */
+static inline void writeMem(machine_t* m, uint16_t addr, uint8_t data, bool stack) {
+	uint8_t* host = m->mem->tables[stack].write[addr >> MEM_PAGE_SHIFT];
+	if (host) host[addr & (MEM_PAGE_SIZE - 1)] = data;
+	else writePage(m, addr, data, stack);
+}
 
 /**
  * Converts the status signals to bits, placing them on the data bus.
  */
-void sendStatusToData();
+void sendStatusToData(machine_t* m);
+
+void latchStatus(machine_t* m);
+
+void mem(machine_t* m);
+
+/**
+ * Services an I/O read or write on the bus, from or to the device on the port.
+ * @param m The machine
+ */
+void io(machine_t* m);
 
-void latchStatus();
+/**
+ * Performs a memory read machine cycle (T1-T3) at the given address.
+ * @param m The machine
+ * @param addr The address to read
+ * @param stack Whether the address comes from the stack pointer
+ * @return The byte read off the data bus
+ */
+uint8_t readCycle(machine_t* m, uint16_t addr, bool stack);
 
-void mem();
+/**
+ * Performs a memory write machine cycle (T1-T3) at the given address.
+ * @param m The machine
+ * @param addr The address to write
+ * @param data The byte to write
+ * @param stack Whether the address comes from the stack pointer
+ */
+void writeCycle(machine_t* m, uint16_t addr, uint8_t data, bool stack);
+
+/**
+ * Performs an input machine cycle (T1-T3) from the port.
+ * @param m The machine
+ * @param port The port
+ * @return The byte read off the data bus
+ */
+uint8_t inCycle(machine_t* m, uint8_t port);
+
+/**
+ * Performs an output machine cycle (T1-T3) to the port.
+ * @param m The machine
+ * @param port The port
+ * @param data The byte to write
+ */
+void outCycle(machine_t* m, uint8_t port, uint8_t data);
+
+/**
+ * Performs an interrupt acknowledge machine cycle (T1-T3), the fetch of an interrupt's opcode.
+ * @param m The machine
+ * @param opcode The opcode the interrupting device puts on the data bus
+ * @return The byte read off the data bus
+ */
+uint8_t intaCycle(machine_t* m, uint8_t opcode);
 
 #endif
\ No newline at end of file
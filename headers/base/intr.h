@@ -0,0 +1,70 @@
+#ifndef _INTR_H_
+#define _INTR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "m80.h"
+
+#define NUM_IRQS 8 // Request lines, line n is answered with RST n
+
+#define RST_OPCODE(n) (0xC7 | ((n) << 3)) // What a device puts on the data bus for an interrupt
+#define PIC_PORT 0x20 // Where the controller is usually put, its mask port is 0x21
+
+// The interrupt request lines and, when one is attached, the 8259-style controller in front of them
+typedef struct intr {
+	uint8_t request; // Lines raised and not yet taken
+	uint8_t mask; // Lines held off, only set through the controller
+	uint8_t service; // Lines taken and not yet ended, only kept with the controller
+	bool pending; // An interrupt can be taken now, worked out whenever any of the above or INTE changes
+	uint64_t enabledAt; // T-states EI finished at, nothing is taken until the instruction after it has run
+
+	bool pic; // Whether the controller is attached
+	uint16_t picPort; // Its command port, the mask port follows it
+	uint8_t initWords; // Initialization words still to come on the mask port
+	bool readService; // Whether the command port reads the lines in service rather than those raised
+} intr_t;
+
+
+/**
+ * Lowers every line and detaches the controller.
+ * @param m The machine
+ */
+void initInterrupts(machine_t* m);
+
+/**
+ * Works out whether an interrupt can be taken, bringing the run loop's next event forward to now if one can.
+ * To be called whenever the lines, the controller or INTE change, never as a poll.
+ * @param m The machine
+ */
+void updateInterrupts(machine_t* m);
+
+/**
+ * Takes the pending interrupt, acknowledging it and running the RST it answers with.
+ * Interrupts are disabled, as the 8080 does.
+ * @param m The machine, with an interrupt pending
+ */
+void takeInterrupt(machine_t* m);
+
+/**
+ * Raises the request line, holding it until the interrupt is taken.
+ * @param m The machine
+ * @param line The line
+ */
+void raiseIrq(machine_t* m, int line);
+
+/**
+ * Lowers the request line, withdrawing an interrupt not yet taken.
+ * @param m The machine
+ * @param line The line
+ */
+void lowerIrq(machine_t* m, int line);
+
+/**
+ * Attaches an 8259-style controller in front of the lines, at the port and the one after it.
+ * @param m The machine
+ * @param port The command port, the mask port is the one after it
+ */
+void attachPic(machine_t* m, uint8_t port);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef _IO_H_
+#define _IO_H_
+
+#include <stdint.h>
+
+#include "m80.h"
+
+#define NUM_PORTS 256
+
+// A device plugin loaded into a machine
+typedef struct plugin {
+	void* handle;
+	void* device;
+	m80_device_free_t free;
+	struct plugin* next;
+} plugin_t;
+
+// What is attached to each I/O port. Ports with nothing attached have handlers that do
+// nothing, so an access is always a single indirect call.
+typedef struct ports {
+	m80_port_in_t in[NUM_PORTS];
+	m80_port_out_t out[NUM_PORTS];
+	void* ctx[NUM_PORTS];
+	plugin_t* plugins; // Unloaded with the machine, NULL for a fork
+} ports_t;
+
+
+/**
+ * Reads from the device on the port.
+ * @param ports The ports
+ * @param port The port
+ * @return The byte the device put on the data bus
+ */
+static inline uint8_t portIn(ports_t* ports, uint8_t port) {
+	return ports->in[port](ports->ctx[port], port);
+}
+
+/**
+ * Writes to the device on the port.
+ * @param ports The ports
+ * @param port The port
+ * @param data The byte
+ */
+static inline void portOut(ports_t* ports, uint8_t port, uint8_t data) {
+	ports->out[port](ports->ctx[port], port, data);
+}
+
+/**
+ * Detaches every port.
+ * @param ports The ports
+ */
+void initPorts(ports_t* ports);
+
+/**
+ * Attaches a device to the port, NULL handlers doing nothing.
+ * @param ports The ports
+ * @param port The port
+ * @param in Reads from the device, or NULL
+ * @param out Writes to the device, or NULL
+ * @param ctx Passed on to the handlers
+ */
+void attachPort(ports_t* ports, uint8_t port, m80_port_in_t in, m80_port_out_t out, void* ctx);
+
+/**
+ * Loads a device plugin, letting it attach its ports to the machine.
+ * @param m The machine
+ * @param path The shared object
+ * @param args Passed on to the plugin, may be NULL
+ * @return 0 on success, -1 otherwise
+ */
+int loadDevice(machine_t* m, const char* path, const char* args);
+
+/**
+ * Unloads the plugins loaded into the machine, freeing their devices.
+ * @param ports The ports
+ */
+void freePorts(ports_t* ports);
+
+#endif
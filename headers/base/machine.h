@@ -3,7 +3,14 @@
 
 #include <stdint.h>
 
+#include "m80.h"
 #include "mem.h"
+#include "io.h"
+#include "intr.h"
+#include "timer.h"
+#include "blockcache.h"
+#include "jit.h"
+#include "profile.h"
 #include "instr.h"
 #include "instr-stages.h"
 
@@ -14,14 +21,59 @@ typedef enum AluRegs {
 	TEMP // Temporary register (feeds in to ALU)
 } aluregs;
 
+// Used to refer to a register as numbered in the instruction encoding
+// B-L index into the general purpose registers, M is the memory byte addressed by H-L
+typedef enum GpRegs {
+	REG_B,
+	REG_C,
+	REG_D,
+	REG_E,
+	REG_H,
+	REG_L,
+	REG_M,
+	REG_A
+} gpregs;
+
+// Used to refer to a register pair as numbered in the instruction encoding
+// PAIR_SP is PSW (A and the flags) for PUSH and POP
+typedef enum RegPairs {
+	PAIR_B,
+	PAIR_D,
+	PAIR_H,
+	PAIR_SP
+} regpairs;
+
+// Used to refer to a temporary register
+typedef enum TempRegs {
+	REG_W,
+	REG_Z
+} tempregs;
+
 // Grouping of the different buses
 typedef struct bus {
 	uint16_t addrbus; // Address bus
 	uint8_t databus; // Data bus, incoming or outgoing data
-	uint8_t ctrlbus; // Control bus - b0: inta; b1: memr; b2: memw
+	uint8_t ctrlbus; // Control bus - b0: inta; b1: memr; b2: memw; b3: i/or; b4: i/ow
 } bus_t;
 
 
+// The kind of ALU operation the flags are to be worked out from
+typedef enum FlagOps {
+	FLAGS_NONE, // eflags is up to date
+	FLAGS_ADD, // Additions and increments
+	FLAGS_SUB, // Subtractions, compares, and decrements
+	FLAGS_AND,
+	FLAGS_LOGIC // OR and XOR
+} flag_op_t;
+
+// The last flag setting ALU operation, so the flags only get worked out when read
+typedef struct lazyFlags {
+	flag_op_t op;
+	uint8_t a; // First operand
+	uint8_t b; // Second operand
+	uint16_t res; // Result, bit 8 always holds the carry
+} lazy_flags_t;
+
 typedef struct proc {
 	uint8_t gpr[6]; // General purpose registers
 	uint8_t alureg[3]; // Registers used by the ALU
@@ -29,7 +81,9 @@ typedef struct proc {
 	uint8_t IR; // Instruction register, holds the instruction
 	uint16_t PC;
 	uint16_t SP;
-	uint8_t eflags;
+	uint8_t eflags; // Only up to date when lazy.op is FLAGS_NONE, read through getEflags()
+	lazy_flags_t lazy;
+	uint64_t cycles; // T-states elapsed since the machine was started
 
 	bus_t bus; // The buses
 
@@ -39,22 +93,51 @@ typedef struct proc {
 } proc_t;
 
 
-#define Bus (guest.proc->bus)
-#define AddrBus (guest.proc->bus.addrbus)
-#define DataBus (guest.proc->bus.databus)
-#define CtrlBus (guest.proc->bus.ctrlbus)
+// The buses and state of the machine's processor
+#define Bus(m) ((m)->proc->bus)
+#define AddrBus(m) ((m)->proc->bus.addrbus)
+#define DataBus(m) ((m)->proc->bus.databus)
+#define CtrlBus(m) ((m)->proc->bus.ctrlbus)
 
-#define State (guest.proc->state)
+#define State(m) ((m)->proc->state)
 
 
-typedef struct machine {
+// How instructions are run
+typedef enum RunMode {
+	FAST_MODE, // Bytes are read and written straight through memory, skipping the bus
+	CYCLE_MODE // Every byte goes through a full machine cycle on the bus, for hardware debugging
+} run_mode_t;
+
+struct machine {
 	char* name;
+	run_mode_t mode;
+	uint8_t waitStates; // TW states in every memory and I/O machine cycle, slow memory and devices holding READY low
 	proc_t* proc;
 	mem_t* mem;
-} machine_t;
-
-
-void initMachine();
+	ports_t* ports; // Devices on the I/O ports
+	intr_t* intr; // Interrupt requests from the devices
+	timers_t* timers; // Callbacks the devices have at T-state counts
+	block_cache_t* cache; // Decoded blocks, used in fast mode
+	jit_buf_t* jit; // Host code for hot blocks, NULL unless translation is enabled
+	pair_profile_t* profile; // Opcode pair counts, NULL unless profiling
+	struct baseline* baseline; // State to reset back to, NULL until one is set
+	struct checkpoint* checkpoint; // Where runs are checkpointed to, NULL unless checkpointing
+	struct console* console; // Buffers the console ports, NULL unless attached
+	struct pit* pit; // The interval timer, NULL unless attached
+	struct uart* uart; // The serial port, NULL unless attached
+	struct disk* disk; // The virtual disk, NULL unless attached
+	struct dma* dma; // The DMA controller, NULL unless attached
+	struct banks* banks; // Bank-switched memory, NULL unless attached
+	struct idle* idle; // Host files watched while halted
+	struct pace* pace; // Keeps runs to a clock, NULL unless paced
+	uint64_t nextEvent; // T-states something outside the processor is next due at, the run loop stops there
+};
+
+
+/**
+ * Prints the registers, flags, and status of the processor.
+ */
+void dumpProc(machine_t* m);
 
 
 #endif
\ No newline at end of file
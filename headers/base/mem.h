@@ -3,11 +3,19 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+#include "m80.h"
 
 #define KB 1024
 #define MAX_ADDR UINT16_MAX
 #define WORD_SIZE 8
 
+// Memory is tracked in 256 byte pages for bookkeeping such as which pages hold cached code
+#define MEM_PAGE_SHIFT 8
+#define MEM_PAGE_SIZE (1 << MEM_PAGE_SHIFT)
+#define MEM_PAGES ((MAX_ADDR + 1) / MEM_PAGE_SIZE)
+
 #define TEXTDATA_SIZE 30 * KB
 #define NOACCES_SIZE 4 * KB
 #define STACK_SIZE 30 * KB
@@ -19,16 +27,195 @@ typedef enum {
 	ERROR_SEG = -1
 } seg_t;
 
+// What is behind a page of the address space
+typedef enum {
+	PAGE_RAM,
+	PAGE_ROM, // Read like RAM, writes are dropped
+	PAGE_NOACCESS, // Any access is an address fault
+	PAGE_DEVICE // Accesses go to the device mapped there
+} page_kind_t;
+
+// Handles the accesses to a page that do not go straight to host memory
+typedef struct pageOps {
+	uint8_t (*read)(machine_t* m, uint16_t addr);
+	void (*write)(machine_t* m, uint16_t addr, uint8_t data);
+} page_ops_t;
+
+// Maps each page of the address space. Reading or writing ordinary RAM is a single
+// indexed load of the host pointer, anything else finds it NULL and calls the page's ops.
+// RAM is written through its ops too while the page holds cached code or has not been
+// dirtied since the last checkpoint or baseline, so the stores can be tracked.
+typedef struct pageTable {
+	uint8_t* read[MEM_PAGES]; // Host memory the page is read straight from, or NULL
+	uint8_t* write[MEM_PAGES]; // Host memory the page is written straight to, or NULL
+	page_kind_t kind[MEM_PAGES];
+	const page_ops_t* ops[MEM_PAGES];
+	void* ctx[MEM_PAGES]; // For the ops, such as the device mapped at the page
+} page_table_t;
+
+// What a page has been written to since, a byte per page so marking one is a single store
+#define DIRTY_CHECKPOINT 0x1 // Since the last checkpoint
+#define DIRTY_BASELINE 0x2 // Since the baseline was set
+#define DIRTY_ALL (DIRTY_CHECKPOINT | DIRTY_BASELINE)
+
 typedef struct mem {
 	uint16_t maxAddr;
 	uint8_t wordSize;
 	uint16_t segStart[STACK_SEG+1];
-	uint8_t ram[MAX_ADDR];
+	uint8_t* ram; // Mapped on its own between guard pages, so forked machines can share it copy-on-write
+	uint8_t* ext; // Extended memory banks are switched in from, shared by forks as the RAM is, NULL if none
+	size_t extSize;
+	uint8_t* backing[MEM_PAGES]; // Host memory behind each page, its own place in the RAM unless a bank is switched in
+	page_table_t tables[2]; // Indexed by whether the access is through the stack pointer, which only reaches the stack segment
+	uint16_t faultAddr; // The address of the last access that faulted
+	int image; // File the memory was last frozen into for a fork, -1 if none
+	bool imageCurrent; // Whether the memory still matches the image
+	bool codePage[MEM_PAGES]; // Whether the page holds code in the block cache
+	uint8_t dirty[MEM_PAGES]; // DIRTY_ flags of each page
+	uint8_t ramDirty[MEM_PAGES]; // DIRTY_ flags of each page of the RAM while a bank is switched in over it, 0 while it is seen
+	uint8_t* extDirty; // DIRTY_ flags of each page of extended memory while it is switched out, 0 while it is seen
 } mem_t;
 
 
 
-void memRead();
-void memWrite();
+void memRead(machine_t* m);
+void memWrite(machine_t* m);
+
+/**
+ * Reads a byte from a page that is not read straight from host memory.
+ * @param m The machine
+ * @param addr The address
+ * @param stack Whether the address comes from the stack pointer
+ * @return The byte read
+ */
+uint8_t readPage(machine_t* m, uint16_t addr, bool stack);
+
+/**
+ * Writes a byte to a page that is not written straight to host memory.
+ * @param m The machine
+ * @param addr The address
+ * @param data The byte
+ * @param stack Whether the address comes from the stack pointer
+ */
+void writePage(machine_t* m, uint16_t addr, uint8_t data, bool stack);
+
+/**
+ * Works out the page's host pointers again, after its kind, dirty flags, or cached code change.
+ * @param mem The memory
+ * @param page The page
+ */
+void updatePage(mem_t* mem, uint8_t page);
+
+/**
+ * Switches the host memory behind the pages, such as for a bank of extended memory. The page
+ * tables are only pointed at it, nothing is copied. Code cached from the pages is dropped. The
+ * dirty flags of the memory switched out are kept for it, and the pages take those of the memory
+ * switched in, as well as being taken as written since the last checkpoint as they hold something else.
+ * @param m The machine
+ * @param first The first page
+ * @param count How many pages
+ * @param host The host memory, or NULL for the pages' own place in the RAM
+ */
+void mapBacking(machine_t* m, uint8_t first, int count, uint8_t* host);
+
+/**
+ * Gets the DIRTY_ flags kept for host memory while it is switched out.
+ * @param mem The memory
+ * @param host A page of the RAM or extended memory
+ * @return The page's flags
+ */
+uint8_t* hiddenDirty(mem_t* mem, const uint8_t* host);
+
+/**
+ * Maps extended memory for banks to be switched in from, cleared.
+ * @param mem The memory, without extended memory
+ * @param size Its size, whole host pages
+ * @return 0 on success, -1 if it could not be mapped
+ */
+int initExtMem(mem_t* mem, size_t size);
+
+/**
+ * Clears the extended memory, if there is any, without copying anything.
+ * @param mem The memory
+ * @return 0 on success, -1 if it could not be mapped again
+ */
+int clearExtMem(mem_t* mem);
+
+/**
+ * Clears the dirty flag from every page, including those of memory switched out, so the next write to each is tracked again.
+ * @param mem The memory
+ * @param flag The DIRTY_ flag
+ */
+void cleanPages(mem_t* mem, uint8_t flag);
+
+/**
+ * Copies bytes into the address space as a device on the bus would, a page at a time rather
+ * than a byte, wrapping round at the top. RAM is written as by the processor, dropping any
+ * code cached from it, writes to ROM are dropped and devices are written a byte at a time.
+ * @param m The machine
+ * @param addr Where to start
+ * @param src The bytes
+ * @param len How many
+ * @return 0 on success, -1 if any of it is not mapped, those bytes going nowhere
+ */
+int copyToMem(machine_t* m, uint16_t addr, const uint8_t* src, size_t len);
+
+/**
+ * Copies bytes out of the address space as a device on the bus would, a page at a time rather than a byte.
+ * @param m The machine
+ * @param addr Where to start
+ * @param dst Where the bytes go
+ * @param len How many
+ * @return 0 on success, -1 if any of it is not mapped, those bytes reading as 0xFF
+ */
+int copyFromMem(machine_t* m, uint16_t addr, uint8_t* dst, size_t len);
+
+/**
+ * Maps the pages as RAM, ROM or no access, for accesses through the stack pointer or for the rest.
+ * @param m The machine
+ * @param first The first page
+ * @param count How many pages
+ * @param kind What they are, not PAGE_DEVICE
+ * @param stack Whether it is the stack's mapping that is set
+ */
+void mapMemory(machine_t* m, uint8_t first, int count, page_kind_t kind, bool stack);
+
+/**
+ * Maps a device over the pages, for every kind of access.
+ * @param m The machine
+ * @param first The first page
+ * @param count How many pages
+ * @param ops Handle the accesses
+ * @param ctx Passed on to the ops through the page table
+ */
+void mapDevice(machine_t* m, uint8_t first, int count, const page_ops_t* ops, void* ctx);
+
+/**
+ * Maps the address space from the segment table: the text-data segment is RAM, the no access
+ * segment faults, and the stack segment is RAM and the only place the stack pointer can reach.
+ * @param m The machine
+ */
+void mapSegments(machine_t* m);
+
+/**
+ * Maps the memory's RAM, between guard pages.
+ * @param mem The memory
+ * @return 0 on success, -1 if the RAM could not be mapped
+ */
+int initMem(mem_t* mem);
+
+/**
+ * Unmaps the memory's RAM.
+ * @param mem The memory
+ */
+void freeMem(mem_t* mem);
+
+/**
+ * Gives the child the parent's RAM and extended memory, with pages only copied once either of them writes to it.
+ * @param parent The memory forked from
+ * @param child The memory forked to, not yet mapped
+ * @return 0 on success, -1 if the RAM could not be mapped
+ */
+int forkMem(mem_t* parent, mem_t* child);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,90 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+#include <stdint.h>
+
+#include "m80.h"
+
+#define MAX_TIMERS 32 // Timers the devices of a machine can add
+#define NO_SLOT -1 // Where a timer that is not set is kept in the heap
+
+// A callback a device has at a T-state count
+typedef struct deviceTimer {
+	m80_timer_fn_t fire;
+	void* ctx;
+	uint64_t at; // T-states it is due at, only meaningful while set
+	int slot; // Where it is in the heap, NO_SLOT if not set
+} device_timer_t;
+
+// The devices' timers, the ones set kept in a min-heap on when they are due so the soonest is always first
+typedef struct timers {
+	device_timer_t timers[MAX_TIMERS];
+	int count; // Timers added
+	int heap[MAX_TIMERS]; // The set timers, each due no sooner than its parent
+	int size; // Timers set
+} timers_t;
+
+
+/**
+ * Removes every timer.
+ * @param timers The timers
+ */
+void initTimers(timers_t* timers);
+
+/**
+ * Adds a timer for a device, not yet set.
+ * @param m The machine
+ * @param fire Called when it comes due
+ * @param ctx Passed on to fire
+ * @return The timer, or -1 if the machine has too many
+ */
+int addTimer(machine_t* m, m80_timer_fn_t fire, void* ctx);
+
+/**
+ * Sets the timer to come due at the T-states, replacing when it was set for, and brings
+ * the run loop's next event forward to it if it is sooner.
+ * @param m The machine
+ * @param timer The timer
+ * @param at T-states it is due at
+ */
+void setTimer(machine_t* m, int timer, uint64_t at);
+
+/**
+ * Stops the timer, if it is set.
+ * @param m The machine
+ * @param timer The timer
+ */
+void stopTimer(machine_t* m, int timer);
+
+/**
+ * Brings every timer set forward by the T-states, for the count to be started over that far back.
+ * One due sooner than that is due straight away.
+ * @param m The machine
+ * @param by T-states to take off
+ */
+void rewindTimers(machine_t* m, uint64_t by);
+
+/**
+ * Has a timer copied to a fork call back the fork's copy of its device, set as it was.
+ * @param m The fork
+ * @param timer The timer
+ * @param ctx Passed on to fire instead
+ */
+void moveTimer(machine_t* m, int timer, void* ctx);
+
+/**
+ * Fires every timer due by now, soonest first, each stopped before it is called so it can be set again.
+ * @param m The machine
+ */
+void runTimers(machine_t* m);
+
+/**
+ * Gets when the soonest timer is due.
+ * @param timers The timers
+ * @return T-states it is due at, UINT64_MAX if none are set
+ */
+static inline uint64_t nextTimer(const timers_t* timers) {
+	return timers->size ? timers->timers[timers->heap[0]].at : UINT64_MAX;
+}
+
+#endif
@@ -3,7 +3,10 @@
 
 #include <stdint.h>
 
-uint16_t loadAEF(const char* filename);
-int runAEF(const uint16_t entry);
+#include "m80.h"
+
+int loadAEF(machine_t* m, const char* filename, uint16_t* entry);
+int runAEF(machine_t* m, const uint16_t entry);
+int resumeAEF(machine_t* m);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,75 @@
+#ifndef _BANK_H
+#define _BANK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "m80.h"
+
+#define BANK_PORT 0x70 // Where the bank registers usually are, one for each window
+#define BANK_WINDOW 0x3800 // Where a window usually is, the top 16KB of the text-data segment
+#define BANK_SIZE 0x4000 // Default bytes in a bank, and so in its window
+#define BANK_COUNT 64 // Default banks a window can switch between, 1MB of 16KB banks
+#define MAX_WINDOWS 8
+#define MAX_BANKS 256 // As many as a bank register can number
+
+// A window of the address space banks are switched into
+typedef struct bankWindow {
+	uint8_t first; // Its first page
+	uint8_t bank; // The bank switched in, 0 being the window's own place in the RAM
+} bank_window_t;
+
+// Bank-switched extended memory. Each window has banks of its own in the machine's extended memory,
+// so no bank is ever seen at two addresses at once, and switching one in only points the page
+// tables at it.
+typedef struct banks {
+	machine_t* m;
+	uint8_t port;
+	int pages; // Pages in a bank
+	int count; // Banks a window can switch between
+	bank_window_t windows[MAX_WINDOWS];
+	int numWindows;
+} banks_t;
+
+
+/**
+ * Attaches bank-switched memory to the machine, the register for each window on the port
+ * and the ones after it, and maps the extended memory the banks are in.
+ * @param m The machine, without banks
+ * @param port The first window's register
+ * @param windows Where each window starts, on a page boundary
+ * @param numWindows How many windows, up to MAX_WINDOWS
+ * @param size Bytes in a bank, whole pages
+ * @param count Banks each window can switch between, up to MAX_BANKS
+ * @return 0 on success, -1 if the windows do not fit in the address space or the banks could not be mapped
+ */
+int attachBanks(machine_t* m, uint8_t port, const uint16_t* windows, int numWindows, uint32_t size, int count);
+
+/**
+ * Switches a bank into a window, as writing its register does.
+ * @param m The machine, with banks
+ * @param window The window
+ * @param bank The bank, 0 for the window's own place in the RAM, ignored past the last
+ */
+void switchBank(machine_t* m, int window, uint8_t bank);
+
+/**
+ * Switches every window back to its own place in the RAM and clears the banks.
+ * @param m The machine
+ */
+void resetBanks(machine_t* m);
+
+/**
+ * Gives the fork its own copy of the bank registers, its extended memory having been forked with the rest.
+ * @param child The fork
+ * @param m The machine it was forked from
+ */
+void forkBanks(machine_t* child, machine_t* m);
+
+/**
+ * Frees the machine's bank registers, if it has them. The extended memory goes with the rest of memory.
+ * @param m The machine
+ */
+void freeBanks(machine_t* m);
+
+#endif
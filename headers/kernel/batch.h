@@ -0,0 +1,32 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include <stdbool.h>
+
+#include "machine.h"
+
+#define BATCH_MAX_PATH 4096 // Longest path a manifest line can hold
+
+// How the machines running a batch are set up
+typedef struct batchOpts {
+	run_mode_t mode;
+	bool jit;
+	uint8_t waitStates; // TW states in every memory and I/O machine cycle
+	int workers; // Threads running jobs
+} batch_opts_t;
+
+
+/**
+ * Runs every program listed in the manifest, one per line, each on a fresh machine.
+ * Blank lines and lines starting with # are skipped. Once all have finished, a
+ * tab separated summary is printed with a line per program in manifest order:
+ * the path, the status it stopped with, the exit code, the T-states ran, and
+ * the wall time in microseconds. A program that could not be loaded has the
+ * status LOAD, and one no worker got to, there being no machine to run it on, NORUN.
+ * @param manifest The file listing the programs
+ * @param opts How to run them
+ * @return 0 if every program halted, 1 if any did not or was never run, -1 if the manifest could not be read
+ */
+int runBatch(const char* manifest, const batch_opts_t* opts);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef _CONSOLE_H
+#define _CONSOLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "m80.h"
+
+#define CONSOLE_STATUS_PORT 0x00 // IN reads the status bits, OUT sets the interrupt enables
+#define CONSOLE_DATA_PORT 0x01 // IN reads a character, OUT writes one
+
+#define CONSOLE_RX_READY 0x01 // A character is waiting to be read
+#define CONSOLE_TX_READY 0x02 // A character can be written, always set
+
+#define CONSOLE_RX_INT 0x01 // Written to the status port, raises CONSOLE_IRQ while a character is waiting
+#define CONSOLE_IRQ 1 // Taken as RST 1
+
+#define CONSOLE_BUF_SIZE 4096 // Bytes each way, a power of 2
+#define CONSOLE_FLUSH_TSTATES 100000 // Most T-states output is held for without a newline
+#define CONSOLE_POLL_TSTATES 10000 // Least T-states between looking for input while there is none
+
+// Bytes between the host and the guest, the indices only ever count up
+typedef struct ring {
+	uint8_t buf[CONSOLE_BUF_SIZE];
+	size_t head; // Taken off here
+	size_t tail; // Put on here
+} ring_t;
+
+// The guest's console, output is gathered up and written to the host a line at a time
+// and input is read ahead of the guest as it becomes available
+typedef struct console {
+	machine_t* m;
+	int in;
+	int out;
+	bool eof; // Nothing more will come in
+	bool rxInt; // Whether waiting input raises an interrupt
+	bool polling; // Whether the guest last found no input waiting
+	bool watching; // Whether input is looked for without the guest asking, it being wanted for an interrupt or a poll
+	ring_t rx;
+	ring_t tx;
+	uint64_t flushAt; // T-states the output is written by, UINT64_MAX while there is none
+	uint64_t pollAt; // T-states input is next looked for
+} console_t;
+
+
+/**
+ * Attaches a console to the machine's console ports.
+ * @param m The machine
+ * @param in The host file input is read from
+ * @param out The host file output is written to
+ */
+void attachConsole(machine_t* m, int in, int out);
+
+/**
+ * Gives the fork its own copy of the console on the same host files, with the input waiting
+ * copied too. What the parent has written is written out first.
+ * @param child The fork
+ * @param m The machine it was forked from
+ */
+void forkConsole(machine_t* child, machine_t* m);
+
+/**
+ * Writes out all the output held by the console.
+ * @param console The console
+ */
+void flushConsole(console_t* console);
+
+/**
+ * Writes out the machine's console and frees it, if it has one.
+ * @param m The machine
+ */
+void freeConsole(machine_t* m);
+
+#endif
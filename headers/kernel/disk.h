@@ -0,0 +1,85 @@
+#ifndef _DISK_H
+#define _DISK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "m80.h"
+
+#define DISK_PORT 0x30 // Where the disk is usually put, command and status then the registers
+#define DISK_IRQ 4 // A transfer finished, taken as RST 4
+#define DISK_SECTOR_SIZE 128 // Default sector size, as on 8" floppies
+#define DISK_BYTE_TSTATES 1 // T-states a byte takes to transfer, the bus given over to the disk
+
+// Registers, after the command and status port
+#define DISK_SECTOR_LSB 1
+#define DISK_SECTOR_MSB 2
+#define DISK_ADDR_LSB 3 // Where in memory the transfer starts
+#define DISK_ADDR_MSB 4
+#define DISK_COUNT 5 // Sectors to transfer
+#define DISK_PORTS 6
+
+// Commands, written to the command port
+#define DISK_READ 0x01 // Sectors to memory
+#define DISK_WRITE 0x02 // Memory to sectors
+#define DISK_FLUSH 0x03 // Sectors written to the host file
+#define DISK_INT 0x80 // Or'd in to interrupt once the command is done
+
+// Status bits, read from the command port
+#define DISK_BUSY 0x01
+#define DISK_ERROR 0x02 // The last command was not understood, ran off the disk or memory, or could not write
+#define DISK_READY 0x80 // There is an image
+
+// A disk whose image is mapped from a host file, sectors copied to and from memory in bulk
+typedef struct disk {
+	machine_t* m;
+	uint8_t port;
+	int fd;
+	uint8_t* image;
+	size_t size;
+	bool readOnly;
+	uint16_t sectorSize;
+	uint32_t sectors;
+	uint16_t sector; // The registers, moved past a transfer so the next carries on from it
+	uint16_t addr;
+	uint8_t count;
+	uint8_t status;
+	bool interrupting; // Raised DISK_IRQ, until the status is read
+	bool interrupt; // The command being done interrupts once it is
+	int timer; // When the command being done is
+} disk_t;
+
+
+/**
+ * Attaches a disk to the machine's ports from the port on, mapping its image in. The image is
+ * opened for reading only if it cannot be written.
+ * @param m The machine, without a disk
+ * @param port The command port
+ * @param path The image
+ * @param sectorSize Bytes a sector
+ * @return 0 on success, -1 if the image could not be mapped
+ */
+int attachDisk(machine_t* m, uint8_t port, const char* path, uint16_t sectorSize);
+
+/**
+ * Puts the disk's registers back as they were attached, dropping the end of a command being done.
+ * What has been written to the image stays.
+ * @param m The machine, with a disk
+ */
+void resetDisk(machine_t* m);
+
+/**
+ * Gives the fork its own copy of the disk, its image mapped copy-on-write so what it writes is its own.
+ * @param child The fork
+ * @param m The machine it was forked from
+ */
+void forkDisk(machine_t* child, machine_t* m);
+
+/**
+ * Writes what the machine's disk has had written back to its image and frees it, if it has one.
+ * @param m The machine
+ */
+void freeDisk(machine_t* m);
+
+#endif
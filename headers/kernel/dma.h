@@ -0,0 +1,108 @@
+#ifndef _DMA_H
+#define _DMA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "m80.h"
+
+#define DMA_PORT 0x50 // Where the controller is usually put, the channel registers then mode and status
+#define DMA_CHANNELS 4
+#define DMA_MODE_PORT 8 // After the first port, mode set when written, status when read
+#define DMA_REQUEST_PORT 9 // Not on an 8257, software requests as on the 8237
+#define DMA_PORTS 10
+#define DMA_MAX_BLOCK 0x4000 // Bytes the 14 bit count can have moved, the count being one less
+#define DMA_CYCLE_TSTATES 4 // T-states a DMA cycle takes the bus for, S1 to S4
+
+// Terminal count register, the count and the transfer in its top two bits
+#define DMA_COUNT(tc) ((tc) & 0x3FFF)
+#define DMA_TRANSFER(tc) ((tc) >> 14)
+#define DMA_VERIFY 0 // Cycles are ran without moving anything
+#define DMA_WRITE 1 // Device to memory
+#define DMA_READ 2 // Memory to device
+
+// Mode set bits, the low four enabling the channels
+#define DMA_ROTATE 0x10 // The channel just serviced goes to the lowest priority
+#define DMA_EXTENDED_WRITE 0x20
+#define DMA_TC_STOP 0x40 // A channel is disabled once its count is done
+#define DMA_AUTOLOAD 0x80 // Channel 2 is loaded again from channel 3 once its count is done
+
+// Status bits, the low four the channels that reached terminal count since the status was last read
+#define DMA_UPDATE 0x10
+
+// Software request bits
+#define DMA_REQUEST_CHANNEL(req) ((req) & 0x3)
+#define DMA_REQUEST 0x04 // Requests the channel as its device would
+#define DMA_MEM_TO_MEM 0x08 // Copies channel 0's block to channel 1's address, as the 8237 does
+
+// A channel, and the device on it
+typedef struct dmaChannel {
+	uint16_t addr;
+	uint16_t tc; // Terminal count register
+	m80_dma_in_t in; // Fills the block for a write to memory, NULL to float the bus
+	m80_dma_out_t out; // Takes the block of a read from memory, NULL to drop it
+	void* ctx;
+} dma_channel_t;
+
+// An 8257-style DMA controller. Blocks are moved in one go as host copies rather than a byte at a
+// time, the processor being held for the DMA cycles the bytes would have taken.
+typedef struct dma {
+	machine_t* m;
+	uint8_t port;
+	dma_channel_t channels[DMA_CHANNELS];
+	uint8_t mode;
+	uint8_t status;
+	uint8_t requests; // Channels with DREQ raised, not yet serviced
+	bool memToMem; // The request on channel 0 copies to channel 1
+	bool high; // The first/last flip-flop, the high byte of a register is next
+	int last; // The channel last serviced, for rotating priority
+	int timer; // Takes the bus once there is something to service, -1 if the machine had too many
+	uint8_t buf[DMA_MAX_BLOCK]; // The block being moved
+} dma_t;
+
+
+/**
+ * Attaches a DMA controller to the machine's ports from the port on.
+ * @param m The machine, without a controller
+ * @param port The first port
+ */
+void attachDma(machine_t* m, uint8_t port);
+
+/**
+ * Puts a device on a channel of the machine's controller.
+ * @param m The machine
+ * @param channel The channel, 0 to 3
+ * @param in Fills a block written to memory
+ * @param out Takes a block read from memory
+ * @param ctx Passed on to in and out
+ * @return 0 on success, -1 if there is no controller or no such channel
+ */
+int attachDmaChannel(machine_t* m, int channel, m80_dma_in_t in, m80_dma_out_t out, void* ctx);
+
+/**
+ * Raises DREQ for a channel, the controller taking the bus for its block between instructions.
+ * @param m The machine
+ * @param channel The channel, 0 to 3
+ */
+void requestDma(machine_t* m, int channel);
+
+/**
+ * Resets the machine's controller, every channel disabled with nothing requested.
+ * @param m The machine, with a controller
+ */
+void resetDma(machine_t* m);
+
+/**
+ * Gives the fork its own copy of the controller, the devices on it staying the parent's.
+ * @param child The fork
+ * @param m The machine it was forked from
+ */
+void forkDma(machine_t* child, machine_t* m);
+
+/**
+ * Frees the machine's controller, if it has one.
+ * @param m The machine
+ */
+void freeDma(machine_t* m);
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef _IDLE_H
+#define _IDLE_H
+
+#include <stdbool.h>
+#include <poll.h>
+
+#include "m80.h"
+#include "machine.h"
+
+#define MAX_WATCHES 16 // Host files watched for devices while halted or spinning
+#define WATCH_POLL_TSTATES 10000 // Least T-states between looking at the watched files while running
+#define SPIN_SAMPLE 64 // Branches back between looking at whether the loop is spinning
+
+// The host files that can bring a processor out of a halt or a polling loop
+typedef struct idle {
+	struct pollfd fds[MAX_WATCHES];
+	m80_ready_t ready[MAX_WATCHES];
+	void* ctx[MAX_WATCHES];
+	int count;
+	uint64_t pollAt; // T-states the files are next looked at while running
+} idle_t;
+
+// A loop being looked at to see whether it can change anything, the processor as it was at its start
+typedef struct spin {
+	uint8_t countdown; // Branches back until the next is looked at
+	uint16_t head; // Where the loop starts, branched back to
+	uint64_t at; // T-states it started at
+	bool quiet; // Whether only quiet blocks have ran since
+	uint16_t sp;
+	uint8_t gpr[6];
+	uint8_t acc;
+	uint8_t eflags;
+	lazy_flags_t lazy;
+} spin_t;
+
+
+/**
+ * Stops watching every file.
+ * @param idle The watched files
+ */
+void initIdle(idle_t* idle);
+
+/**
+ * Watches a host file for a device, while the processor is halted or spinning and every
+ * WATCH_POLL_TSTATES while running.
+ * @param m The machine
+ * @param fd The host file
+ * @param ready Called when the file is readable
+ * @param ctx Passed on to ready
+ * @return 0 on success, -1 if too many files are watched
+ */
+int watchFd(machine_t* m, int fd, m80_ready_t ready, void* ctx);
+
+/**
+ * Stops watching a host file, if it is watched.
+ * @param m The machine
+ * @param fd The host file
+ */
+void unwatchFd(machine_t* m, int fd);
+
+/**
+ * Lets the devices read whichever watched files are ready, without waiting for any,
+ * looking again WATCH_POLL_TSTATES later.
+ * @param m The machine
+ */
+void pollWatched(machine_t* m);
+
+/**
+ * Sleeps until a watched file is ready, letting the devices watching it read it, or until the
+ * next device timer is due. A run kept to a clock wakes for the next event instead, the time
+ * slept being taken as T-states the processor spent waiting. Otherwise time does not pass
+ * while asleep, and waiting for a timer is moving the T-states on to it.
+ * @param m The machine
+ * @return Files ready, 0 if woken by the time, -1 if nothing is watched and no timer set
+ */
+int waitWatched(machine_t* m);
+
+/**
+ * Gets whether the processor is spinning, back at the start of the loop it was at with nothing
+ * changed. A loop that ran only quiet blocks and comes back around to the same state does the
+ * same every pass, until a device or an event changes something. Only the branch back after
+ * one that was looked at is compared with it, the rest only count down to the next.
+ * @param m The machine, just branched back
+ * @param spin The loop being looked at
+ * @return Whether it is spinning
+ */
+bool spinning(machine_t* m, spin_t* spin);
+
+/**
+ * Skips over a spinning loop. The thread sleeps until a watched file is ready or a device
+ * timer is due, or failing both the T-states are moved on to the next event. Either way the
+ * loop is left at the first pass through it at or after the time it was skipped to. A loop
+ * nothing could ever break out of ends the run, halted.
+ * @param m The machine, spinning
+ * @param spin The loop
+ */
+void skipSpin(machine_t* m, spin_t* spin);
+
+#endif
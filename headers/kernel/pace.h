@@ -0,0 +1,56 @@
+#ifndef _PACE_H
+#define _PACE_H
+
+#include <stdint.h>
+
+#include "m80.h"
+
+#define PACE_BATCHES 1000 // Times a second of emulated time the run is brought back in line with the clock
+#define PACE_MAX_LAG 50000000 // Nanoseconds a run can fall behind the clock before it stops trying to catch up
+
+// Keeps a run to the clock, T-states being matched to host time from a point both were taken at
+typedef struct pace {
+	uint64_t hz; // T-states a second
+	uint64_t baseCycles; // T-states at baseTime
+	uint64_t baseTime; // Host monotonic time in nanoseconds
+	uint64_t next; // T-states the run is next brought in line at
+} pace_t;
+
+
+/**
+ * Runs the machine at the clock, or as fast as it can.
+ * @param m The machine
+ * @param hz T-states a second, 0 to not keep to a clock
+ */
+void setClock(machine_t* m, uint64_t hz);
+
+/**
+ * Starts keeping to the clock from now, as a run starts or carries on.
+ * @param m The machine, with a clock
+ */
+void startPace(machine_t* m);
+
+/**
+ * Sleeps until host time catches up with the T-states ran, in one go for the whole batch
+ * since the last time. A run that falls too far behind, on a host too slow or stopped,
+ * is taken as in line from now rather than rushing to catch up.
+ * @param m The machine, with a clock
+ */
+void pace(machine_t* m);
+
+/**
+ * Gets how long until the run is due at the T-states by the clock.
+ * @param pace The clock
+ * @param cycles The T-states
+ * @return Nanoseconds of host time, 0 if already past
+ */
+uint64_t paceWait(const pace_t* pace, uint64_t cycles);
+
+/**
+ * Gets the T-states the run is at by the clock.
+ * @param pace The clock
+ * @return The T-states
+ */
+uint64_t paceCycles(const pace_t* pace);
+
+#endif
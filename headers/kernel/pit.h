@@ -0,0 +1,85 @@
+#ifndef _PIT_H
+#define _PIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "m80.h"
+
+#define PIT_PORT 0x40 // Where the timer is usually put, counters 0 to 2 then the control port
+#define PIT_COUNTERS 3
+#define PIT_CONTROL_PORT 3 // After the first port, sets a counter up or latches it
+#define PIT_IRQ 2 // Counter 0's output, taken as RST 2, RST 0 being where the program starts
+#define PIT_TSTATES 1 // Default T-states a count takes, the timer clocked as fast as the processor
+
+// How a counter is read and written, from the control word
+#define PIT_LATCH 0 // Not an access, latches the count for reading
+#define PIT_LSB 1
+#define PIT_MSB 2
+#define PIT_WORD 3 // The low byte, then the high
+
+// Counter modes, gate is tied high so the hardware triggered 1 and 5 are loaded but never start
+#define PIT_TERMINAL 0 // Interrupts once, counting down to 0
+#define PIT_ONE_SHOT 1
+#define PIT_RATE 2 // Interrupts every period
+#define PIT_SQUARE 3 // Interrupts every period, high for the first half
+#define PIT_STROBE 4 // Interrupts once, counting down to 0
+#define PIT_HW_STROBE 5
+
+// A counter is never counted down, its count is worked out from the T-states it was loaded at
+typedef struct pitCounter {
+	struct pit* pit;
+	uint8_t mode;
+	uint8_t access;
+	bool bcd; // Counts in four decimal digits rather than binary
+	uint16_t count; // The count register as the guest last wrote it
+	uint32_t period; // Counts from loading to 0, count 0 being the most there can be
+	bool counting;
+	uint64_t loadedAt; // T-states the count was loaded at
+	uint32_t nextPeriod; // A count written while periodic, taken at the end of the period, 0 if none
+	uint64_t switchAt; // T-states the period ends at
+	bool writeHigh; // The high byte is written next
+	bool readHigh; // The high byte is read next
+	bool latched; // A latched count is read until it has all been read
+	uint16_t latch;
+	int irq; // The line its output interrupts on, -1 if not wired
+	int timer; // Fires on each rising edge of its output
+} pit_counter_t;
+
+// An 8253-style interval timer, clocked from the processor's T-states
+typedef struct pit {
+	machine_t* m;
+	uint8_t port;
+	uint32_t tstates; // T-states a count takes
+	pit_counter_t counters[PIT_COUNTERS];
+} pit_t;
+
+
+/**
+ * Attaches an interval timer to the machine's ports from the port on, counter 0 interrupting on PIT_IRQ.
+ * @param m The machine, without a timer
+ * @param port The first port
+ * @param tstates T-states a count takes
+ */
+void attachPit(machine_t* m, uint8_t port, uint32_t tstates);
+
+/**
+ * Puts every counter back as it was attached, none counting.
+ * @param m The machine, with a timer
+ */
+void resetPit(machine_t* m);
+
+/**
+ * Gives the fork its own copy of the timer, counting on from where it was.
+ * @param child The fork
+ * @param m The machine it was forked from
+ */
+void forkPit(machine_t* child, machine_t* m);
+
+/**
+ * Frees the machine's timer, if it has one.
+ * @param m The machine
+ */
+void freePit(machine_t* m);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define PROFILE_TOP_PAIRS 20 // Pairs listed in the report
+
+// How often each opcode was ran right after each other one
+typedef struct pairProfile {
+	bool started; // Whether `prev` holds an opcode yet
+	uint8_t prev; // The opcode ran last
+	uint64_t total;
+	uint64_t counts[256][256]; // Indexed by the first opcode, then the second
+} pair_profile_t;
+
+
+/**
+ * Counts the opcode as following the one ran before it.
+ * @param profile The profile
+ * @param opcode The opcode being ran
+ */
+static inline void countPair(pair_profile_t* profile, uint8_t opcode) {
+	if (profile->started) {
+		profile->counts[profile->prev][opcode]++;
+		profile->total++;
+	}
+
+	profile->started = true;
+	profile->prev = opcode;
+}
+
+/**
+ * Prints the most frequent pairs, one per line as the two opcodes, the count, and the share of all pairs.
+ * @param profile The profile
+ * @param out Where to print to
+ */
+void reportPairs(const pair_profile_t* profile, FILE* out);
+
+#endif
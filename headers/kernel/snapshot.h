@@ -0,0 +1,119 @@
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "machine.h"
+#include "bank.h"
+
+// A snapshot record is the magic, version and kind, the registers, buses and signals, the segment
+// table, the interrupt lines and controller, the bank switched into each window, then a bitmap of
+// memory pages followed by only those pages. A full record holds the pages
+// with anything other than zeroes, a delta the pages written since the record before it. Every
+// field is stored little endian, whatever the host. A snapshot file is a full record, optionally
+// followed by deltas.
+#define SNAP_MAGIC "M80S"
+#define SNAP_VERSION 3
+
+#define SNAP_FULL 0
+#define SNAP_DELTA 1
+
+#define SNAP_HDR_SIZE 7 // Magic, version and kind
+#define SNAP_PROC_SIZE 30 // Registers, flags, T-states, buses and status
+#define SNAP_STATE_SIZE 3 // Internal data bus, status and control signals
+#define SNAP_SEG_SIZE (2 * (STACK_SEG + 1))
+#define SNAP_INTR_SIZE 13 // Lines raised, masked and in service, when EI finished and the controller's state
+#define SNAP_BANK_SIZE (1 + MAX_WINDOWS) // Windows, then the bank in each
+#define SNAP_MAP_SIZE (MEM_PAGES / 8)
+#define SNAP_FIXED_SIZE (SNAP_HDR_SIZE + SNAP_PROC_SIZE + SNAP_STATE_SIZE + SNAP_SEG_SIZE + SNAP_INTR_SIZE + SNAP_BANK_SIZE + SNAP_MAP_SIZE)
+#define SNAP_MAX_SIZE (SNAP_FIXED_SIZE + MAX_ADDR + 1)
+
+#define CHECKPOINT_INTERVAL 100000000 // Default T-states between checkpoints
+#define CHECKPOINT_MAX_LOG (8 * SNAP_MAX_SIZE) // Size the log is started over with a full record at
+
+// The state a machine is reset back to without reloading it
+typedef struct baseline {
+	proc_t proc;
+	uint16_t segStart[STACK_SEG + 1];
+	uint8_t ram[MAX_ADDR + 1]; // The RAM itself, whatever banks were switched in over it
+	uint8_t* ext; // Extended memory, NULL if the machine had none
+	size_t extSize;
+	uint8_t banks[MAX_WINDOWS]; // The bank switched into each window
+} baseline_t;
+
+// The snapshot file a run is checkpointed to, appending a delta each time
+typedef struct checkpoint {
+	char* filename;
+	int fd;
+	uint64_t interval; // T-states between checkpoints
+	uint64_t next; // T-states the next checkpoint is due at
+	size_t size; // Bytes in the file
+	uint8_t* buf; // Holds a record while it is written
+} checkpoint_t;
+
+
+/**
+ * Writes the machine's state to the file as a full record, replacing it.
+ * @param m The machine
+ * @param filename The snapshot
+ * @return 0 on success, -1 if the file could not be written
+ */
+int saveSnapshot(machine_t* m, const char* filename);
+
+/**
+ * Puts the machine in the state held by the snapshot, applying its deltas in order. A delta
+ * cut short, as by a crash while it was written, is left off along with anything after it.
+ * The machine is left as it was if the file cannot be read or is not a snapshot of this version.
+ * @param m The machine
+ * @param filename The snapshot
+ * @return 0 on success, -1 otherwise
+ */
+int restoreSnapshot(machine_t* m, const char* filename);
+
+/**
+ * Starts checkpointing the machine to the file, writing a full record now and a delta
+ * every interval T-states of running after.
+ * @param m The machine
+ * @param filename The snapshot to write to
+ * @param interval T-states between checkpoints
+ * @return 0 on success, -1 if the file could not be written
+ */
+int startCheckpoints(machine_t* m, const char* filename, uint64_t interval);
+
+/**
+ * Stops checkpointing the machine, if it was.
+ * @param m The machine
+ */
+void stopCheckpoints(machine_t* m);
+
+/**
+ * Appends the pages written since the last checkpoint to the file, starting the file over
+ * with a full record once it grows past CHECKPOINT_MAX_LOG. Checkpointing is stopped if
+ * the file cannot be written.
+ * @param m The machine, being checkpointed
+ * @return 0 on success, -1 otherwise
+ */
+int checkpoint(machine_t* m);
+
+/**
+ * Records the machine's state as the baseline to reset back to.
+ * @param m The machine
+ */
+void setBaseline(machine_t* m);
+
+/**
+ * Puts the machine back to its baseline, switching the banks back and copying back only the
+ * pages written since, including those of memory switched out.
+ * @param m The machine
+ * @return 0 on success, -1 if no baseline was set
+ */
+int resetBaseline(machine_t* m);
+
+/**
+ * Frees the machine's baseline, if it has one.
+ * @param m The machine
+ */
+void freeBaseline(machine_t* m);
+
+#endif
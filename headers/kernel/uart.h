@@ -0,0 +1,113 @@
+#ifndef _UART_H
+#define _UART_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "m80.h"
+
+#define UART_PORT 0x10 // Where the USART is usually put, data then control and status
+#define UART_CONTROL_PORT 1 // After the data port
+#define UART_IRQ 3 // RxRDY, taken as RST 3
+#define UART_BAUD 9600 // Default line rate
+#define UART_CPU_HZ 2000000 // Processor clock the line rate is timed against when the run is not kept to one
+
+// Status bits
+#define UART_TX_READY 0x01
+#define UART_RX_READY 0x02
+#define UART_TX_EMPTY 0x04
+#define UART_DSR 0x80 // Something is connected to the host end
+
+// Command bits
+#define UART_TX_ENABLE 0x01
+#define UART_RX_ENABLE 0x04
+#define UART_INTERNAL_RESET 0x40 // The next control write is a mode instruction again
+
+// Mode instruction fields
+#define UART_MODE_FACTOR(mode) ((mode) & 0x3) // 0 for synchronous
+#define UART_MODE_BITS(mode) (5 + (((mode) >> 2) & 0x3))
+#define UART_MODE_PARITY(mode) (((mode) >> 4) & 0x1)
+#define UART_MODE_STOP(mode) ((mode) >> 6) // In half bits, less 1: 1, 1.5 or 2 stop bits
+#define UART_MODE_SINGLE_SYNC 0x80
+
+#define UART_BUF_SIZE 4096 // Bytes each way, a power of 2
+
+// Bytes between the I/O thread and the machine, each index only moved by the side it names
+typedef struct uartRing {
+	uint8_t buf[UART_BUF_SIZE];
+	atomic_size_t head; // Taken off here, by the reader
+	atomic_size_t tail; // Put on here, by the writer
+} uart_ring_t;
+
+// An 8251-style USART in asynchronous mode. Its host end is a pseudo-terminal or a unix socket,
+// served by a thread of its own that moves bytes through the rings in bulk. Characters go on
+// and off the line at the line rate, timed against the T-states.
+typedef struct uart {
+	machine_t* m;
+	uint8_t port;
+	uint64_t bitTstates; // T-states a bit takes on the line
+	uint64_t charTstates; // T-states a character takes, with its start, parity and stop bits
+
+	// Only touched by the machine
+	bool expectMode; // The next control write is a mode instruction
+	uint8_t syncChars; // Sync characters still to come after a synchronous mode instruction
+	uint8_t command;
+	uint8_t rxData;
+	bool rxFull; // rxData holds a character not yet read, nothing more is taken off the line until it is
+	bool receiving; // A character is coming in off the line
+	int rxTimer; // Fires as it finishes coming in
+	uint64_t txDoneAt; // T-states the last character written is sent by
+	int doorbell; // Readable once the I/O thread has put bytes on the rx ring
+	bool watching; // Whether the doorbell is watched, only while the receiver is enabled
+
+	// Shared with the I/O thread
+	uart_ring_t rx;
+	uart_ring_t tx;
+	atomic_bool sleeping; // The I/O thread is about to wait, and has to be woken for anything new
+	atomic_bool stop;
+	atomic_bool connected; // Something is on the host end
+	int wake; // Wakes the I/O thread
+	pthread_t thread;
+
+	// Only touched by the I/O thread once started
+	char* path; // The socket, removed once the USART is freed
+	int listener; // The socket connections are taken on, -1 for a pseudo-terminal
+	int host; // The host end, -1 while nothing is connected
+	int peer; // The pseudo-terminal's other end, kept open so it does not hang up between clients
+} uart_t;
+
+
+/**
+ * Attaches a USART to the machine's ports from the port on, its host end on a new pseudo-terminal,
+ * whose name is printed, or a unix socket listening at the path.
+ * @param m The machine, without a USART
+ * @param port The data port
+ * @param path Where the socket listens, NULL for a pseudo-terminal
+ * @param bitTstates T-states a bit takes on the line
+ * @return 0 on success, -1 if the host end could not be set up
+ */
+int attachUart(machine_t* m, uint8_t port, const char* path, uint64_t bitTstates);
+
+/**
+ * Resets the machine's USART, as its RESET input would, the host end staying connected.
+ * @param m The machine, with a USART
+ */
+void resetUart(machine_t* m);
+
+/**
+ * Empties the fork's USART ports, the host end cannot be shared.
+ * @param child The fork
+ * @param m The machine it was forked from
+ */
+void forkUart(machine_t* child, machine_t* m);
+
+/**
+ * Stops the machine's USART and frees it, if it has one, sending what the guest wrote first.
+ * @param m The machine
+ */
+void freeUart(machine_t* m);
+
+#endif
@@ -0,0 +1,347 @@
+#ifndef _M80_H_
+#define _M80_H_
+
+#include <stdint.h>
+
+// An emulated 8080 along with its memory. Machines share nothing with each other,
+// so any number of them can be created and each ran from its own thread.
+typedef struct machine machine_t;
+
+// A device on an I/O port, called with the context it was attached with. Reads return the byte the
+// device puts on the data bus.
+typedef uint8_t (*m80_port_in_t)(void* ctx, uint8_t port);
+typedef void (*m80_port_out_t)(void* ctx, uint8_t port, uint8_t data);
+
+// Called when a host file a device is watching becomes readable while the processor is halted
+typedef void (*m80_ready_t)(void* ctx, int fd);
+
+// Called when a timer a device set comes due, with the T-states it was due at. Timers are seen to
+// between blocks of instructions, so the processor may have gone a little past.
+typedef void (*m80_timer_fn_t)(void* ctx, uint64_t at);
+
+// A device on a DMA channel moving a block, filling the buffer with the bytes written to memory,
+// or taking the bytes read from memory out of it
+typedef void (*m80_dma_in_t)(void* ctx, uint8_t* buf, uint16_t len);
+typedef void (*m80_dma_out_t)(void* ctx, const uint8_t* buf, uint16_t len);
+
+// Device plugins are shared objects exporting M80_DEVICE_INIT, called once for each machine the
+// plugin is loaded into to attach its ports. It is given the machine, the arguments the plugin
+// was loaded with, and M80_DEVICE_ABI as this emulator has it, and returns the device, or NULL
+// having attached nothing if it could not be set up. M80_DEVICE_FREE, if exported, is called with the device when the
+// machine is destroyed.
+#define M80_DEVICE_ABI 1
+#define M80_DEVICE_INIT "m80_device_init"
+#define M80_DEVICE_FREE "m80_device_free"
+typedef void* (*m80_device_init_t)(machine_t* m, const char* args, int abi);
+typedef void (*m80_device_free_t)(void* device);
+
+
+/**
+ * Creates a machine with cleared registers and memory.
+ * @return The machine, or NULL if its memory could not be mapped
+ */
+machine_t* m80_create();
+
+/**
+ * Puts the machine back as it was created, without allocating anything, so it can run another program.
+ * @param m The machine
+ */
+void m80_reset(machine_t* m);
+
+/**
+ * Loads an AEF executable into the machine's memory.
+ * @param m The machine
+ * @param filename The executable
+ * @param entry Set to the entry point
+ * @return 0 on success, -1 if the file could not be read or is not an AEF executable
+ */
+int m80_load(machine_t* m, const char* filename, uint16_t* entry);
+
+/**
+ * Runs the machine from the entry point until it stops.
+ * @param m The machine
+ * @param entry The address to start at
+ * @return 0 if the program halted, otherwise the status it stopped with
+ */
+int m80_run(machine_t* m, uint16_t entry);
+
+/**
+ * Runs the machine on from where it stopped, such as after restoring a snapshot.
+ * @param m The machine
+ * @return 0 if the program halted, otherwise the status it stopped with
+ */
+int m80_resume(machine_t* m);
+
+/**
+ * Saves the registers, signals, interrupt lines, bank windows and memory to a snapshot file.
+ * The other devices are not saved, being the machine's own.
+ * @param m The machine
+ * @param filename The snapshot
+ * @return 0 on success, -1 if the file could not be written
+ */
+int m80_save(machine_t* m, const char* filename);
+
+/**
+ * Puts the machine in the state saved in a snapshot file.
+ * @param m The machine
+ * @param filename The snapshot
+ * @return 0 on success, -1 if the file could not be read or is not a snapshot, leaving the machine as it was
+ */
+int m80_restore(machine_t* m, const char* filename);
+
+/**
+ * Checkpoints the machine's runs to a snapshot file, so a long run can be restored and resumed
+ * after a crash. A full snapshot is written now, then every interval T-states, and when a run
+ * stops, only the pages written since the last checkpoint are appended.
+ * @param m The machine
+ * @param filename The snapshot to write, or NULL to stop checkpointing
+ * @param interval T-states between checkpoints
+ * @return 0 on success, -1 if the file could not be written
+ */
+int m80_checkpoint(machine_t* m, const char* filename, uint64_t interval);
+
+/**
+ * Records the machine's registers and memory as the baseline to reset back to, such as
+ * once a program is loaded and before it is ran with the first of many inputs.
+ * @param m The machine
+ */
+void m80_set_baseline(machine_t* m);
+
+/**
+ * Puts the machine back to its baseline. Only the memory pages written since are copied
+ * back, which makes it far cheaper than resetting and loading the program again.
+ * @param m The machine
+ * @return 0 on success, -1 if no baseline was set
+ */
+int m80_reset_baseline(machine_t* m);
+
+/**
+ * Attaches a device to an I/O port, replacing whatever was there.
+ * @param m The machine
+ * @param port The port
+ * @param in Called for IN from the port, or NULL if the device is not read, leaving 0xFF on the bus
+ * @param out Called for OUT to the port, or NULL if the device is not written
+ * @param ctx Passed on to in and out
+ */
+void m80_attach_port(machine_t* m, uint8_t port, m80_port_in_t in, m80_port_out_t out, void* ctx);
+
+/**
+ * Loads a device plugin into the machine, see M80_DEVICE_INIT.
+ * @param m The machine
+ * @param path The shared object
+ * @param args Passed on to the plugin, may be NULL
+ * @return 0 on success, -1 if the plugin could not be loaded or its device set up
+ */
+int m80_load_device(machine_t* m, const char* path, const char* args);
+
+/**
+ * Has every memory and I/O machine cycle take wait states, as slow memory or devices
+ * holding READY low would, on top of the T-states the instruction takes.
+ * @param m The machine
+ * @param waitStates TW states a machine cycle
+ */
+void m80_set_wait_states(machine_t* m, uint8_t waitStates);
+
+/**
+ * Gets the T-states the machine has ran, the time devices work to.
+ * @param m The machine
+ * @return T-states since it was started
+ */
+uint64_t m80_cycles(machine_t* m);
+
+/**
+ * Adds a timer for a device, to call it back at a T-state count. Devices keep to the emulated
+ * time this way rather than being polled, the run loop only looking at the soonest timer.
+ * @param m The machine
+ * @param fire Called when the timer comes due
+ * @param ctx Passed on to fire
+ * @return The timer, or -1 if the machine has too many
+ */
+int m80_add_timer(machine_t* m, m80_timer_fn_t fire, void* ctx);
+
+/**
+ * Sets the timer to come due at the T-states, replacing when it was set for. A timer fires once
+ * and is stopped before it is called back, so a periodic device sets it again from fire.
+ * @param m The machine
+ * @param timer The timer
+ * @param at T-states it is due at
+ */
+void m80_set_timer(machine_t* m, int timer, uint64_t at);
+
+/**
+ * Stops the timer, if it is set.
+ * @param m The machine
+ * @param timer The timer
+ */
+void m80_stop_timer(machine_t* m, int timer);
+
+/**
+ * Keeps the machine's runs to a clock, sleeping a batch at a time for host time to catch up
+ * with the T-states ran rather than running as fast as the host can.
+ * @param m The machine
+ * @param hz T-states a second, such as 2000000 for a 2 MHz 8080, or 0 to run as fast as the host can
+ */
+void m80_set_clock(machine_t* m, uint64_t hz);
+
+/**
+ * Raises an interrupt request line. The interrupt is taken between instructions once
+ * interrupts are enabled, as RST n for line n, and the line is lowered again.
+ * @param m The machine
+ * @param line The line, 0 to 7, lower lines are taken first
+ */
+void m80_raise_irq(machine_t* m, int line);
+
+/**
+ * Lowers an interrupt request line, withdrawing an interrupt not yet taken.
+ * @param m The machine
+ * @param line The line, 0 to 7
+ */
+void m80_lower_irq(machine_t* m, int line);
+
+/**
+ * Puts an 8259-style interrupt controller in front of the request lines, with its command
+ * port at the port and its mask port at the one after. A line taken stays in service, holding
+ * off itself and the lines below it in priority, until the program ends it with an EOI.
+ * @param m The machine
+ * @param port The command port
+ */
+void m80_attach_pic(machine_t* m, uint8_t port);
+
+/**
+ * Watches a host file for the device, for while the processor is halted or spinning. A halted
+ * processor with interrupts enabled parks its thread until an interrupt is raised, and one spinning
+ * in a loop that only reads until something changes, calling the device whenever the file becomes
+ * readable so it can raise an interrupt or have an answer for the loop. With nothing watched
+ * and no timer set, halting ends the run.
+ * @param m The machine
+ * @param fd The host file
+ * @param ready Called when the file is readable, it should read from it or stop watching it
+ * @param ctx Passed on to ready
+ * @return 0 on success, -1 if too many files are watched
+ */
+int m80_watch_fd(machine_t* m, int fd, m80_ready_t ready, void* ctx);
+
+/**
+ * Stops watching a host file.
+ * @param m The machine
+ * @param fd The host file
+ */
+void m80_unwatch_fd(machine_t* m, int fd);
+
+/**
+ * Attaches a console to ports 0 (status) and 1 (data). Output is gathered up and written
+ * to the host a line at a time, and input is read ahead of the guest without blocking it.
+ * @param m The machine
+ * @param in The host file input is read from
+ * @param out The host file output is written to
+ */
+void m80_attach_console(machine_t* m, int in, int out);
+
+/**
+ * Attaches an 8253-style interval timer, its three counters on the port and the two after it
+ * and its control port on the one after those. Counter 0 raises line 2 on each rising edge of its
+ * output. Counts are worked out from the T-states rather than counted down, so a counter running
+ * costs nothing until it interrupts or is read. GATE is tied high, so modes 1 and 5, which wait
+ * on it, never start.
+ * @param m The machine, without a timer
+ * @param port The port counter 0 is on
+ * @param tstates T-states a count takes, the processor clock over the timer's
+ */
+void m80_attach_pit(machine_t* m, uint8_t port, uint32_t tstates);
+
+/**
+ * Attaches an 8251-style USART in asynchronous mode, its data port on the port and its control
+ * and status port on the one after. Its host end is a new pseudo-terminal, whose name is printed,
+ * or a unix socket taking one client at a time. A thread of its own moves bytes to and from the
+ * host end in bulk, and characters go on and off the line at the line rate. A received character
+ * raises line 3 until it is read, and the next is not taken off the line until then.
+ * @param m The machine, without a USART
+ * @param port The data port
+ * @param path Where the socket listens, NULL for a pseudo-terminal
+ * @param bitTstates T-states a bit takes on the line, the processor clock over the line rate
+ * @return 0 on success, -1 if the host end could not be set up
+ */
+int m80_attach_uart(machine_t* m, uint8_t port, const char* path, uint64_t bitTstates);
+
+/**
+ * Attaches a virtual disk, its command and status port on the port and its sector, memory address
+ * and sector count registers on the five after. The image is a host file mapped in, and a command
+ * copies the sectors between it and memory in one go rather than the program moving them a byte at
+ * a time, leaving the disk busy for as long as the transfer would take. A command can have line 4
+ * raised once it is done, until the status is read.
+ * @param m The machine, without a disk
+ * @param port The command port
+ * @param path The image, written back to as the program writes to the disk
+ * @param sectorSize Bytes a sector, such as 128 or 512
+ * @return 0 on success, -1 if the image could not be mapped
+ */
+int m80_attach_disk(machine_t* m, uint8_t port, const char* path, uint16_t sectorSize);
+
+/**
+ * Attaches an 8257-style DMA controller, the address and terminal count registers of its four
+ * channels on the port and the seven after, its mode and status port on the one after those, and
+ * a software request port after that as on the 8237. A channel requested takes the bus between
+ * instructions with HOLD and moves its whole block as a host copy, the processor charged the
+ * four T-states a byte the DMA cycles would have held it for. A software request with bit 3 set
+ * copies channel 0's block to channel 1's address, memory to memory, at two DMA cycles a byte.
+ * @param m The machine, without a controller
+ * @param port The port channel 0's address register is on
+ */
+void m80_attach_dma(machine_t* m, uint8_t port);
+
+/**
+ * Puts a device on a DMA channel, replacing whatever was there.
+ * @param m The machine
+ * @param channel The channel, 0 to 3
+ * @param in Called for a block written to memory, or NULL for it to be 0xFF
+ * @param out Called for a block read from memory, or NULL for it to be dropped
+ * @param ctx Passed on to in and out
+ * @return 0 on success, -1 if the machine has no controller or there is no such channel
+ */
+int m80_attach_dma_channel(machine_t* m, int channel, m80_dma_in_t in, m80_dma_out_t out, void* ctx);
+
+/**
+ * Raises DREQ for a device's channel. The block the program set the channel up for is moved
+ * once the processor is between instructions, if the channel is enabled, or once it is.
+ * @param m The machine
+ * @param channel The channel, 0 to 3
+ */
+void m80_request_dma(machine_t* m, int channel);
+
+/**
+ * Attaches bank-switched memory beyond the 64KB that can be addressed. Each window of the address
+ * space has a register, on the port and the ones after it, that switches one of its banks in.
+ * Bank 0 is the window's own RAM and the rest are in extended memory mapped for the banks, so
+ * switching only points the window's pages elsewhere rather than copying anything. Snapshots
+ * and checkpoints hold the address space as it is seen and the bank switched into each window,
+ * not the banks switched out. Baselines hold those too.
+ * @param m The machine, without banks
+ * @param port The first window's register
+ * @param windows Where each window starts, on a 256 byte boundary
+ * @param numWindows How many windows, up to 8
+ * @param size Bytes in a bank, a multiple of 256, such as 16384
+ * @param count Banks each window can switch between, up to 256
+ * @return 0 on success, -1 if the windows do not fit in the address space or the banks could not be mapped
+ */
+int m80_attach_banks(machine_t* m, uint8_t port, const uint16_t* windows, int numWindows, uint32_t size, int count);
+
+/**
+ * Clones the machine. Memory is shared copy-on-write, so this is cheap enough to fork
+ * a machine per test case off one that has had its program loaded. The clone has no
+ * baseline and is not checkpointed. It shares its parent's devices, so it is to be
+ * destroyed before the parent is, though it has no USART as the host end cannot be shared, and
+ * its disk image is its own copy-on-write, what it writes never reaching the file. Its console
+ * is its own, on the same host files. Ports attached with the machine itself as their context
+ * are left off, as their handlers would act on the parent.
+ * @param m The machine
+ * @return The clone, to be destroyed on its own, or NULL if its memory could not be mapped
+ */
+machine_t* m80_fork(machine_t* m);
+
+/**
+ * Frees the machine and everything it holds.
+ * @param m The machine
+ */
+void m80_destroy(machine_t* m);
+
+#endif
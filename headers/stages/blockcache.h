@@ -0,0 +1,83 @@
+#ifndef _BLOCKCACHE_H_
+#define _BLOCKCACHE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "m80.h"
+#include "instr.h"
+#include "mem.h"
+
+#define BLOCK_MAX_INSNS 32 // Most instructions decoded into a single block
+#define MAX_BLOCKS 1024 // Blocks cached before the whole cache is flushed
+#define BLOCK_BUCKETS 1024 // Hash buckets, a power of 2
+
+struct proc;
+
+// Host code translated from a block, returns the number of its instructions ran on the last pass
+typedef int (*native_block_t)(struct proc* proc, uint8_t* ram, machine_t* m);
+
+// A basic block, a run of instructions ending at the first one that can change the flow
+typedef struct block {
+	uint16_t start; // Address of the first instruction
+	uint16_t end; // Address following the last instruction
+	bool valid; // Cleared once any of its code is written over
+	bool quiet; // Whether it changes nothing but registers, reading memory and devices only
+	uint8_t count; // Number of instructions
+	insn_t insns[BLOCK_MAX_INSNS];
+
+	// Blocks ran right after this one, [0] when it fell through and [1] when it branched
+	// Only followed once checked to still be valid and start at the PC
+	struct block* succ[2];
+
+	struct block* hashNext; // Next block in the same bucket, or next free block
+	struct block* pageNext[2]; // Next block on the page of `start` [0] and of `end - 1` [1]
+
+	uint16_t hits; // Times ran by the interpreter, up to JIT_THRESHOLD
+	native_block_t native; // Translated host code, or NULL
+} block_t;
+
+typedef struct blockCache {
+	block_t* buckets[BLOCK_BUCKETS];
+	block_t* pages[MEM_PAGES]; // Blocks with code on each page
+	block_t* free;
+	block_t pool[MAX_BLOCKS]; // Blocks are never freed back to the heap so stale links stay safe to check
+} block_cache_t;
+
+
+/**
+ * Allocates the block cache the first time the machine runs blocks, so machines
+ * that never do, such as forks that get thrown away, do not pay for it.
+ * @param m The machine
+ */
+void initBlocks(machine_t* m);
+
+/**
+ * Drops every cached block.
+ */
+void flushBlocks(machine_t* m);
+
+/**
+ * Gets the block starting at the PC, following the link from the previous block
+ * if it has one, decoding a new block otherwise.
+ * @param m The machine
+ * @param prev The block ran last, or NULL
+ * @return The block to run
+ */
+block_t* nextBlock(machine_t* m, block_t* prev);
+
+/**
+ * Invalidates every cached block holding code at the address.
+ * @param m The machine
+ * @param addr The address written to
+ */
+void invalidateCode(machine_t* m, uint16_t addr);
+
+/**
+ * Invalidates every cached block holding code in the page.
+ * @param m The machine
+ * @param page The page
+ */
+void invalidatePage(machine_t* m, uint8_t page);
+
+#endif
@@ -4,6 +4,9 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "m80.h"
+#include "instr.h"
+
 typedef enum {
 	FETCH_STAGE,
 	DECODE_STAGE,
@@ -16,7 +19,16 @@ typedef enum {
 	MINUS_OP,
 	OR_OP,
 	XOR_OP,
-	AND_OP
+	AND_OP,
+	PLUS_CY_OP, // Addition with the carry flag as carry in
+	MINUS_CY_OP, // Subtraction with the carry flag as borrow in
+	INC_OP, // Increment, carry flag left as is
+	DEC_OP, // Decrement, carry flag left as is
+	RLC_OP,
+	RRC_OP,
+	RAL_OP,
+	RAR_OP,
+	DAA_OP
 } alu_op_t;
 
 typedef struct ctrlSigs {
@@ -46,6 +58,66 @@ typedef struct state {
 } state_t;
 
 
-void fetch();
+void fetch(machine_t* m);
+
+/**
+ * Decodes the instruction in the instruction register, reading in any data bytes
+ * following the PC into registers W and Z.
+ * @param m The machine
+ * @param insn The decoded instruction
+ */
+void decode(machine_t* m, insn_t* insn);
+
+/**
+ * Gets the number of memory and I/O machine cycles the instruction takes, each of which
+ * waits while READY is held low. Conditional calls and returns are counted as not taken.
+ * @param insn The decoded instruction, not fused
+ * @return The number of machine cycles on the bus
+ */
+uint8_t busCycles(const insn_t* insn);
+
+/**
+ * Decodes the instruction at the given address straight out of memory, without
+ * going through the processor or the bus. Code off the memory pages decodes to OP_ADR.
+ * @param m The machine
+ * @param addr The address of the instruction
+ * @param insn The decoded instruction
+ * @return The address following the instruction
+ */
+uint16_t decodeAt(machine_t* m, uint16_t addr, insn_t* insn);
+
+/**
+ * Fuses the instruction following `first` into it, if the pair is one with its
+ * own operation. The fused instruction takes the size and T-states of both.
+ * @param first The first instruction, replaced by the fused pair
+ * @param second The instruction following it
+ * @return Whether the pair was fused
+ */
+bool fuseInsns(insn_t* first, const insn_t* second);
+
+/**
+ * Splits a fused instruction back into the pair it was made of.
+ * @param insn The instruction
+ * @param parts The instructions it is made of, just itself when it is not fused
+ * @return The number of instructions, 1 or 2
+ */
+int unfuseInsn(const insn_t* insn, insn_t parts[2]);
+
+/**
+ * Executes the decoded instruction, first advancing the PC past it.
+ * @param m The machine
+ * @param insn The decoded instruction
+ */
+void execute(machine_t* m, const insn_t* insn);
+
+/**
+ * Executes a run of decoded instructions back to back, stopping early should `*valid`
+ * be cleared (their code was written over).
+ * @param m The machine
+ * @param insns The decoded instructions
+ * @param count The number of instructions
+ * @param valid Whether the instructions still match memory
+ */
+void executeBlock(machine_t* m, const insn_t* insns, int count, const bool* valid);
 
 #endif
\ No newline at end of file
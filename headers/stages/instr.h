@@ -1,43 +1,112 @@
 #ifndef _INSTR_H_
 #define _INSTR_H_
 
-
+#include <stdint.h>
 
 
 /**
  * Flag Word:
  * [S Z 0 AC 0 P 1 CY]
- * 
+ *
  * S: Sign
  * 	Set if the most significant bit of the result of the operation is 1
- * 
+ *
  * Z: Zero
  * 	Set when the result of an instruction is 0
- * 
+ *
  * AC: Auxiliary Carry
  * 	Set when an instruction caused a carry out of bit 3 into bit 4
  *  of the resulting value
- * 
+ *
  * P: Parity
  * 	Set if the modulo 2 sum of the bits of the result of the operation is 0
- * 
+ *
  * CY: Carry
  * 	Set if an instruction resulted in a carry (from addition) or a borrow
  * 	(from subtraction or a comparison)
  */
 #define PACK_EFLAGS(Z,S,P,CY,AC) ((S<<7)|(Z<<6)|(0<<5)|(AC<<4)|(0<<3)|(P<<2)|(1<<1)|(CY<<0))
-#define GET_S(eflags) ((eflags>>7) & 0x1)
-#define GET_Z(efalgs) ((eflags>>6) & 0x1)
-#define GET_AC(eflags) ((eflags>>4) & 0x1)
-#define GET_P(eflags) ((eflags>>2) & 0x1)
-#define GET_CY(eflags) ((eflags>>0) & 0x1)
+// The flags are evaluated lazily, see getEflags() and the flag accessors in hardware.h
 
+// The operation an opcode decodes to, operands are taken from the opcode bits
 typedef enum {
-	OP_NOP
+	OP_NOP,
+	OP_LXI,
+	OP_STAX,
+	OP_INX,
+	OP_INR,
+	OP_DCR,
+	OP_MVI,
+	OP_RLC,
+	OP_RRC,
+	OP_RAL,
+	OP_RAR,
+	OP_DAD,
+	OP_LDAX,
+	OP_DCX,
+	OP_SHLD,
+	OP_LHLD,
+	OP_DAA,
+	OP_CMA,
+	OP_STA,
+	OP_LDA,
+	OP_STC,
+	OP_CMC,
+	OP_MOV,
+	OP_HLT,
+	OP_ADD,
+	OP_ADC,
+	OP_SUB,
+	OP_SBB,
+	OP_ANA,
+	OP_XRA,
+	OP_ORA,
+	OP_CMP,
+	OP_RCC, // Conditional return
+	OP_POP,
+	OP_JCC, // Conditional jump
+	OP_JMP,
+	OP_CCC, // Conditional call
+	OP_PUSH,
+	OP_ADI,
+	OP_ACI,
+	OP_SUI,
+	OP_SBI,
+	OP_ANI,
+	OP_XRI,
+	OP_ORI,
+	OP_CPI,
+	OP_RST,
+	OP_RET,
+	OP_CALL,
+	OP_OUT,
+	OP_IN,
+	OP_XTHL,
+	OP_PCHL,
+	OP_XCHG,
+	OP_DI,
+	OP_SPHL,
+	OP_EI,
+	OP_ADR, // Code that cannot be fetched, as it is on a page that is not memory
+
+	// Pairs fused into one instruction when decoding blocks, see fuseInsns()
+	OP_DCR_JNZ, // DCR r; JNZ addr
+	OP_MOV_INX, // MOV A,M; INX H
+	OP_LDAX_STAX, // LDAX rp; STAX rp
+	OP_MVI_MVI, // MVI r,d8; MVI r,d8
+	NUM_OPS
 } opcode_t;
 
+// The condition field (bits 3-5) of the conditional jumps, calls, and returns
 typedef enum {
-	C_EQ
+	C_NZ,
+	C_Z,
+	C_NC,
+	C_C,
+	C_PO,
+	C_PE,
+	C_P,
+	C_M
 } cond_t;
 
 typedef enum {
@@ -47,5 +116,23 @@ typedef enum {
 	STAT_INS
 } stat_t;
 
+// Decoding information for a single opcode
+typedef struct insnInfo {
+	opcode_t op; // The operation
+	uint8_t size; // Total size of the instruction in bytes (1-3)
+	uint8_t tstates; // T-states taken, for conditional calls and returns this is when the condition is not met
+} insn_info_t;
+
+// A decoded instruction
+typedef struct insn {
+	opcode_t op; // The operation
+	uint8_t opcode; // The first byte, holding any register, pair, or condition fields
+	uint8_t size; // Total size of the instruction in bytes (1-3)
+	uint8_t tstates; // T-states taken
+	uint8_t opcode2; // The first byte of the second instruction of a fused pair
+	uint8_t tstates2; // T-states taken by the second instruction of a fused pair
+	uint16_t data; // The data bytes, byte 2 as the low byte and byte 3 as the high byte
+} insn_t;
+
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,54 @@
+#ifndef _JIT_H_
+#define _JIT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "blockcache.h"
+
+// Times a block is ran by the interpreter before it is translated to host code
+#ifndef JIT_THRESHOLD
+#define JIT_THRESHOLD 64
+#endif
+
+#define JIT_BUFFER_SIZE (4 * 1024 * 1024) // Executable memory for translated blocks
+#define JIT_MAX_BLOCK_CODE 16384 // Most host code a single block can translate to
+#define JIT_LOOP_BUDGET 1024 // Passes a block looping on itself makes before going back to the run loop
+
+// Executable memory translated blocks are placed in, handed out in order
+// and only reclaimed when the whole block cache is flushed
+typedef struct jitBuffer {
+	uint8_t* code;
+	size_t size;
+	size_t used;
+} jit_buf_t;
+
+
+/**
+ * Maps the executable memory for the translator.
+ * @param m The machine
+ * @return Whether the host supports translation and the memory could be mapped
+ */
+bool initJIT(machine_t* m);
+
+/**
+ * Unmaps the translator's executable memory, if it was mapped.
+ */
+void freeJIT(machine_t* m);
+
+/**
+ * Drops every translated block, called whenever the block cache is flushed.
+ */
+void flushJIT(machine_t* m);
+
+/**
+ * Runs the block, through its host code once it has become hot. Only the leading
+ * instructions the translator supports run as host code, the rest are interpreted.
+ * @param m The machine
+ * @param blk The block to run
+ * @return Whether the block was ran, false when it is left to the interpreter
+ */
+bool runJIT(machine_t* m, block_t* blk);
+
+#endif
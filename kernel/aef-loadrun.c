@@ -5,14 +5,17 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 
 #include "aef-loadrun.h"
 #include "mem.h"
 #include "machine.h"
 #include "aef.h"
-#include "Error.h"
+#include "snapshot.h"
+#include "console.h"
+#include "idle.h"
+#include "pace.h"
 
-extern machine_t guest;
 
 static bool isAEF(aef_hdr* header) {
 	uint8_t aefMagic[4] = { AEF_MAGIC0, AEF_MAGIC1, AEF_MAGIC2, AEF_MAGIC3 };
@@ -24,74 +27,189 @@ static bool isAEF(aef_hdr* header) {
 	return true;
 }
 
-uint16_t loadAEF(const char* filename) {
-	printf("Loading AEF executable\n");
-
+int loadAEF(machine_t* m, const char* filename, uint16_t* entry) {
 	int fd = open(filename, O_RDONLY);
 	if (fd == -1) {
-		perror(NULL);
-		exit(-1);
+		perror(filename);
+		return -1;
 	}
 
 	struct stat statbuff;
 	int rc = fstat(fd, &statbuff);
 	if (rc != 0) {
-		perror(NULL);
-		exit(-1);
+		perror(filename);
+		close(fd);
+		return -1;
+	}
+
+	// The header, followed by the 2 byte size
+	if (statbuff.st_size < (off_t) (sizeof(aef_hdr) + 2)) {
+		fprintf(stderr, "%s: File is not AEF executable!\n", filename);
+		close(fd);
+		return -1;
 	}
 
 	void* ptr = mmap(0, statbuff.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
 	if (ptr == MAP_FAILED) {
-		perror(NULL);
-		exit(-1);
+		perror(filename);
+		return -1;
 	}
 
 	aef_hdr* header = (aef_hdr*) ptr;
-	if (!isAEF(header)) {
-		handleError(ERR_AEF, FATAL, "File is not AEF executable!\n");
-	}
-	u_int16_t entry = header->entry;
-
 	uint8_t* data = ((uint8_t*) header) + 10;
 	// Size is at offset 10 from beginning
-	uint16_t size = *data;
+	uint16_t size = data[0] | (data[1] << 8);
 	// The beginning of the program
 	data += 2;
 
+	if (!isAEF(header) || sizeof(aef_hdr) + 2 + size > statbuff.st_size) {
+		fprintf(stderr, "%s: File is not AEF executable!\n", filename);
+		munmap(ptr, statbuff.st_size);
+		return -1;
+	}
+	*entry = header->entry;
+
 	for (int i = 0; i < size; i++) {
 		uint8_t byte = data[i];
 		// printf("Loading byte 0x%x at 0x%x\n", byte, i);
-		guest.mem->ram[i] = byte;
+		m->mem->backing[i >> MEM_PAGE_SHIFT][i & (MEM_PAGE_SIZE - 1)] = byte;
+	}
+	for (int page = 0; page < (size + MEM_PAGE_SIZE - 1) >> MEM_PAGE_SHIFT; page++) {
+		m->mem->dirty[page] = DIRTY_ALL;
+		updatePage(m->mem, page);
 	}
 
-	return entry;
+	munmap(ptr, statbuff.st_size);
+
+	return 0;
 }
 
-int runAEF(const uint16_t entry) {
-	printf("Running AEF executable\n");
+int runAEF(machine_t* m, const uint16_t entry) {
+	m->proc->PC = entry;
+	m->proc->SP = m->mem->segStart[STACK_SEG] + STACK_SIZE;
 	
-	guest.proc->PC = entry;
-	guest.proc->SP = guest.mem->segStart[STACK_SEG] + STACK_SIZE;
-	
-	// printf("PC: 0x%x\n", guest.proc->PC);
+	// printf("PC: 0x%x\n", m->proc->PC);
+
+	State(m).ctrSigs.DBIN = false;
+	State(m).ctrSigs.HLDA = false;
+	State(m).ctrSigs.INTE = false;
+	State(m).ctrSigs.WAIT = false;
+	State(m).ctrSigs._WR = false;
 
-	State.ctrSigs.DBIN = false;
-	State.ctrSigs.HLDA = false;
-	State.ctrSigs.INTE = false;
-	State.ctrSigs.WAIT = false;
-	State.ctrSigs._WR = false;
+	// State(m).statusSigs.
 
-	// State.statusSigs.
+	return resumeAEF(m);
+}
+
+// Does whatever is due outside the processor, then works out when the next thing is
+static void runEvents(machine_t* m) {
+	uint64_t now = m->proc->cycles;
+
+	if (m->checkpoint && now >= m->checkpoint->next) checkpoint(m);
+	runTimers(m);
+	if (m->console && now >= m->console->flushAt) flushConsole(m->console);
+	if (m->idle->count && now >= m->idle->pollAt) pollWatched(m);
+	if (m->pace && now >= m->pace->next) pace(m);
+
+	// Interrupts are taken between instructions, though not straight after an EI, a halt waits to take them
+	if (m->intr->pending && now != m->intr->enabledAt && m->proc->status == STAT_OK) takeInterrupt(m);
+
+	m->nextEvent = nextTimer(m->timers);
+	if (m->checkpoint && m->checkpoint->next < m->nextEvent) m->nextEvent = m->checkpoint->next;
+	if (m->console && m->console->flushAt < m->nextEvent) m->nextEvent = m->console->flushAt;
+	if (m->idle->count && m->idle->pollAt < m->nextEvent) m->nextEvent = m->idle->pollAt;
+	if (m->pace && m->pace->next < m->nextEvent) m->nextEvent = m->pace->next;
+	if (m->intr->pending) m->nextEvent = m->proc->cycles + 1;
+}
 
-	do {
-		fetch();
+// Parks a halted processor until an interrupt is pending, sleeping on the watched files rather than running
+// anything, then brings it out of its halt for the run loop to take the interrupt. Returns false if none could ever come.
+static bool halt(machine_t* m) {
+	// Only an interrupt ends a halt
+	if (!State(m).ctrSigs.INTE) return false;
 
-		// printf("Fetched instruction: 0x%x\n", guest.proc->IR);
+	// Nothing more is written while halted, so what was is shown now rather than at its deadline
+	if (m->console) flushConsole(m->console);
 
-		// decode();
-		// execute();
-		break;
-	} while (!State.ctrSigs.WAIT);
-		
-	return 0;
-}
\ No newline at end of file
+	// Time moves on while halted, to the device timers or as the clock goes, bringing events due
+	while (!m->intr->pending) {
+		// With nothing left that could interrupt, the program is done
+		if (waitWatched(m) < 0) return false;
+		if (m->proc->cycles >= m->nextEvent) runEvents(m);
+	}
+
+	m->proc->status = STAT_OK;
+	State(m).statusSigs.HLTA = false;
+
+	// The interrupt is taken before the instruction after the HLT, which it returns to
+	runEvents(m);
+
+	return true;
+}
+
+static void runProgram(machine_t* m) {
+	// Profiling steps one instruction at a time, so pairs are counted as in memory rather than as fused
+	if (m->mode == CYCLE_MODE || m->profile) {
+		insn_t insn;
+
+		while (m->proc->status == STAT_OK) {
+			fetch(m);
+			if (m->proc->status != STAT_OK) break;
+
+			// printf("Fetched instruction: 0x%x\n", m->proc->IR);
+
+			decode(m, &insn);
+			if (m->proc->status != STAT_OK) break;
+			if (m->profile) countPair(m->profile, insn.opcode);
+			execute(m, &insn);
+
+			if (m->proc->cycles >= m->nextEvent) runEvents(m);
+		}
+	} else {
+		// Fast mode runs decoded blocks out of the block cache
+		block_t* blk = NULL;
+		spin_t spin = { .countdown = SPIN_SAMPLE };
+		initBlocks(m);
+
+		while (m->proc->status == STAT_OK) {
+			// Blocks run without looking at anything else until the next event is due, devices bring it forward
+			while (m->proc->status == STAT_OK && m->proc->cycles < m->nextEvent) {
+				blk = nextBlock(m, blk);
+				uint16_t start = blk->start;
+				spin.quiet = spin.quiet && blk->quiet;
+
+				if (!m->jit || !runJIT(m, blk)) executeBlock(m, blk->insns, blk->count, &blk->valid);
+
+				// Loops start over by branching back, polling loops need not run pass after pass
+				if (m->proc->PC <= start && m->proc->status == STAT_OK && spinning(m, &spin)) skipSpin(m, &spin);
+			}
+
+			// Events can change anything
+			runEvents(m);
+			spin.quiet = false;
+		}
+	}
+}
+
+int resumeAEF(machine_t* m) {
+	// Whatever is due is worked out before the first instruction
+	m->nextEvent = 0;
+	updateInterrupts(m);
+
+	// Time spent stopped is not made up for
+	if (m->pace) startPace(m);
+
+	// A halted processor waits for an interrupt to carry on
+	do runProgram(m);
+	while (m->proc->status == STAT_HLT && halt(m));
+
+	// Output the program left behind is shown before anything the host prints after
+	if (m->console) flushConsole(m->console);
+
+	// The state the run stopped in is kept too
+	if (m->checkpoint) checkpoint(m);
+
+	// Halting is the normal way for a program to finish
+	return (m->proc->status == STAT_HLT) ? 0 : m->proc->status;
+}
@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "bank.h"
+#include "machine.h"
+#include "mem.h"
+
+
+/**
+ * Gets where the window's bank is in extended memory, NULL for bank 0.
+ */
+static uint8_t* bankHost(banks_t* banks, int window, int bank) {
+	if (bank == 0) return NULL;
+
+	size_t index = (size_t) window * (banks->count - 1) + bank - 1;
+	return banks->m->mem->ext + ((index * banks->pages) << MEM_PAGE_SHIFT);
+}
+
+static uint8_t bankIn(void* ctx, uint8_t port) {
+	banks_t* banks = (banks_t*) ctx;
+
+	return banks->windows[port - banks->port].bank;
+}
+
+void switchBank(machine_t* m, int window, uint8_t bank) {
+	banks_t* banks = m->banks;
+	bank_window_t* w = &banks->windows[window];
+
+	// There is nothing to switch to past the last bank
+	if (bank >= banks->count || bank == w->bank) return;
+
+	w->bank = bank;
+	mapBacking(m, w->first, banks->pages, bankHost(banks, window, bank));
+}
+
+static void bankOut(void* ctx, uint8_t port, uint8_t data) {
+	banks_t* banks = (banks_t*) ctx;
+
+	switchBank(banks->m, port - banks->port, data);
+}
+
+/**
+ * Attaches the bank registers' ports.
+ */
+static void attachPorts(machine_t* m, banks_t* banks) {
+	for (int i = 0; i < banks->numWindows; i++) attachPort(m->ports, banks->port + i, bankIn, bankOut, banks);
+}
+
+int attachBanks(machine_t* m, uint8_t port, const uint16_t* windows, int numWindows, uint32_t size, int count) {
+	int pages = size >> MEM_PAGE_SHIFT;
+
+	if (numWindows < 1 || numWindows > MAX_WINDOWS || count < 2 || count > MAX_BANKS ||
+			pages == 0 || size % MEM_PAGE_SIZE != 0 || size > MAX_ADDR + 1) {
+		fprintf(stderr, "Banks do not fit in the address space!\n");
+		return -1;
+	}
+
+	// Windows are whole pages and apart from each other
+	for (int i = 0; i < numWindows; i++) {
+		bool fits = windows[i] % MEM_PAGE_SIZE == 0 && windows[i] + size <= MAX_ADDR + 1;
+		for (int j = 0; j < i; j++) {
+			if (windows[i] < windows[j] + size && windows[j] < windows[i] + size) fits = false;
+		}
+
+		if (!fits) {
+			fprintf(stderr, "Bank window at 0x%04x does not fit in the address space!\n", windows[i]);
+			return -1;
+		}
+	}
+
+	if (initExtMem(m->mem, (size_t) numWindows * (count - 1) * size) != 0) {
+		fprintf(stderr, "Could not map memory for the banks\n");
+		return -1;
+	}
+
+	banks_t* banks = (banks_t*) malloc(sizeof(banks_t));
+	banks->m = m;
+	banks->port = port;
+	banks->pages = pages;
+	banks->count = count;
+	banks->numWindows = numWindows;
+	for (int i = 0; i < numWindows; i++) {
+		banks->windows[i].first = windows[i] >> MEM_PAGE_SHIFT;
+		banks->windows[i].bank = 0;
+	}
+
+	m->banks = banks;
+	attachPorts(m, banks);
+
+	return 0;
+}
+
+void resetBanks(machine_t* m) {
+	banks_t* banks = m->banks;
+
+	for (int i = 0; i < banks->numWindows; i++) switchBank(m, i, 0);
+
+	clearExtMem(m->mem);
+}
+
+void forkBanks(machine_t* child, machine_t* m) {
+	banks_t* banks = (banks_t*) malloc(sizeof(banks_t));
+	*banks = *m->banks;
+	banks->m = child;
+
+	child->banks = banks;
+	attachPorts(child, banks);
+}
+
+void freeBanks(machine_t* m) {
+	free(m->banks);
+	m->banks = NULL;
+}
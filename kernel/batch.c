@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "batch.h"
+#include "machine.h"
+
+// A program to run and how it went
+typedef struct job {
+	char* path;
+	bool ran; // Whether a worker got to it at all
+	int loaded; // 0 once loaded, -1 if the file could not be loaded
+	stat_t status;
+	int ret;
+	uint64_t cycles;
+	uint64_t wallUs;
+} job_t;
+
+// The jobs a worker has left, indices [head, tail) of the job list. The owner takes jobs
+// off the head while other workers steal from the tail, so each only ever runs a job once.
+typedef struct jobQueue {
+	pthread_mutex_t lock;
+	int head;
+	int tail;
+} job_queue_t;
+
+typedef struct batch {
+	job_t* jobs;
+	int count;
+	job_queue_t* queues;
+	const batch_opts_t* opts;
+} batch_t;
+
+typedef struct worker {
+	batch_t* batch;
+	int id;
+	pthread_t thread;
+} worker_t;
+
+
+static int takeJob(job_queue_t* queue) {
+	int job = -1;
+
+	pthread_mutex_lock(&queue->lock);
+	if (queue->head < queue->tail) job = queue->head++;
+	pthread_mutex_unlock(&queue->lock);
+
+	return job;
+}
+
+/**
+ * Moves the back half of another worker's jobs over to the worker's own queue.
+ * @return Whether any jobs were stolen
+ */
+static bool stealJobs(batch_t* batch, int id) {
+	int workers = batch->opts->workers;
+
+	for (int i = 1; i < workers; i++) {
+		job_queue_t* victim = &batch->queues[(id + i) % workers];
+
+		pthread_mutex_lock(&victim->lock);
+		int left = victim->tail - victim->head;
+		int take = (left + 1) / 2;
+		victim->tail -= take;
+		int from = victim->tail;
+		pthread_mutex_unlock(&victim->lock);
+
+		if (take == 0) continue;
+
+		// Only the owner ever adds to its queue, and only once it is empty
+		job_queue_t* own = &batch->queues[id];
+		pthread_mutex_lock(&own->lock);
+		own->head = from;
+		own->tail = from + take;
+		pthread_mutex_unlock(&own->lock);
+
+		return true;
+	}
+
+	return false;
+}
+
+static uint64_t nowUs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void runJob(machine_t* m, job_t* job) {
+	uint64_t start = nowUs();
+
+	// The machine is reused from job to job, so nothing is allocated per program
+	m80_reset(m);
+
+	uint16_t entry;
+	job->ran = true;
+	job->loaded = m80_load(m, job->path, &entry);
+	if (job->loaded == 0) {
+		job->ret = m80_run(m, entry);
+		job->status = m->proc->status;
+		job->cycles = m->proc->cycles;
+	}
+
+	job->wallUs = nowUs() - start;
+}
+
+static void* work(void* arg) {
+	worker_t* worker = (worker_t*) arg;
+	batch_t* batch = worker->batch;
+
+	// The other workers take over the jobs of one that cannot get a machine
+	machine_t* m = m80_create();
+	if (!m) return NULL;
+	m->mode = batch->opts->mode;
+	m->waitStates = batch->opts->waitStates;
+	if (batch->opts->jit && m->mode == FAST_MODE) initJIT(m);
+
+	for (;;) {
+		int job = takeJob(&batch->queues[worker->id]);
+		if (job == -1) {
+			if (!stealJobs(batch, worker->id)) break;
+			continue;
+		}
+
+		runJob(m, &batch->jobs[job]);
+	}
+
+	m80_destroy(m);
+
+	return NULL;
+}
+
+/**
+ * Reads the paths out of the manifest.
+ * @return The number of jobs, or -1 if the manifest could not be read
+ */
+static int readManifest(const char* manifest, job_t** jobs) {
+	FILE* file = fopen(manifest, "r");
+	if (!file) {
+		perror(manifest);
+		return -1;
+	}
+
+	int count = 0;
+	int cap = 64;
+	*jobs = (job_t*) malloc(sizeof(job_t) * cap);
+
+	char line[BATCH_MAX_PATH];
+	while (fgets(line, sizeof(line), file)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] == '\0' || line[0] == '#') continue;
+
+		if (count == cap) {
+			cap *= 2;
+			*jobs = (job_t*) realloc(*jobs, sizeof(job_t) * cap);
+		}
+
+		// Not run until a worker says otherwise, so one left behind is never taken as having halted
+		job_t* job = &(*jobs)[count++];
+		memset(job, 0, sizeof(job_t));
+		job->path = strdup(line);
+		job->ran = false;
+		job->loaded = -1;
+		job->ret = -1;
+	}
+
+	fclose(file);
+
+	return count;
+}
+
+int runBatch(const char* manifest, const batch_opts_t* opts) {
+	static const char* statnames[] = { "OK", "HLT", "ADR", "INS" };
+
+	batch_t batch;
+	batch.opts = opts;
+	batch.count = readManifest(manifest, &batch.jobs);
+	if (batch.count == -1) return -1;
+
+	int workers = opts->workers;
+
+	// Each worker starts with an even share, in order, of the jobs
+	batch.queues = (job_queue_t*) malloc(sizeof(job_queue_t) * workers);
+	for (int i = 0; i < workers; i++) {
+		pthread_mutex_init(&batch.queues[i].lock, NULL);
+		batch.queues[i].head = (int) ((long) batch.count * i / workers);
+		batch.queues[i].tail = (int) ((long) batch.count * (i + 1) / workers);
+	}
+
+	worker_t* pool = (worker_t*) malloc(sizeof(worker_t) * workers);
+	for (int i = 0; i < workers; i++) {
+		pool[i].batch = &batch;
+		pool[i].id = i;
+		pthread_create(&pool[i].thread, NULL, work, &pool[i]);
+	}
+	for (int i = 0; i < workers; i++) pthread_join(pool[i].thread, NULL);
+
+	int skipped = 0;
+	for (int i = 0; i < batch.count; i++) skipped += !batch.jobs[i].ran;
+	if (skipped) fprintf(stderr, "%d of %d programs were never run, no worker could get a machine\n", skipped, batch.count);
+
+	int rc = 0;
+
+	printf("path\tstatus\texit\tcycles\twall_us\n");
+	for (int i = 0; i < batch.count; i++) {
+		job_t* job = &batch.jobs[i];
+
+		if (!job->ran) {
+			printf("%s\tNORUN\t-1\t0\t0\n", job->path);
+			rc = 1;
+		} else if (job->loaded != 0) {
+			printf("%s\tLOAD\t-1\t0\t%llu\n", job->path, (unsigned long long) job->wallUs);
+			rc = 1;
+		} else {
+			printf("%s\t%s\t%d\t%llu\t%llu\n", job->path, statnames[job->status], job->ret,
+				(unsigned long long) job->cycles, (unsigned long long) job->wallUs);
+			if (job->ret != 0) rc = 1;
+		}
+
+		free(job->path);
+	}
+
+	for (int i = 0; i < workers; i++) pthread_mutex_destroy(&batch.queues[i].lock);
+	free(batch.queues);
+	free(pool);
+	free(batch.jobs);
+
+	return rc;
+}
@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "console.h"
+#include "machine.h"
+#include "idle.h"
+
+
+#define RING_MASK (CONSOLE_BUF_SIZE - 1)
+
+
+static size_t ringLen(const ring_t* ring) {
+	return ring->tail - ring->head;
+}
+
+/**
+ * Gets the ring's bytes from the index on as at most two runs, the second from the start of the buffer.
+ * @return The number of runs
+ */
+static int ringRuns(ring_t* ring, size_t from, size_t len, struct iovec runs[2]) {
+	size_t start = from & RING_MASK;
+	size_t first = CONSOLE_BUF_SIZE - start;
+	if (first > len) first = len;
+
+	runs[0].iov_base = ring->buf + start;
+	runs[0].iov_len = first;
+	runs[1].iov_base = ring->buf;
+	runs[1].iov_len = len - first;
+
+	return (len > first) ? 2 : 1;
+}
+
+void flushConsole(console_t* console) {
+	ring_t* tx = &console->tx;
+
+	while (ringLen(tx) > 0) {
+		struct iovec runs[2];
+		int n = ringRuns(tx, tx->head, ringLen(tx), runs);
+
+		ssize_t written = writev(console->out, runs, n);
+		if (written == -1 && errno == EINTR) continue;
+		// Output that cannot be written is dropped, rather than stopping the guest
+		if (written <= 0) break;
+
+		tx->head += written;
+	}
+
+	tx->head = tx->tail;
+	console->flushAt = UINT64_MAX;
+}
+
+static void inputReady(void* ctx, int fd);
+
+/**
+ * Raises the interrupt while input is waiting, if the guest wants it, and watches for input
+ * while halted when there is room for it.
+ */
+static void updateConsole(console_t* console) {
+	machine_t* m = console->m;
+	bool waiting = ringLen(&console->rx) > 0;
+
+	if (console->rxInt) {
+		if (waiting) raiseIrq(m, CONSOLE_IRQ);
+		else lowerIrq(m, CONSOLE_IRQ);
+	}
+
+	bool watch = (console->rxInt || console->polling) && !console->eof && ringLen(&console->rx) < CONSOLE_BUF_SIZE;
+	if (watch == console->watching) return;
+
+	if (watch) {
+		console->watching = watchFd(m, console->in, inputReady, console) == 0;
+	} else {
+		unwatchFd(m, console->in);
+		console->watching = false;
+	}
+}
+
+/**
+ * Reads what input fits, without waiting for any.
+ */
+static void readInput(console_t* console) {
+	ring_t* rx = &console->rx;
+
+	struct iovec runs[2];
+	int n = ringRuns(rx, rx->tail, CONSOLE_BUF_SIZE - ringLen(rx), runs);
+
+	ssize_t got = readv(console->in, runs, n);
+	if (got > 0) rx->tail += got;
+	else if (got == 0 || errno != EINTR) console->eof = true;
+
+	updateConsole(console);
+}
+
+// Input has come in without the guest asking for it
+static void inputReady(void* ctx, int fd) {
+	readInput((console_t*) ctx);
+}
+
+/**
+ * Reads whatever input the host has ready, without waiting for any.
+ */
+static void readAhead(console_t* console) {
+	ring_t* rx = &console->rx;
+	uint64_t now = console->m->proc->cycles;
+
+	if (console->eof || ringLen(rx) > 0 || now < console->pollAt) return;
+	console->pollAt = now + CONSOLE_POLL_TSTATES;
+
+	struct pollfd pfd = { console->in, POLLIN, 0 };
+	if (poll(&pfd, 1, 0) == 1) readInput(console);
+}
+
+static void statusOut(void* ctx, uint8_t port, uint8_t data) {
+	console_t* console = (console_t*) ctx;
+
+	bool rxInt = data & CONSOLE_RX_INT;
+	if (console->rxInt && !rxInt) lowerIrq(console->m, CONSOLE_IRQ);
+
+	console->rxInt = rxInt;
+	updateConsole(console);
+}
+
+static uint8_t statusIn(void* ctx, uint8_t port) {
+	console_t* console = (console_t*) ctx;
+
+	// Whatever the guest is waiting on input for is shown first
+	flushConsole(console);
+	readAhead(console);
+
+	bool waiting = ringLen(&console->rx) > 0;
+	if (console->polling == waiting) {
+		console->polling = !waiting;
+		updateConsole(console);
+	}
+
+	return CONSOLE_TX_READY | (waiting ? CONSOLE_RX_READY : 0);
+}
+
+static uint8_t dataIn(void* ctx, uint8_t port) {
+	console_t* console = (console_t*) ctx;
+	ring_t* rx = &console->rx;
+
+	flushConsole(console);
+	readAhead(console);
+
+	console->polling = ringLen(rx) == 0;
+
+	// Nothing drives the data bus without a character
+	if (console->polling) {
+		updateConsole(console);
+		return 0xFF;
+	}
+
+	uint8_t data = rx->buf[rx->head++ & RING_MASK];
+	updateConsole(console);
+
+	return data;
+}
+
+static void dataOut(void* ctx, uint8_t port, uint8_t data) {
+	console_t* console = (console_t*) ctx;
+	ring_t* tx = &console->tx;
+
+	tx->buf[tx->tail++ & RING_MASK] = data;
+
+	if (data == '\n' || ringLen(tx) == CONSOLE_BUF_SIZE) flushConsole(console);
+	else if (console->flushAt == UINT64_MAX) {
+		// The run loop writes out what is left by the deadline
+		console->flushAt = console->m->proc->cycles + CONSOLE_FLUSH_TSTATES;
+		if (console->flushAt < console->m->nextEvent) console->m->nextEvent = console->flushAt;
+	}
+}
+
+static void attachPorts(machine_t* m, console_t* console) {
+	attachPort(m->ports, CONSOLE_STATUS_PORT, statusIn, statusOut, console);
+	attachPort(m->ports, CONSOLE_DATA_PORT, dataIn, dataOut, console);
+}
+
+void attachConsole(machine_t* m, int in, int out) {
+	freeConsole(m);
+
+	console_t* console = (console_t*) malloc(sizeof(console_t));
+	console->m = m;
+	console->in = in;
+	console->out = out;
+	console->eof = false;
+	console->rxInt = false;
+	console->polling = false;
+	console->watching = false;
+	console->rx.head = console->rx.tail = 0;
+	console->tx.head = console->tx.tail = 0;
+	console->flushAt = UINT64_MAX;
+	console->pollAt = 0;
+
+	m->console = console;
+	attachPorts(m, console);
+}
+
+void forkConsole(machine_t* child, machine_t* m) {
+	// What the parent has written goes out first, so it is neither lost nor written twice
+	flushConsole(m->console);
+
+	console_t* console = (console_t*) malloc(sizeof(console_t));
+	*console = *m->console;
+	console->m = child;
+
+	// The fork watches for input on its own, as its guest needs it
+	console->watching = false;
+
+	child->console = console;
+	attachPorts(child, console);
+}
+
+void freeConsole(machine_t* m) {
+	if (!m->console) return;
+
+	flushConsole(m->console);
+	if (m->console->watching) unwatchFd(m, m->console->in);
+	free(m->console);
+	m->console = NULL;
+}
@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "disk.h"
+#include "machine.h"
+#include "mem.h"
+
+
+#define DISK_MAX_SECTORS 65536 // As many as the sector registers can number
+
+
+// The command finished
+static void done(void* ctx, uint64_t at) {
+	disk_t* disk = (disk_t*) ctx;
+
+	disk->status &= ~DISK_BUSY;
+	if (disk->interrupt) {
+		raiseIrq(disk->m, DISK_IRQ);
+		disk->interrupting = true;
+	}
+}
+
+/**
+ * Moves the sectors between the image and memory in one go, rather than a byte for each OUT
+ * or IN. Nothing is moved if they run off the end of the disk.
+ * @return The bytes moved, or -1 if the transfer failed
+ */
+static int64_t transfer(disk_t* disk, bool write) {
+	machine_t* m = disk->m;
+	size_t len = (size_t) disk->count * disk->sectorSize;
+
+	if ((uint32_t) disk->sector + disk->count > disk->sectors || (write && disk->readOnly)) return -1;
+
+	uint8_t* sectors = disk->image + (size_t) disk->sector * disk->sectorSize;
+	int rc = write ? copyFromMem(m, disk->addr, sectors, len) : copyToMem(m, disk->addr, sectors, len);
+
+	// Carries on from past it, as a run of transfers through a file would
+	disk->sector += disk->count;
+	disk->addr += len;
+
+	return (rc == 0) ? (int64_t) len : -1;
+}
+
+static void command(disk_t* disk, uint8_t data) {
+	int64_t len = 0;
+
+	// Commands while one is being done are not taken
+	if (disk->status & DISK_BUSY) return;
+
+	disk->status &= ~DISK_ERROR;
+	disk->interrupt = data & DISK_INT;
+
+	switch (data & ~DISK_INT) {
+		case DISK_READ:
+			len = transfer(disk, false);
+			break;
+		case DISK_WRITE:
+			len = transfer(disk, true);
+			break;
+		case DISK_FLUSH:
+			if (!disk->readOnly && msync(disk->image, disk->size, MS_SYNC) != 0) len = -1;
+			break;
+		default:
+			len = -1;
+	}
+
+	if (len < 0) {
+		disk->status |= DISK_ERROR;
+		len = 0;
+	}
+
+	// The data is in place straight away, the program is told once it would have been
+	disk->status |= DISK_BUSY;
+	setTimer(disk->m, disk->timer, disk->m->proc->cycles + (uint64_t) len * DISK_BYTE_TSTATES);
+}
+
+static uint8_t diskIn(void* ctx, uint8_t port) {
+	disk_t* disk = (disk_t*) ctx;
+
+	switch ((uint8_t) (port - disk->port)) {
+		case 0:
+			// Reading the status acknowledges the interrupt
+			if (disk->interrupting) {
+				lowerIrq(disk->m, DISK_IRQ);
+				disk->interrupting = false;
+			}
+			return disk->status;
+		case DISK_SECTOR_LSB:
+			return disk->sector & 0xFF;
+		case DISK_SECTOR_MSB:
+			return disk->sector >> 8;
+		case DISK_ADDR_LSB:
+			return disk->addr & 0xFF;
+		case DISK_ADDR_MSB:
+			return disk->addr >> 8;
+		default:
+			return disk->count;
+	}
+}
+
+static void diskOut(void* ctx, uint8_t port, uint8_t data) {
+	disk_t* disk = (disk_t*) ctx;
+
+	switch ((uint8_t) (port - disk->port)) {
+		case 0:
+			command(disk, data);
+			break;
+		case DISK_SECTOR_LSB:
+			disk->sector = (disk->sector & 0xFF00) | data;
+			break;
+		case DISK_SECTOR_MSB:
+			disk->sector = (disk->sector & 0x00FF) | (data << 8);
+			break;
+		case DISK_ADDR_LSB:
+			disk->addr = (disk->addr & 0xFF00) | data;
+			break;
+		case DISK_ADDR_MSB:
+			disk->addr = (disk->addr & 0x00FF) | (data << 8);
+			break;
+		default:
+			disk->count = data;
+	}
+}
+
+/**
+ * Attaches the disk's ports.
+ */
+static void attachPorts(machine_t* m, disk_t* disk) {
+	for (int i = 0; i < DISK_PORTS; i++) attachPort(m->ports, disk->port + i, diskIn, diskOut, disk);
+}
+
+/**
+ * Puts the registers back as they are at power on, ready with nothing being done.
+ */
+static void clearDisk(disk_t* disk) {
+	disk->sector = 0;
+	disk->addr = 0;
+	disk->count = 0;
+	disk->status = DISK_READY;
+	disk->interrupting = false;
+	disk->interrupt = false;
+}
+
+int attachDisk(machine_t* m, uint8_t port, const char* path, uint16_t sectorSize) {
+	bool readOnly = false;
+	int fd = open(path, O_RDWR);
+	if (fd == -1) {
+		readOnly = true;
+		fd = open(path, O_RDONLY);
+	}
+	if (fd == -1) {
+		perror(path);
+		return -1;
+	}
+
+	struct stat statbuff;
+	if (fstat(fd, &statbuff) != 0) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	if (statbuff.st_size < sectorSize) {
+		fprintf(stderr, "%s: Image is smaller than a sector!\n", path);
+		close(fd);
+		return -1;
+	}
+
+	// Shared, so what is written goes back to the file without being copied
+	void* image = mmap(NULL, statbuff.st_size, PROT_READ | (readOnly ? 0 : PROT_WRITE), MAP_SHARED, fd, 0);
+	if (image == MAP_FAILED) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+
+	disk_t* disk = (disk_t*) malloc(sizeof(disk_t));
+	disk->m = m;
+	disk->port = port;
+	disk->fd = fd;
+	disk->image = (uint8_t*) image;
+	disk->size = statbuff.st_size;
+	disk->readOnly = readOnly;
+	disk->sectorSize = sectorSize;
+	disk->sectors = statbuff.st_size / sectorSize;
+	if (disk->sectors > DISK_MAX_SECTORS) disk->sectors = DISK_MAX_SECTORS;
+	clearDisk(disk);
+	disk->timer = addTimer(m, done, disk);
+	if (disk->timer == -1) {
+		fprintf(stderr, "%s: Too many timers for the disk!\n", path);
+		munmap(image, disk->size);
+		close(fd);
+		free(disk);
+		return -1;
+	}
+
+	m->disk = disk;
+	attachPorts(m, disk);
+
+	return 0;
+}
+
+void resetDisk(machine_t* m) {
+	clearDisk(m->disk);
+	stopTimer(m, m->disk->timer);
+}
+
+void forkDisk(machine_t* child, machine_t* m) {
+	disk_t* disk = (disk_t*) malloc(sizeof(disk_t));
+	*disk = *m->disk;
+	disk->m = child;
+
+	// Private, so the fork's writes stay out of the file and its parent
+	disk->fd = dup(m->disk->fd);
+	void* image = (disk->fd == -1) ? MAP_FAILED : mmap(NULL, disk->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, disk->fd, 0);
+	if (image == MAP_FAILED) {
+		// Without an image the fork gets empty ports
+		if (disk->fd != -1) close(disk->fd);
+		free(disk);
+		stopTimer(child, m->disk->timer);
+		for (int i = 0; i < DISK_PORTS; i++) attachPort(child->ports, m->disk->port + i, NULL, NULL, NULL);
+		return;
+	}
+	disk->image = (uint8_t*) image;
+
+	// The timer was copied set as it was, it is pointed at the copy
+	moveTimer(child, disk->timer, disk);
+
+	child->disk = disk;
+	attachPorts(child, disk);
+}
+
+void freeDisk(machine_t* m) {
+	disk_t* disk = m->disk;
+	if (!disk) return;
+
+	// A fork's image is private, so this only writes back the parent's
+	msync(disk->image, disk->size, MS_SYNC);
+	munmap(disk->image, disk->size);
+	close(disk->fd);
+
+	free(disk);
+	m->disk = NULL;
+}
@@ -0,0 +1,249 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "dma.h"
+#include "machine.h"
+#include "mem.h"
+
+
+static uint8_t enabled(const dma_t* dma) {
+	return dma->mode & ((1 << DMA_CHANNELS) - 1);
+}
+
+/**
+ * Has the controller take the bus once the processor is between instructions, if a channel
+ * requested is enabled.
+ */
+static void schedule(dma_t* dma) {
+	if (dma->timer != -1 && (dma->requests & enabled(dma))) setTimer(dma->m, dma->timer, dma->m->proc->cycles);
+}
+
+/**
+ * Copies a block from memory to memory as the bytes would be moved one at a time in ascending
+ * order, so a destination just past the source repeats the bytes before it.
+ */
+static void copyBlock(dma_t* dma, uint16_t src, uint16_t dst, uint32_t len) {
+	machine_t* m = dma->m;
+	uint16_t gap = dst - src;
+
+	// Overlapping from above, each run is only read once the run before has been written
+	uint32_t run = (gap && gap < len) ? gap : len;
+
+	while (len > 0) {
+		if (run > len) run = len;
+
+		copyFromMem(m, src, dma->buf, run);
+		copyToMem(m, dst, dma->buf, run);
+
+		src += run;
+		dst += run;
+		len -= run;
+	}
+}
+
+/**
+ * Ends the channel's block, the count having gone past 0.
+ */
+static void terminalCount(dma_t* dma, int c) {
+	dma_channel_t* ch = &dma->channels[c];
+
+	ch->tc |= DMA_COUNT(0xFFFF);
+	dma->status |= 1 << c;
+
+	if (c == 2 && (dma->mode & DMA_AUTOLOAD)) {
+		dma->channels[2].addr = dma->channels[3].addr;
+		dma->channels[2].tc = dma->channels[3].tc;
+	} else if (dma->mode & DMA_TC_STOP) {
+		dma->mode &= ~(1 << c);
+	}
+}
+
+/**
+ * Moves the channel's block in one go, charging the processor for the DMA cycles it was held for.
+ */
+static void transfer(dma_t* dma, int c) {
+	machine_t* m = dma->m;
+	dma_channel_t* ch = &dma->channels[c];
+	uint32_t len = DMA_COUNT(ch->tc) + 1;
+	uint32_t cycles = len;
+
+	if (c == 0 && dma->memToMem) {
+		// A read cycle then a write cycle for each byte
+		copyBlock(dma, ch->addr, dma->channels[1].addr, len);
+		cycles *= 2;
+
+		dma->channels[1].addr += len;
+		terminalCount(dma, 1);
+		dma->memToMem = false;
+	} else {
+		switch (DMA_TRANSFER(ch->tc)) {
+			case DMA_WRITE:
+				if (ch->in) ch->in(ch->ctx, dma->buf, len);
+				else memset(dma->buf, 0xFF, len);
+				copyToMem(m, ch->addr, dma->buf, len);
+				break;
+			case DMA_READ:
+				copyFromMem(m, ch->addr, dma->buf, len);
+				if (ch->out) ch->out(ch->ctx, dma->buf, len);
+				break;
+			default:
+				// Verify cycles only run the cycles
+				break;
+		}
+	}
+
+	// Memory and the device are both slowed by the wait states
+	m->proc->cycles += (uint64_t) cycles * (DMA_CYCLE_TSTATES + m->waitStates);
+
+	ch->addr += len;
+	terminalCount(dma, c);
+}
+
+// The processor granted HOLD, the channels requested are serviced in priority order before it is given back
+static void service(void* ctx, uint64_t at) {
+	dma_t* dma = (dma_t*) ctx;
+	uint8_t ready = dma->requests & enabled(dma);
+	if (!ready) return;
+
+	State(dma->m).ctrSigs.HLDA = true;
+
+	int first = (dma->mode & DMA_ROTATE) ? dma->last + 1 : 0;
+	for (int i = 0; i < DMA_CHANNELS; i++) {
+		int c = (first + i) % DMA_CHANNELS;
+		if (!(ready & (1 << c))) continue;
+
+		dma->requests &= ~(1 << c);
+		transfer(dma, c);
+		dma->last = c;
+	}
+
+	State(dma->m).ctrSigs.HLDA = false;
+}
+
+static uint8_t dmaIn(void* ctx, uint8_t port) {
+	dma_t* dma = (dma_t*) ctx;
+	uint8_t reg = port - dma->port;
+
+	if (reg == DMA_MODE_PORT) {
+		// Terminal counts are cleared once read
+		uint8_t status = dma->status;
+		dma->status &= ~((1 << DMA_CHANNELS) - 1);
+		return status;
+	}
+	if (reg > DMA_MODE_PORT) return 0xFF;
+
+	dma_channel_t* ch = &dma->channels[reg / 2];
+	uint16_t value = (reg & 1) ? ch->tc : ch->addr;
+	bool high = dma->high;
+	dma->high = !dma->high;
+
+	return high ? value >> 8 : value & 0xFF;
+}
+
+static void writeRegister(dma_channel_t* ch, uint8_t reg, bool high, uint8_t data) {
+	uint16_t* value = (reg & 1) ? &ch->tc : &ch->addr;
+
+	if (high) *value = (*value & 0x00FF) | (data << 8);
+	else *value = (*value & 0xFF00) | data;
+}
+
+static void dmaOut(void* ctx, uint8_t port, uint8_t data) {
+	dma_t* dma = (dma_t*) ctx;
+	uint8_t reg = port - dma->port;
+
+	switch (reg) {
+		case DMA_MODE_PORT:
+			dma->mode = data;
+			dma->high = false;
+			break;
+		case DMA_REQUEST_PORT:
+			if (data & DMA_MEM_TO_MEM) {
+				dma->memToMem = true;
+				dma->requests |= 1 << 0;
+			} else if (data & DMA_REQUEST) {
+				dma->requests |= 1 << DMA_REQUEST_CHANNEL(data);
+			} else {
+				dma->requests &= ~(1 << DMA_REQUEST_CHANNEL(data));
+			}
+			break;
+		default:
+			writeRegister(&dma->channels[reg / 2], reg, dma->high, data);
+
+			// Autoloading, channel 2 is written through to channel 3
+			if (reg / 2 == 2 && (dma->mode & DMA_AUTOLOAD)) writeRegister(&dma->channels[3], reg, dma->high, data);
+			dma->high = !dma->high;
+			return;
+	}
+
+	schedule(dma);
+}
+
+/**
+ * Attaches the controller's ports.
+ */
+static void attachPorts(machine_t* m, dma_t* dma) {
+	for (int i = 0; i < DMA_PORTS; i++) attachPort(m->ports, dma->port + i, dmaIn, dmaOut, dma);
+}
+
+void attachDma(machine_t* m, uint8_t port) {
+	dma_t* dma = (dma_t*) calloc(1, sizeof(dma_t));
+	dma->m = m;
+	dma->port = port;
+	dma->last = DMA_CHANNELS - 1;
+	dma->timer = addTimer(m, service, dma);
+
+	m->dma = dma;
+	attachPorts(m, dma);
+}
+
+int attachDmaChannel(machine_t* m, int channel, m80_dma_in_t in, m80_dma_out_t out, void* ctx) {
+	if (!m->dma || channel < 0 || channel >= DMA_CHANNELS) return -1;
+
+	dma_channel_t* ch = &m->dma->channels[channel];
+	ch->in = in;
+	ch->out = out;
+	ch->ctx = ctx;
+
+	return 0;
+}
+
+void requestDma(machine_t* m, int channel) {
+	if (!m->dma || channel < 0 || channel >= DMA_CHANNELS) return;
+
+	m->dma->requests |= 1 << channel;
+	schedule(m->dma);
+}
+
+void resetDma(machine_t* m) {
+	dma_t* dma = m->dma;
+
+	// The devices stay on their channels
+	for (int i = 0; i < DMA_CHANNELS; i++) {
+		dma->channels[i].addr = 0;
+		dma->channels[i].tc = 0;
+	}
+	dma->mode = 0;
+	dma->status = 0;
+	dma->requests = 0;
+	dma->memToMem = false;
+	dma->high = false;
+	dma->last = DMA_CHANNELS - 1;
+	if (dma->timer != -1) stopTimer(m, dma->timer);
+}
+
+void forkDma(machine_t* child, machine_t* m) {
+	dma_t* dma = (dma_t*) malloc(sizeof(dma_t));
+	*dma = *m->dma;
+	dma->m = child;
+
+	// The timer was copied set as it was, it is pointed at the copy
+	if (dma->timer != -1) moveTimer(child, dma->timer, dma);
+
+	child->dma = dma;
+	attachPorts(child, dma);
+}
+
+void freeDma(machine_t* m) {
+	free(m->dma);
+	m->dma = NULL;
+}
@@ -0,0 +1,162 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "idle.h"
+#include "machine.h"
+#include "console.h"
+#include "pace.h"
+
+
+/**
+ * Calls the devices watching the files found ready.
+ */
+static void dispatch(idle_t* idle) {
+	// Going down, anything a device stops watching is swapped for one already seen to
+	for (int i = idle->count - 1; i >= 0; i--) {
+		short revents = idle->fds[i].revents;
+		idle->fds[i].revents = 0;
+
+		if (revents) idle->ready[i](idle->ctx[i], idle->fds[i].fd);
+	}
+}
+
+void initIdle(idle_t* idle) {
+	idle->count = 0;
+	idle->pollAt = 0;
+}
+
+int watchFd(machine_t* m, int fd, m80_ready_t ready, void* ctx) {
+	idle_t* idle = m->idle;
+	if (idle->count == MAX_WATCHES) return -1;
+
+	int i = idle->count++;
+	idle->fds[i].fd = fd;
+	idle->fds[i].events = POLLIN;
+	idle->fds[i].revents = 0;
+	idle->ready[i] = ready;
+	idle->ctx[i] = ctx;
+
+	// Looked at while running too, starting from the next event
+	if (idle->pollAt < m->nextEvent) m->nextEvent = idle->pollAt;
+
+	return 0;
+}
+
+void unwatchFd(machine_t* m, int fd) {
+	idle_t* idle = m->idle;
+
+	for (int i = 0; i < idle->count; i++) {
+		if (idle->fds[i].fd != fd) continue;
+
+		// The last one takes its place
+		int last = --idle->count;
+		idle->fds[i] = idle->fds[last];
+		idle->ready[i] = idle->ready[last];
+		idle->ctx[i] = idle->ctx[last];
+		return;
+	}
+}
+
+void pollWatched(machine_t* m) {
+	idle_t* idle = m->idle;
+	idle->pollAt = m->proc->cycles + WATCH_POLL_TSTATES;
+
+	if (poll(idle->fds, idle->count, 0) > 0) dispatch(idle);
+}
+
+int waitWatched(machine_t* m) {
+	idle_t* idle = m->idle;
+	pace_t* pace = m->pace;
+	uint64_t timer = nextTimer(m->timers);
+
+	// Kept to a clock, whatever is next comes due as host time passes, otherwise
+	// a device timer can only be waited for by moving the T-states on to it
+	uint64_t until = pace ? m->nextEvent : timer;
+	if (idle->count == 0 && timer == UINT64_MAX) return -1;
+
+	struct timespec timeout = { 0, 0 };
+	int ready;
+	do {
+		if (pace && until != UINT64_MAX) {
+			uint64_t wait = paceWait(pace, until);
+			timeout.tv_sec = wait / 1000000000;
+			timeout.tv_nsec = wait % 1000000000;
+		}
+		ready = ppoll(idle->fds, idle->count, (until != UINT64_MAX) ? &timeout : NULL, NULL);
+	} while (ready == -1 && errno == EINTR);
+
+	if (ready == -1) {
+		perror("ppoll");
+		return -1;
+	}
+
+	dispatch(idle);
+
+	// The time slept was time the processor spent waiting, a file ready straight away took none
+	uint64_t now = pace ? paceCycles(pace) : (ready ? m->proc->cycles : until);
+	if (now > until) now = until;
+	if (now > m->proc->cycles) m->proc->cycles = now;
+
+	return ready;
+}
+
+bool spinning(machine_t* m, spin_t* spin) {
+	proc_t* proc = m->proc;
+	const lazy_flags_t* lazy = &proc->lazy;
+
+	// Compared with the pass before, then left for a while
+	if (spin->countdown == 0) {
+		spin->countdown = SPIN_SAMPLE;
+
+		return spin->quiet && spin->head == proc->PC && spin->sp == proc->SP &&
+				memcmp(spin->gpr, proc->gpr, sizeof(spin->gpr)) == 0 && spin->acc == proc->alureg[ACC] &&
+				spin->eflags == proc->eflags && spin->lazy.op == lazy->op && spin->lazy.a == lazy->a &&
+				spin->lazy.b == lazy->b && spin->lazy.res == lazy->res;
+	}
+
+	if (--spin->countdown > 0) return false;
+
+	// This pass is the one the next is compared with
+	spin->head = proc->PC;
+	spin->at = proc->cycles;
+	spin->quiet = true;
+	spin->sp = proc->SP;
+	memcpy(spin->gpr, proc->gpr, sizeof(spin->gpr));
+	spin->acc = proc->alureg[ACC];
+	spin->eflags = proc->eflags;
+	spin->lazy = *lazy;
+
+	return false;
+}
+
+void skipSpin(machine_t* m, spin_t* spin) {
+	uint64_t from = m->proc->cycles;
+	uint64_t period = from - spin->at;
+
+	// The loop writes nothing, the output before it may be what it is waiting on an answer to
+	if (m->console) flushConsole(m->console);
+
+	// Whatever the loop is waiting on comes from a device, so the thread sleeps until one has something
+	int ready = waitWatched(m);
+	if (ready > 0) spin->quiet = false;
+
+	if (ready < 0) {
+		// With nothing left that could break the loop, the program is done, as a halt with nothing to wake it is
+		if (m->nextEvent == UINT64_MAX) {
+			m->proc->status = STAT_HLT;
+			return;
+		}
+
+		// Otherwise the loop goes on until the next event
+		if (m->nextEvent > from) m->proc->cycles = m->nextEvent;
+	}
+
+	// It is skipped to the first pass at or after where it got to, unless that is past any count of T-states
+	uint64_t passes = (m->proc->cycles - from + period - 1) / period;
+	if (passes <= (UINT64_MAX - from) / period) m->proc->cycles = from + passes * period;
+	spin->at = m->proc->cycles;
+}
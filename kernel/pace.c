@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+
+#include "pace.h"
+#include "machine.h"
+
+
+#define NS_PER_SEC 1000000000ULL
+
+
+static uint64_t hostTime() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * Scales the count by num / den without overflowing for any run length.
+ */
+static uint64_t scale(uint64_t count, uint64_t num, uint64_t den) {
+	return count / den * num + count % den * num / den;
+}
+
+void setClock(machine_t* m, uint64_t hz) {
+	if (!hz) {
+		free(m->pace);
+		m->pace = NULL;
+		return;
+	}
+
+	if (!m->pace) m->pace = (pace_t*) malloc(sizeof(pace_t));
+	m->pace->hz = hz;
+	startPace(m);
+}
+
+void startPace(machine_t* m) {
+	pace_t* pace = m->pace;
+
+	pace->baseCycles = m->proc->cycles;
+	pace->baseTime = hostTime();
+	pace->next = m->proc->cycles;
+}
+
+/**
+ * Gets the host time the run gets to the T-states at.
+ */
+static uint64_t paceTime(const pace_t* pace, uint64_t cycles) {
+	if (cycles < pace->baseCycles) return pace->baseTime;
+
+	return pace->baseTime + scale(cycles - pace->baseCycles, NS_PER_SEC, pace->hz);
+}
+
+uint64_t paceWait(const pace_t* pace, uint64_t cycles) {
+	uint64_t due = paceTime(pace, cycles);
+	uint64_t now = hostTime();
+
+	return (due > now) ? due - now : 0;
+}
+
+uint64_t paceCycles(const pace_t* pace) {
+	return pace->baseCycles + scale(hostTime() - pace->baseTime, pace->hz, NS_PER_SEC);
+}
+
+void pace(machine_t* m) {
+	pace_t* pace = m->pace;
+	uint64_t due = paceTime(pace, m->proc->cycles);
+	uint64_t now = hostTime();
+
+	if (now + PACE_MAX_LAG < due || now > due + PACE_MAX_LAG) startPace(m);
+	else if (due > now) {
+		struct timespec until = { due / NS_PER_SEC, due % NS_PER_SEC };
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR);
+	}
+
+	pace->next = m->proc->cycles + pace->hz / PACE_BATCHES;
+}
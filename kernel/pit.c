@@ -0,0 +1,306 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "pit.h"
+#include "machine.h"
+
+
+#define SC(control) ((control) >> 6) // The counter the control word is for
+#define RW(control) (((control) >> 4) & 0x3)
+#define MODE(control) (((control) >> 1) & 0x7)
+#define BCD 0x01
+
+
+static uint32_t modulus(const pit_counter_t* c) {
+	return c->bcd ? 10000 : 65536;
+}
+
+/**
+ * Gets the counts a count register holds.
+ */
+static uint32_t fromCount(const pit_counter_t* c, uint16_t count) {
+	uint32_t value = count;
+	if (c->bcd) value = (count >> 12) * 1000 + ((count >> 8) & 0xF) * 100 + ((count >> 4) & 0xF) * 10 + (count & 0xF);
+
+	// 0 is the most, wrapping round to it
+	return value ? value : modulus(c);
+}
+
+/**
+ * Gets the count register holding the counts.
+ */
+static uint16_t toCount(const pit_counter_t* c, uint32_t value) {
+	value %= modulus(c);
+	if (!c->bcd) return value;
+
+	return ((value / 1000) << 12) | ((value / 100 % 10) << 8) | ((value / 10 % 10) << 4) | (value % 10);
+}
+
+static bool periodic(const pit_counter_t* c) {
+	return c->mode == PIT_RATE || c->mode == PIT_SQUARE;
+}
+
+/**
+ * Takes the count written while periodic, once the period it was written in is over.
+ */
+static void catchUp(pit_counter_t* c, uint64_t now) {
+	if (!c->nextPeriod || now < c->switchAt) return;
+
+	c->period = c->nextPeriod;
+	c->loadedAt = c->switchAt;
+	c->nextPeriod = 0;
+}
+
+/**
+ * Gets the counts gone since the counter was loaded.
+ */
+static uint64_t elapsed(pit_counter_t* c, uint64_t now) {
+	catchUp(c, now);
+
+	return (now - c->loadedAt) / c->pit->tstates;
+}
+
+/**
+ * Gets the counter's count register as it is now.
+ */
+static uint16_t current(pit_counter_t* c) {
+	if (!c->counting) return c->count;
+
+	uint64_t ticks = elapsed(c, c->pit->m->proc->cycles);
+
+	switch (c->mode) {
+		case PIT_RATE:
+			return toCount(c, c->period - ticks % c->period);
+		case PIT_SQUARE: {
+			// Counted down two at a time, once for each half
+			uint32_t half = (c->period > 1) ? c->period & ~1 : 2;
+			return toCount(c, c->period - (2 * ticks) % half);
+		}
+		default:
+			// Wraps round past 0, carrying on down
+			return toCount(c, c->period + modulus(c) - ticks % modulus(c));
+	}
+}
+
+/**
+ * Gets the T-states the output next rises at, UINT64_MAX if it never does again.
+ */
+static uint64_t nextEdge(pit_counter_t* c, uint64_t now) {
+	uint64_t tstates = c->pit->tstates;
+
+	if (periodic(c)) {
+		if (c->nextPeriod) return c->switchAt;
+
+		return c->loadedAt + (elapsed(c, now) / c->period + 1) * c->period * tstates;
+	}
+
+	// Once the count has gone to 0 only the next load starts it again
+	uint64_t at = c->loadedAt + (uint64_t) c->period * tstates;
+	return (at > now) ? at : UINT64_MAX;
+}
+
+/**
+ * Sets the counter's timer for the next rising edge of its output, if it interrupts on one.
+ */
+static void schedule(pit_counter_t* c, uint64_t now) {
+	machine_t* m = c->pit->m;
+	if (c->irq < 0) return;
+
+	uint64_t at = c->counting ? nextEdge(c, now) : UINT64_MAX;
+	if (at == UINT64_MAX) stopTimer(m, c->timer);
+	else setTimer(m, c->timer, at);
+}
+
+// The output rose, interrupting
+static void edge(void* ctx, uint64_t at) {
+	pit_counter_t* c = (pit_counter_t*) ctx;
+
+	raiseIrq(c->pit->m, c->irq);
+
+	// Counted on from when it was due, however late it was seen to
+	if (periodic(c)) schedule(c, at);
+}
+
+/**
+ * Loads the counter with the count register just written.
+ */
+static void load(pit_counter_t* c) {
+	uint64_t now = c->pit->m->proc->cycles;
+	uint32_t period = fromCount(c, c->count);
+
+	if (c->mode == PIT_ONE_SHOT || c->mode == PIT_HW_STROBE) {
+		// Waiting on the gate
+		c->period = period;
+		return;
+	}
+
+	if (periodic(c) && c->counting) {
+		// The period being counted is finished first
+		catchUp(c, now);
+		c->switchAt = c->loadedAt + (elapsed(c, now) / c->period + 1) * c->period * c->pit->tstates;
+		c->nextPeriod = period;
+	} else {
+		c->period = period;
+		c->loadedAt = now;
+		c->nextPeriod = 0;
+		c->counting = true;
+	}
+
+	schedule(c, now);
+}
+
+static uint8_t counterIn(void* ctx, uint8_t port) {
+	pit_counter_t* c = (pit_counter_t*) ctx;
+	uint16_t count = c->latched ? c->latch : current(c);
+	bool high;
+
+	switch (c->access) {
+		case PIT_LSB:
+			high = false;
+			break;
+		case PIT_MSB:
+			high = true;
+			break;
+		default:
+			high = c->readHigh;
+			c->readHigh = !c->readHigh;
+	}
+
+	// A latch is let go of once read in full
+	if (high || c->access == PIT_LSB) c->latched = false;
+
+	return high ? count >> 8 : count & 0xFF;
+}
+
+static void counterOut(void* ctx, uint8_t port, uint8_t data) {
+	pit_counter_t* c = (pit_counter_t*) ctx;
+
+	switch (c->access) {
+		case PIT_LSB:
+			c->count = data;
+			break;
+		case PIT_MSB:
+			c->count = data << 8;
+			break;
+		default:
+			if (!c->writeHigh) {
+				c->count = (c->count & 0xFF00) | data;
+				c->writeHigh = true;
+
+				// Half a count stops a counter counting down to 0
+				if (c->mode == PIT_TERMINAL) {
+					c->counting = false;
+					schedule(c, c->pit->m->proc->cycles);
+				}
+				return;
+			}
+
+			c->count = (c->count & 0x00FF) | (data << 8);
+			c->writeHigh = false;
+	}
+
+	load(c);
+}
+
+static void controlOut(void* ctx, uint8_t port, uint8_t data) {
+	pit_t* pit = (pit_t*) ctx;
+
+	// There is no read-back command on the 8253
+	if (SC(data) >= PIT_COUNTERS) return;
+	pit_counter_t* c = &pit->counters[SC(data)];
+
+	if (RW(data) == PIT_LATCH) {
+		// Latching again before the last latch was read does nothing
+		if (!c->latched) {
+			c->latch = current(c);
+			c->latched = true;
+		}
+		return;
+	}
+
+	// Modes 6 and 7 are 2 and 3
+	c->mode = (MODE(data) > PIT_HW_STROBE) ? MODE(data) - 4 : MODE(data);
+	c->access = RW(data);
+	c->bcd = data & BCD;
+	c->counting = false;
+	c->nextPeriod = 0;
+	c->writeHigh = false;
+	c->readHigh = false;
+	c->latched = false;
+	schedule(c, pit->m->proc->cycles);
+}
+
+/**
+ * Attaches the timer's ports.
+ */
+static void attachPorts(machine_t* m, pit_t* pit) {
+	for (int i = 0; i < PIT_COUNTERS; i++) attachPort(m->ports, pit->port + i, counterIn, counterOut, &pit->counters[i]);
+	attachPort(m->ports, pit->port + PIT_CONTROL_PORT, NULL, controlOut, pit);
+}
+
+/**
+ * Puts the counter back as it is at power on, set up but not counting.
+ */
+static void clearCounter(pit_counter_t* c) {
+	c->mode = PIT_TERMINAL;
+	c->access = PIT_WORD;
+	c->bcd = false;
+	c->count = 0;
+	c->period = 0;
+	c->counting = false;
+	c->nextPeriod = 0;
+	c->writeHigh = false;
+	c->readHigh = false;
+	c->latched = false;
+}
+
+void attachPit(machine_t* m, uint8_t port, uint32_t tstates) {
+	pit_t* pit = (pit_t*) malloc(sizeof(pit_t));
+	pit->m = m;
+	pit->port = port;
+	pit->tstates = tstates;
+
+	for (int i = 0; i < PIT_COUNTERS; i++) {
+		pit_counter_t* c = &pit->counters[i];
+
+		c->pit = pit;
+		clearCounter(c);
+
+		// Only counter 0 is wired to the interrupt lines, the others are only read
+		c->irq = (i == 0) ? PIT_IRQ : -1;
+		c->timer = (i == 0) ? addTimer(m, edge, c) : -1;
+		if (c->timer == -1) c->irq = -1;
+	}
+
+	m->pit = pit;
+	attachPorts(m, pit);
+}
+
+void resetPit(machine_t* m) {
+	for (int i = 0; i < PIT_COUNTERS; i++) {
+		pit_counter_t* c = &m->pit->counters[i];
+
+		clearCounter(c);
+		if (c->timer != -1) stopTimer(m, c->timer);
+	}
+}
+
+void forkPit(machine_t* child, machine_t* m) {
+	pit_t* pit = (pit_t*) malloc(sizeof(pit_t));
+	*pit = *m->pit;
+	pit->m = child;
+
+	// The timers were copied set as they were, they are pointed at the copy
+	for (int i = 0; i < PIT_COUNTERS; i++) {
+		pit->counters[i].pit = pit;
+		if (pit->counters[i].timer != -1) moveTimer(child, pit->counters[i].timer, &pit->counters[i]);
+	}
+
+	child->pit = pit;
+	attachPorts(child, pit);
+}
+
+void freePit(machine_t* m) {
+	free(m->pit);
+	m->pit = NULL;
+}
@@ -0,0 +1,29 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "profile.h"
+
+void reportPairs(const pair_profile_t* profile, FILE* out) {
+	// The pairs picked so far, most frequent first
+	int top[PROFILE_TOP_PAIRS];
+	int found = 0;
+
+	for (int pair = 0; pair < 256 * 256; pair++) {
+		uint64_t count = profile->counts[pair >> 8][pair & 0xFF];
+		if (count == 0) continue;
+
+		int i = found < PROFILE_TOP_PAIRS ? found++ : PROFILE_TOP_PAIRS;
+		while (i > 0 && profile->counts[top[i - 1] >> 8][top[i - 1] & 0xFF] < count) {
+			if (i < PROFILE_TOP_PAIRS) top[i] = top[i - 1];
+			i--;
+		}
+		if (i < PROFILE_TOP_PAIRS) top[i] = pair;
+	}
+
+	fprintf(out, "Opcode pairs: %llu\n", (unsigned long long) profile->total);
+	for (int i = 0; i < found; i++) {
+		uint64_t count = profile->counts[top[i] >> 8][top[i] & 0xFF];
+		fprintf(out, "0x%02x 0x%02x %llu %.2f%%\n", top[i] >> 8, top[i] & 0xFF,
+			(unsigned long long) count, 100.0 * count / profile->total);
+	}
+}
@@ -0,0 +1,508 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+#include "machine.h"
+#include "hardware.h"
+#include "mem.h"
+
+
+// Reads and writes fields in order through a buffer
+typedef struct cursor {
+	uint8_t* buf;
+	size_t pos;
+} cursor_t;
+
+static void put8(cursor_t* c, uint8_t v) {
+	c->buf[c->pos++] = v;
+}
+
+static void put16(cursor_t* c, uint16_t v) {
+	put8(c, v & 0xFF);
+	put8(c, v >> 8);
+}
+
+static void put64(cursor_t* c, uint64_t v) {
+	for (int i = 0; i < 8; i++) put8(c, (v >> (8 * i)) & 0xFF);
+}
+
+static uint8_t get8(cursor_t* c) {
+	return c->buf[c->pos++];
+}
+
+static uint16_t get16(cursor_t* c) {
+	uint16_t lo = get8(c);
+	return lo | (get8(c) << 8);
+}
+
+static uint64_t get64(cursor_t* c) {
+	uint64_t v = 0;
+	for (int i = 0; i < 8; i++) v |= (uint64_t) get8(c) << (8 * i);
+	return v;
+}
+
+/**
+ * Packs the signals into a byte, the first in bit 0.
+ */
+static uint8_t packSigs(const bool* sigs, int n) {
+	uint8_t bits = 0;
+	for (int i = 0; i < n; i++) bits |= sigs[i] << i;
+	return bits;
+}
+
+static void unpackSigs(uint8_t bits, bool* sigs, int n) {
+	for (int i = 0; i < n; i++) sigs[i] = (bits >> i) & 1;
+}
+
+static bool pageInUse(const uint8_t* page) {
+	for (int i = 0; i < MEM_PAGE_SIZE; i++) {
+		if (page[i]) return true;
+	}
+	return false;
+}
+
+static bool pageInRecord(const uint8_t* map, int page) {
+	return (map[page / 8] >> (page % 8)) & 1;
+}
+
+/**
+ * Writes the machine's state to the buffer as a record of the kind.
+ * @return The length of the record
+ */
+static size_t packRecord(machine_t* m, uint8_t* buf, uint8_t kind) {
+	proc_t* proc = m->proc;
+	state_t* state = &State(m);
+
+	cursor_t c = { buf, 0 };
+
+	memcpy(buf, SNAP_MAGIC, 4);
+	c.pos = 4;
+	put16(&c, SNAP_VERSION);
+	put8(&c, kind);
+
+	for (int i = 0; i < 6; i++) put8(&c, proc->gpr[i]);
+	for (int i = 0; i < 3; i++) put8(&c, proc->alureg[i]);
+	for (int i = 0; i < 2; i++) put8(&c, proc->tempreg[i]);
+	put8(&c, proc->IR);
+	put16(&c, proc->PC);
+	put16(&c, proc->SP);
+	put8(&c, getEflags(m));
+	put64(&c, proc->cycles);
+	put16(&c, AddrBus(m));
+	put8(&c, DataBus(m));
+	put8(&c, CtrlBus(m));
+	put8(&c, proc->status);
+
+	put8(&c, state->intdatabus);
+	put8(&c, packSigs((const bool*) &state->statusSigs, sizeof(status_sigs_t) / sizeof(bool)));
+	put8(&c, packSigs((const bool*) &state->ctrSigs, sizeof(ctrl_sigs_t) / sizeof(bool)));
+
+	for (int i = 0; i <= STACK_SEG; i++) put16(&c, m->mem->segStart[i]);
+
+	// Whether the controller is attached is up to the machine restored into, only its state is kept
+	intr_t* intr = m->intr;
+	put8(&c, intr->request);
+	put8(&c, intr->mask);
+	put8(&c, intr->service);
+	put64(&c, intr->enabledAt);
+	put8(&c, intr->initWords);
+	put8(&c, intr->readService);
+
+	int windows = m->banks ? m->banks->numWindows : 0;
+	put8(&c, windows);
+	for (int i = 0; i < MAX_WINDOWS; i++) put8(&c, (i < windows) ? m->banks->windows[i].bank : 0);
+
+	// Most of memory is never touched, so only pages holding something are stored
+	uint8_t* map = buf + c.pos;
+	memset(map, 0, SNAP_MAP_SIZE);
+	c.pos += SNAP_MAP_SIZE;
+
+	for (int page = 0; page < MEM_PAGES; page++) {
+		uint8_t* data = m->mem->backing[page];
+
+		bool stored = (kind == SNAP_FULL) ? pageInUse(data) : (m->mem->dirty[page] & DIRTY_CHECKPOINT);
+		if (!stored) continue;
+
+		map[page / 8] |= 1 << (page % 8);
+		memcpy(buf + c.pos, data, MEM_PAGE_SIZE);
+		c.pos += MEM_PAGE_SIZE;
+	}
+
+	return c.pos;
+}
+
+/**
+ * Checks that a whole, well formed record starts the buffer.
+ * @return The length of the record, or 0 if there is none
+ */
+static size_t recordSize(const uint8_t* buf, size_t size) {
+	if (size < SNAP_FIXED_SIZE || memcmp(buf, SNAP_MAGIC, 4) != 0) return 0;
+
+	uint16_t version = buf[4] | (buf[5] << 8);
+	uint8_t kind = buf[6];
+	uint8_t status = buf[SNAP_HDR_SIZE + SNAP_PROC_SIZE - 1];
+	if (version != SNAP_VERSION || (kind != SNAP_FULL && kind != SNAP_DELTA) || status > STAT_INS) return 0;
+
+	const uint8_t* map = buf + SNAP_FIXED_SIZE - SNAP_MAP_SIZE;
+	size_t pages = 0;
+	for (int page = 0; page < MEM_PAGES; page++) pages += pageInRecord(map, page);
+
+	size_t len = SNAP_FIXED_SIZE + pages * MEM_PAGE_SIZE;
+	return (len <= size) ? len : 0;
+}
+
+/**
+ * Puts the machine in the state held by a record already checked to be well formed.
+ */
+static void applyRecord(machine_t* m, const uint8_t* buf) {
+	proc_t* proc = m->proc;
+	state_t* state = &State(m);
+
+	cursor_t c = { (uint8_t*) buf, SNAP_HDR_SIZE };
+	uint8_t kind = buf[6];
+
+	for (int i = 0; i < 6; i++) proc->gpr[i] = get8(&c);
+	for (int i = 0; i < 3; i++) proc->alureg[i] = get8(&c);
+	for (int i = 0; i < 2; i++) proc->tempreg[i] = get8(&c);
+	proc->IR = get8(&c);
+	proc->PC = get16(&c);
+	proc->SP = get16(&c);
+	setEflags(m, get8(&c));
+	proc->cycles = get64(&c);
+	AddrBus(m) = get16(&c);
+	DataBus(m) = get8(&c);
+	CtrlBus(m) = get8(&c);
+	proc->status = get8(&c);
+
+	state->intdatabus = get8(&c);
+	unpackSigs(get8(&c), (bool*) &state->statusSigs, sizeof(status_sigs_t) / sizeof(bool));
+	unpackSigs(get8(&c), (bool*) &state->ctrSigs, sizeof(ctrl_sigs_t) / sizeof(bool));
+
+	for (int i = 0; i <= STACK_SEG; i++) m->mem->segStart[i] = get16(&c);
+
+	intr_t* intr = m->intr;
+	intr->request = get8(&c);
+	intr->mask = get8(&c);
+	intr->service = get8(&c);
+	intr->enabledAt = get64(&c);
+	intr->initWords = get8(&c);
+	intr->readService = get8(&c);
+
+	// The banks are switched first, so the pages below go where they were seen. A machine
+	// without the same windows takes them as its RAM.
+	int windows = get8(&c);
+	bool banked = m->banks && windows == m->banks->numWindows;
+	for (int i = 0; i < MAX_WINDOWS; i++) {
+		uint8_t bank = get8(&c);
+		if (banked && i < windows) switchBank(m, i, bank);
+	}
+
+	const uint8_t* map = buf + c.pos;
+	c.pos += SNAP_MAP_SIZE;
+
+	// Pages left out of a full record are zeroes, left out of a delta they are as they were
+	for (int page = 0; page < MEM_PAGES; page++) {
+		uint8_t* data = m->mem->backing[page];
+
+		if (pageInRecord(map, page)) {
+			memcpy(data, buf + c.pos, MEM_PAGE_SIZE);
+			c.pos += MEM_PAGE_SIZE;
+		} else if (kind == SNAP_FULL) {
+			memset(data, 0, MEM_PAGE_SIZE);
+		} else continue;
+
+		m->mem->dirty[page] = DIRTY_ALL;
+	}
+}
+
+static int writeAll(int fd, const uint8_t* buf, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n == -1) return -1;
+
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+int saveSnapshot(machine_t* m, const char* filename) {
+	uint8_t* buf = (uint8_t*) malloc(SNAP_MAX_SIZE);
+	size_t len = packRecord(m, buf, SNAP_FULL);
+
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		perror(filename);
+		free(buf);
+		return -1;
+	}
+
+	bool written = writeAll(fd, buf, len) == 0;
+	if (close(fd) != 0) written = false;
+	if (!written) perror(filename);
+
+	free(buf);
+
+	return written ? 0 : -1;
+}
+
+int restoreSnapshot(machine_t* m, const char* filename) {
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1) {
+		perror(filename);
+		return -1;
+	}
+
+	struct stat statbuff;
+	if (fstat(fd, &statbuff) != 0) {
+		perror(filename);
+		close(fd);
+		return -1;
+	}
+
+	size_t size = statbuff.st_size;
+	if (size < SNAP_HDR_SIZE) {
+		fprintf(stderr, "%s: File is not a machine snapshot!\n", filename);
+		close(fd);
+		return -1;
+	}
+
+	uint8_t* buf = (uint8_t*) mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED) {
+		perror(filename);
+		return -1;
+	}
+
+	if (memcmp(buf, SNAP_MAGIC, 4) != 0 || (buf[4] | (buf[5] << 8)) != SNAP_VERSION) {
+		fprintf(stderr, "%s: File is not a machine snapshot!\n", filename);
+		munmap(buf, size);
+		return -1;
+	}
+
+	size_t first = recordSize(buf, size);
+	if (first == 0 || buf[6] != SNAP_FULL) {
+		fprintf(stderr, "%s: Snapshot is truncated or corrupt!\n", filename);
+		munmap(buf, size);
+		return -1;
+	}
+
+	// Nothing is touched until the records are known to be whole
+	size_t end = first;
+	for (size_t len; (len = recordSize(buf + end, size - end)) != 0; end += len);
+
+	for (size_t pos = 0; pos < end; pos += recordSize(buf + pos, size - pos)) applyRecord(m, buf + pos);
+
+	// The segments may have moved, and whatever code was cached is from the old memory
+	mapSegments(m);
+	// INTE and the lines came back apart, so whether an interrupt is pending is worked out again
+	updateInterrupts(m);
+
+	munmap(buf, size);
+
+	return 0;
+}
+
+/**
+ * Starts the checkpoint file over with a full record. It is written aside and renamed
+ * over the file, so a crash part way leaves either the old file or the new one.
+ */
+static int restartLog(machine_t* m) {
+	checkpoint_t* cp = m->checkpoint;
+
+	size_t len = packRecord(m, cp->buf, SNAP_FULL);
+
+	char* tmp = (char*) malloc(strlen(cp->filename) + 4 + 1);
+	sprintf(tmp, "%s.tmp", cp->filename);
+
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1 || writeAll(fd, cp->buf, len) != 0 || fdatasync(fd) != 0 || rename(tmp, cp->filename) != 0) {
+		perror(cp->filename);
+		if (fd != -1) {
+			close(fd);
+			unlink(tmp);
+		}
+		free(tmp);
+		return -1;
+	}
+	free(tmp);
+
+	if (cp->fd != -1) close(cp->fd);
+	cp->fd = fd;
+	cp->size = len;
+	cleanPages(m->mem, DIRTY_CHECKPOINT);
+
+	return 0;
+}
+
+int startCheckpoints(machine_t* m, const char* filename, uint64_t interval) {
+	stopCheckpoints(m);
+
+	checkpoint_t* cp = (checkpoint_t*) malloc(sizeof(checkpoint_t));
+	cp->filename = strdup(filename);
+	cp->fd = -1;
+	cp->interval = interval;
+	cp->next = m->proc->cycles + interval;
+	cp->size = 0;
+	cp->buf = (uint8_t*) malloc(SNAP_MAX_SIZE);
+
+	m->checkpoint = cp;
+	if (restartLog(m) != 0) {
+		stopCheckpoints(m);
+		return -1;
+	}
+
+	return 0;
+}
+
+void stopCheckpoints(machine_t* m) {
+	checkpoint_t* cp = m->checkpoint;
+	if (!cp) return;
+
+	if (cp->fd != -1) close(cp->fd);
+	free(cp->buf);
+	free(cp->filename);
+	free(cp);
+
+	m->checkpoint = NULL;
+}
+
+int checkpoint(machine_t* m) {
+	checkpoint_t* cp = m->checkpoint;
+	cp->next = m->proc->cycles + cp->interval;
+
+	size_t len = packRecord(m, cp->buf, SNAP_DELTA);
+
+	int rc;
+	if (cp->size + len > CHECKPOINT_MAX_LOG) {
+		rc = restartLog(m);
+	} else if (writeAll(cp->fd, cp->buf, len) != 0 || fdatasync(cp->fd) != 0) {
+		perror(cp->filename);
+		rc = -1;
+	} else {
+		cp->size += len;
+		cleanPages(m->mem, DIRTY_CHECKPOINT);
+		rc = 0;
+	}
+
+	// A delta cut short is left off when restoring, but nothing could follow it
+	if (rc != 0) stopCheckpoints(m);
+
+	return rc;
+}
+
+void setBaseline(machine_t* m) {
+	mem_t* mem = m->mem;
+
+	if (!m->baseline) {
+		m->baseline = (baseline_t*) malloc(sizeof(baseline_t));
+		m->baseline->ext = NULL;
+		m->baseline->extSize = 0;
+	}
+	baseline_t* base = m->baseline;
+
+	base->proc = *m->proc;
+	memcpy(base->segStart, mem->segStart, sizeof(base->segStart));
+
+	// The memory behind the address space is taken, so a bank switched out can be put back too
+	memcpy(base->ram, mem->ram, MAX_ADDR + 1);
+	if (mem->ext) {
+		if (base->extSize != mem->extSize) {
+			free(base->ext);
+			base->ext = (uint8_t*) malloc(mem->extSize);
+			base->extSize = mem->extSize;
+		}
+		memcpy(base->ext, mem->ext, mem->extSize);
+	}
+	for (int i = 0; i < (m->banks ? m->banks->numWindows : 0); i++) base->banks[i] = m->banks->windows[i].bank;
+
+	cleanPages(mem, DIRTY_BASELINE);
+}
+
+/**
+ * Gets the baseline's copy of a page of the RAM or extended memory.
+ */
+static const uint8_t* baselinePage(const baseline_t* base, const mem_t* mem, const uint8_t* host) {
+	if (host >= mem->ram && host <= mem->ram + MAX_ADDR) return base->ram + (host - mem->ram);
+
+	return base->ext + (host - mem->ext);
+}
+
+/**
+ * Copies back the pages of memory switched out that were written since the baseline.
+ */
+static void resetHidden(const baseline_t* base, mem_t* mem) {
+	for (int page = 0; page < MEM_PAGES; page++) {
+		if (!(mem->ramDirty[page] & DIRTY_BASELINE)) continue;
+
+		memcpy(mem->ram + (page << MEM_PAGE_SHIFT), base->ram + (page << MEM_PAGE_SHIFT), MEM_PAGE_SIZE);
+		mem->ramDirty[page] = DIRTY_CHECKPOINT;
+	}
+
+	for (size_t page = 0; page < base->extSize >> MEM_PAGE_SHIFT; page++) {
+		if (!(mem->extDirty[page] & DIRTY_BASELINE)) continue;
+
+		memcpy(mem->ext + (page << MEM_PAGE_SHIFT), base->ext + (page << MEM_PAGE_SHIFT), MEM_PAGE_SIZE);
+		mem->extDirty[page] = DIRTY_CHECKPOINT;
+	}
+}
+
+int resetBaseline(machine_t* m) {
+	baseline_t* base = m->baseline;
+	mem_t* mem = m->mem;
+	if (!base) return -1;
+
+	*m->proc = base->proc;
+	if (memcmp(mem->segStart, base->segStart, sizeof(base->segStart)) != 0) {
+		memcpy(mem->segStart, base->segStart, sizeof(base->segStart));
+		mapSegments(m);
+	}
+
+	// Banks attached since have nothing to go back to
+	bool banked = m->banks && base->ext && base->extSize == mem->extSize;
+
+	// The banks are switched back first, so what is copied back below goes where it was
+	for (int i = 0; i < (banked ? m->banks->numWindows : 0); i++) switchBank(m, i, base->banks[i]);
+
+	for (int page = 0; page < MEM_PAGES; page++) {
+		if (!(mem->dirty[page] & DIRTY_BASELINE)) continue;
+
+		uint16_t addr = page << MEM_PAGE_SHIFT;
+		uint8_t* data = mem->backing[page];
+		if (!banked && data != mem->ram + addr) continue;
+		const uint8_t* orig = baselinePage(base, mem, data);
+
+		// Blocks are only dropped over bytes that change back, so code sharing a page with data stays cached
+		if (mem->codePage[page]) {
+			for (int i = 0; i < MEM_PAGE_SIZE; i++) {
+				if (data[i] == orig[i]) continue;
+
+				data[i] = orig[i];
+				invalidateCode(m, addr + i);
+			}
+		} else memcpy(data, orig, MEM_PAGE_SIZE);
+
+		// Changed from whatever was last checkpointed
+		mem->dirty[page] = DIRTY_CHECKPOINT;
+		updatePage(mem, page);
+	}
+
+	if (banked) resetHidden(base, mem);
+
+	return 0;
+}
+
+void freeBaseline(machine_t* m) {
+	if (!m->baseline) return;
+
+	free(m->baseline->ext);
+	free(m->baseline);
+	m->baseline = NULL;
+}
@@ -0,0 +1,469 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "uart.h"
+#include "machine.h"
+#include "idle.h"
+
+
+#define RING_MASK (UART_BUF_SIZE - 1)
+#define UART_DRAIN_MS 1000 // Most time taken sending what is left once stopping, for a host end that is not being read
+#define UART_DRAIN_POLL_MS 10
+
+
+static size_t ringLen(uart_ring_t* ring) {
+	return atomic_load(&ring->tail) - atomic_load(&ring->head);
+}
+
+/**
+ * Gets the ring's bytes from the index on as at most two runs, the second from the start of the buffer.
+ * @return The number of runs
+ */
+static int ringRuns(uart_ring_t* ring, size_t from, size_t len, struct iovec runs[2]) {
+	size_t start = from & RING_MASK;
+	size_t first = UART_BUF_SIZE - start;
+	if (first > len) first = len;
+
+	runs[0].iov_base = ring->buf + start;
+	runs[0].iov_len = first;
+	runs[1].iov_base = ring->buf;
+	runs[1].iov_len = len - first;
+
+	return (len > first) ? 2 : 1;
+}
+
+/**
+ * Rings the eventfd.
+ */
+static void signalFd(int fd) {
+	uint64_t one = 1;
+	while (write(fd, &one, sizeof(one)) == -1 && errno == EINTR);
+}
+
+/**
+ * Empties the eventfd.
+ */
+static void drainFd(int fd) {
+	uint64_t count;
+	while (read(fd, &count, sizeof(count)) == -1 && errno == EINTR);
+}
+
+/**
+ * Wakes the I/O thread if it is waiting, for it to see to the rings.
+ */
+static void wakeThread(uart_t* uart) {
+	if (atomic_load(&uart->sleeping)) signalFd(uart->wake);
+}
+
+/**
+ * Starts the next character coming in off the line, if one is waiting and there is room for it.
+ */
+static void startReceive(uart_t* uart) {
+	machine_t* m = uart->m;
+
+	if (!(uart->command & UART_RX_ENABLE) || uart->rxFull || uart->receiving || ringLen(&uart->rx) == 0) return;
+
+	uart->receiving = true;
+	setTimer(m, uart->rxTimer, m->proc->cycles + uart->charTstates);
+}
+
+// A character has come in off the line
+static void received(void* ctx, uint64_t at) {
+	uart_t* uart = (uart_t*) ctx;
+	uart_ring_t* rx = &uart->rx;
+
+	uart->receiving = false;
+
+	bool full = ringLen(rx) == UART_BUF_SIZE;
+	size_t head = atomic_load(&rx->head);
+	uart->rxData = rx->buf[head & RING_MASK];
+	atomic_store(&rx->head, head + 1);
+	uart->rxFull = true;
+
+	// The thread stops reading the host end while the ring is full
+	if (full) wakeThread(uart);
+
+	raiseIrq(uart->m, UART_IRQ);
+}
+
+// The I/O thread has put bytes on the ring
+static void doorbellReady(void* ctx, int fd) {
+	uart_t* uart = (uart_t*) ctx;
+
+	drainFd(fd);
+	startReceive(uart);
+}
+
+/**
+ * Watches the doorbell while the receiver is enabled, and starts the next character in.
+ */
+static void updateReceiver(uart_t* uart) {
+	machine_t* m = uart->m;
+	bool watch = uart->command & UART_RX_ENABLE;
+
+	if (watch != uart->watching) {
+		if (watch) uart->watching = watchFd(m, uart->doorbell, doorbellReady, uart) == 0;
+		else {
+			unwatchFd(m, uart->doorbell);
+			uart->watching = false;
+		}
+	}
+
+	startReceive(uart);
+}
+
+static uint8_t dataIn(void* ctx, uint8_t port) {
+	uart_t* uart = (uart_t*) ctx;
+
+	if (uart->rxFull) {
+		uart->rxFull = false;
+		lowerIrq(uart->m, UART_IRQ);
+		startReceive(uart);
+	}
+
+	return uart->rxData;
+}
+
+static void dataOut(void* ctx, uint8_t port, uint8_t data) {
+	uart_t* uart = (uart_t*) ctx;
+	uart_ring_t* tx = &uart->tx;
+	uint64_t now = uart->m->proc->cycles;
+
+	if (!(uart->command & UART_TX_ENABLE)) return;
+
+	// A character written over one not yet sent is lost, as it would be
+	if (ringLen(tx) == UART_BUF_SIZE) return;
+
+	size_t tail = atomic_load(&tx->tail);
+	tx->buf[tail & RING_MASK] = data;
+	atomic_store(&tx->tail, tail + 1);
+	wakeThread(uart);
+
+	uart->txDoneAt = ((uart->txDoneAt > now) ? uart->txDoneAt : now) + uart->charTstates;
+}
+
+static uint8_t statusIn(void* ctx, uint8_t port) {
+	uart_t* uart = (uart_t*) ctx;
+	uint64_t now = uart->m->proc->cycles;
+
+	// Nothing is waited on to see whether a character is coming
+	startReceive(uart);
+
+	// The holding buffer is free once only the character being sent is left
+	bool txReady = uart->txDoneAt <= now + uart->charTstates && ringLen(&uart->tx) < UART_BUF_SIZE;
+
+	return (txReady ? UART_TX_READY : 0) | (uart->rxFull ? UART_RX_READY : 0) |
+			((uart->txDoneAt <= now) ? UART_TX_EMPTY : 0) | (atomic_load(&uart->connected) ? UART_DSR : 0);
+}
+
+static void controlOut(void* ctx, uint8_t port, uint8_t data) {
+	uart_t* uart = (uart_t*) ctx;
+
+	// Sync characters are taken and have no meaning here
+	if (uart->syncChars > 0) {
+		uart->syncChars--;
+		return;
+	}
+
+	if (uart->expectMode) {
+		uart->expectMode = false;
+
+		if (UART_MODE_FACTOR(data) == 0) {
+			// The line is still timed as asynchronous, with 8 bits a character
+			uart->syncChars = (data & UART_MODE_SINGLE_SYNC) ? 1 : 2;
+			uart->charTstates = 8 * uart->bitTstates;
+			return;
+		}
+
+		// The clock factor only divides the clock the line rate is given as
+		uint64_t halfBits = 2 * (1 + UART_MODE_BITS(data) + UART_MODE_PARITY(data)) + 1 + UART_MODE_STOP(data);
+		uart->charTstates = halfBits * uart->bitTstates / 2;
+		return;
+	}
+
+	if (data & UART_INTERNAL_RESET) {
+		uart->expectMode = true;
+		uart->command = 0x00;
+	} else {
+		// There are no errors to reset, flow control keeps the receiver from overrunning
+		uart->command = data;
+	}
+
+	updateReceiver(uart);
+}
+
+/**
+ * Sends what is on the tx ring to the host end, as much as it takes without blocking.
+ */
+static void sendHost(uart_t* uart) {
+	uart_ring_t* tx = &uart->tx;
+
+	while (ringLen(tx) > 0) {
+		size_t head = atomic_load(&tx->head);
+		struct iovec runs[2];
+		int n = ringRuns(tx, head, ringLen(tx), runs);
+
+		ssize_t written = writev(uart->host, runs, n);
+		if (written == -1 && errno == EINTR) continue;
+		if (written <= 0) return;
+
+		atomic_store(&tx->head, head + written);
+	}
+}
+
+/**
+ * Takes what the host end has sent onto the rx ring, as much as fits.
+ * @return Whether the host end is still connected
+ */
+static bool receiveHost(uart_t* uart) {
+	uart_ring_t* rx = &uart->rx;
+	size_t tail = atomic_load(&rx->tail);
+	bool empty = ringLen(rx) == 0;
+
+	struct iovec runs[2];
+	int n = ringRuns(rx, tail, UART_BUF_SIZE - ringLen(rx), runs);
+
+	ssize_t got = readv(uart->host, runs, n);
+	if (got == -1) return errno == EINTR || errno == EAGAIN;
+	if (got == 0) return false;
+
+	atomic_store(&rx->tail, tail + got);
+
+	// Rung only as the ring stops being empty, the machine takes everything on it from there
+	if (empty) signalFd(uart->doorbell);
+
+	return true;
+}
+
+static void disconnect(uart_t* uart) {
+	close(uart->host);
+	uart->host = -1;
+	atomic_store(&uart->connected, false);
+}
+
+// Moves bytes between the rings and the host end until the USART is freed
+static void* serve(void* arg) {
+	uart_t* uart = (uart_t*) arg;
+
+	for (;;) {
+		// Anything put on a ring from here on wakes the thread
+		atomic_store(&uart->sleeping, true);
+		if (atomic_load(&uart->stop)) break;
+
+		// With nothing on the other end, what is sent is lost
+		if (uart->host == -1) atomic_store(&uart->tx.head, atomic_load(&uart->tx.tail));
+
+		struct pollfd fds[2] = { { uart->wake, POLLIN, 0 }, { -1, 0, 0 } };
+		if (uart->host != -1) {
+			fds[1].fd = uart->host;
+			if (ringLen(&uart->rx) < UART_BUF_SIZE) fds[1].events |= POLLIN;
+			if (ringLen(&uart->tx) > 0) fds[1].events |= POLLOUT;
+		} else {
+			fds[1].fd = uart->listener;
+			fds[1].events = POLLIN;
+		}
+
+		if (poll(fds, 2, -1) == -1 && errno != EINTR) {
+			perror("poll");
+			break;
+		}
+		atomic_store(&uart->sleeping, false);
+
+		if (fds[0].revents) drainFd(uart->wake);
+		if (!fds[1].revents) continue;
+
+		if (uart->host == -1) {
+			// One client at a time, the next is taken once it goes
+			uart->host = accept4(uart->listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if (uart->host != -1) atomic_store(&uart->connected, true);
+			continue;
+		}
+
+		if (fds[1].revents & POLLOUT) sendHost(uart);
+		if ((fds[1].revents & (POLLIN | POLLHUP | POLLERR)) && !receiveHost(uart)) {
+			// A pseudo-terminal never hangs up, its other end being held open
+			if (uart->listener != -1) disconnect(uart);
+		}
+	}
+
+	// What the guest wrote is sent before stopping, if the host end takes it
+	while (uart->host != -1 && ringLen(&uart->tx) > 0) {
+		struct pollfd pfd = { uart->host, POLLOUT, 0 };
+		if (poll(&pfd, 1, UART_DRAIN_MS) != 1) break;
+		sendHost(uart);
+	}
+
+	// A pseudo-terminal drops what its client has not read once closed, so the client is given the time to
+	int unread;
+	for (int waited = 0; uart->peer != -1 && waited < UART_DRAIN_MS; waited += UART_DRAIN_POLL_MS) {
+		if (ioctl(uart->peer, FIONREAD, &unread) != 0 || unread == 0) break;
+		poll(NULL, 0, UART_DRAIN_POLL_MS);
+	}
+
+	return NULL;
+}
+
+/**
+ * Opens a pseudo-terminal as the host end, printing the name clients open it by.
+ */
+static int openPty(uart_t* uart) {
+	int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (master == -1 || grantpt(master) != 0 || unlockpt(master) != 0) {
+		perror("posix_openpt");
+		if (master != -1) close(master);
+		return -1;
+	}
+
+	// Bytes go through as they are
+	struct termios tio;
+	if (tcgetattr(master, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(master, TCSANOW, &tio);
+	}
+
+	const char* name = ptsname(master);
+	uart->peer = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+	fprintf(stderr, "USART on %s\n", name);
+
+	uart->host = master;
+	atomic_store(&uart->connected, true);
+
+	return 0;
+}
+
+/**
+ * Listens on a unix socket at the path for the host end, replacing whatever was there.
+ */
+static int listenSocket(uart_t* uart, const char* path) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: Socket path too long!\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	unlink(path);
+	if (fd == -1 || bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(fd, 1) != 0) {
+		perror(path);
+		if (fd != -1) close(fd);
+		return -1;
+	}
+
+	uart->listener = fd;
+	uart->path = strdup(path);
+
+	return 0;
+}
+
+/**
+ * Puts the machine's side of the USART as it is after a reset, waiting for a mode instruction.
+ */
+static void clearUart(uart_t* uart) {
+	uart->charTstates = 10 * uart->bitTstates; // 8 bits, a start and a stop, until a mode is set
+	uart->expectMode = true;
+	uart->syncChars = 0;
+	uart->command = 0x00;
+	uart->rxData = 0x00;
+	uart->rxFull = false;
+	uart->receiving = false;
+	uart->txDoneAt = 0;
+}
+
+int attachUart(machine_t* m, uint8_t port, const char* path, uint64_t bitTstates) {
+	uart_t* uart = (uart_t*) malloc(sizeof(uart_t));
+	uart->m = m;
+	uart->port = port;
+	uart->bitTstates = bitTstates;
+	clearUart(uart);
+	uart->watching = false;
+	atomic_init(&uart->rx.head, 0);
+	atomic_init(&uart->rx.tail, 0);
+	atomic_init(&uart->tx.head, 0);
+	atomic_init(&uart->tx.tail, 0);
+	atomic_init(&uart->sleeping, false);
+	atomic_init(&uart->stop, false);
+	atomic_init(&uart->connected, false);
+	uart->path = NULL;
+	uart->listener = -1;
+	uart->host = -1;
+	uart->peer = -1;
+
+	uart->rxTimer = addTimer(m, received, uart);
+	uart->doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	uart->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	int rc = (uart->rxTimer == -1 || uart->doorbell == -1 || uart->wake == -1) ? -1 :
+			path ? listenSocket(uart, path) : openPty(uart);
+	if (rc == 0 && pthread_create(&uart->thread, NULL, serve, uart) != 0) rc = -1;
+
+	if (rc != 0) {
+		fprintf(stderr, "Could not set up the USART\n");
+		if (uart->doorbell != -1) close(uart->doorbell);
+		if (uart->wake != -1) close(uart->wake);
+		if (uart->host != -1) close(uart->host);
+		if (uart->peer != -1) close(uart->peer);
+		if (uart->listener != -1) close(uart->listener);
+		free(uart->path);
+		free(uart);
+		return -1;
+	}
+
+	m->uart = uart;
+	attachPort(m->ports, port, dataIn, dataOut, uart);
+	attachPort(m->ports, port + UART_CONTROL_PORT, statusIn, controlOut, uart);
+
+	return 0;
+}
+
+void resetUart(machine_t* m) {
+	uart_t* uart = m->uart;
+
+	// What is on the rings stays there, only the machine's side is reset
+	clearUart(uart);
+	stopTimer(m, uart->rxTimer);
+	updateReceiver(uart);
+}
+
+void forkUart(machine_t* child, machine_t* m) {
+	uart_t* uart = m->uart;
+
+	attachPort(child->ports, uart->port, NULL, NULL, NULL);
+	attachPort(child->ports, uart->port + UART_CONTROL_PORT, NULL, NULL, NULL);
+	stopTimer(child, uart->rxTimer);
+}
+
+void freeUart(machine_t* m) {
+	uart_t* uart = m->uart;
+	if (!uart) return;
+
+	atomic_store(&uart->stop, true);
+	signalFd(uart->wake);
+	pthread_join(uart->thread, NULL);
+
+	if (uart->watching) unwatchFd(m, uart->doorbell);
+	close(uart->doorbell);
+	close(uart->wake);
+	if (uart->host != -1) close(uart->host);
+	if (uart->peer != -1) close(uart->peer);
+	if (uart->listener != -1) {
+		close(uart->listener);
+		unlink(uart->path);
+	}
+
+	free(uart->path);
+	free(uart);
+	m->uart = NULL;
+}
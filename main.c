@@ -2,37 +2,267 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <unistd.h>
 
 #include "machine.h"
-#include "aef-loadrun.h"
+#include "batch.h"
+#include "snapshot.h"
+#include "pit.h"
+#include "uart.h"
+#include "disk.h"
+#include "dma.h"
+#include "bank.h"
 
 
-machine_t guest;
+static void usage() {
+	fprintf(stderr, "usage: emu [--mode=fast|cycle] [--jit] [--profile-pairs] [--pic] [--pit[=tstates]] [--dma] [--device=plugin[:args]]...\n");
+	fprintf(stderr, "           [--uart[=socket] [--uart-baud=baud]] [--disk=image [--disk-sector=128|512]]\n");
+	fprintf(stderr, "           [--banks[=count] [--bank-size=bytes] [--bank-window=addr]...] [--clock=hz] [--wait-states=n]\n");
+	fprintf(stderr, "           [--save=snapshot] [--checkpoint=snapshot [--checkpoint-interval=tstates]] filename\n");
+	fprintf(stderr, "       emu [--mode=fast|cycle] [--jit] [--profile-pairs] [--pic] [--pit[=tstates]] [--dma] [--device=plugin[:args]]...\n");
+	fprintf(stderr, "           [--uart[=socket] [--uart-baud=baud]] [--disk=image [--disk-sector=128|512]]\n");
+	fprintf(stderr, "           [--banks[=count] [--bank-size=bytes] [--bank-window=addr]...] [--clock=hz] [--wait-states=n]\n");
+	fprintf(stderr, "           [--save=snapshot] [--checkpoint=snapshot [--checkpoint-interval=tstates]] --restore=snapshot\n");
+	fprintf(stderr, "       emu [--mode=fast|cycle] [--jit] [--wait-states=n] --batch manifest [-j workers]\n");
+	exit(-1);
+}
 
+int main(int argc, char* const argv[]) {
+	run_mode_t mode = FAST_MODE;
+	bool jit = false;
+	bool profile = false;
+	bool pic = false;
+	bool dma = false;
+	uint32_t pit = 0; // T-states a count takes, 0 for no timer
+	bool uart = false;
+	char* uartPath = NULL; // A pseudo-terminal if not given
+	uint64_t baud = UART_BAUD;
+	char* disk = NULL;
+	int sectorSize = DISK_SECTOR_SIZE;
+	int banks = 0; // Banks each window switches between, 0 for none
+	uint32_t bankSize = BANK_SIZE;
+	uint16_t windows[MAX_WINDOWS];
+	int numWindows = 0;
+	uint64_t clock = 0; // Unthrottled
+	int waitStates = 0;
+	char* manifest = NULL;
+	char* save = NULL;
+	char* restore = NULL;
+	char* checkpoint = NULL;
+	uint64_t interval = CHECKPOINT_INTERVAL;
+	int workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	char** devices = (char**) calloc(argc, sizeof(char*)); // Plugins to load, each with its arguments
+	int numDevices = 0;
 
-int main(int argc, char const* argv[]) {
-	if (argc != 2) {
-		fprintf(stderr, "usage: emu filename\n");
-		exit(-1);
+	static struct option longopts[] = {
+		{ "mode", required_argument, NULL, 'm' },
+		{ "jit", no_argument, NULL, 'J' },
+		{ "profile-pairs", no_argument, NULL, 'p' },
+		{ "batch", required_argument, NULL, 'b' },
+		{ "save", required_argument, NULL, 's' },
+		{ "restore", required_argument, NULL, 'r' },
+		{ "checkpoint", required_argument, NULL, 'c' },
+		{ "checkpoint-interval", required_argument, NULL, 'i' },
+		{ "device", required_argument, NULL, 'd' },
+		{ "pic", no_argument, NULL, 'P' },
+		{ "dma", no_argument, NULL, 'A' },
+		{ "pit", optional_argument, NULL, 'T' },
+		{ "uart", optional_argument, NULL, 'u' },
+		{ "uart-baud", required_argument, NULL, 'B' },
+		{ "disk", required_argument, NULL, 'D' },
+		{ "disk-sector", required_argument, NULL, 'S' },
+		{ "banks", optional_argument, NULL, 'K' },
+		{ "bank-size", required_argument, NULL, 'Z' },
+		{ "bank-window", required_argument, NULL, 'W' },
+		{ "clock", required_argument, NULL, 'C' },
+		{ "wait-states", required_argument, NULL, 'w' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "j:", longopts, NULL)) != -1) {
+		switch (opt) {
+			case 'm':
+				if (strcmp(optarg, "fast") == 0) mode = FAST_MODE;
+				else if (strcmp(optarg, "cycle") == 0) mode = CYCLE_MODE;
+				else usage();
+				break;
+			case 'J':
+				jit = true;
+				break;
+			case 'p':
+				profile = true;
+				break;
+			case 'b':
+				manifest = optarg;
+				break;
+			case 's':
+				save = optarg;
+				break;
+			case 'r':
+				restore = optarg;
+				break;
+			case 'c':
+				checkpoint = optarg;
+				break;
+			case 'i':
+				interval = strtoull(optarg, NULL, 0);
+				if (interval == 0) usage();
+				break;
+			case 'd':
+				devices[numDevices++] = optarg;
+				break;
+			case 'P':
+				pic = true;
+				break;
+			case 'A':
+				dma = true;
+				break;
+			case 'T':
+				pit = optarg ? strtoul(optarg, NULL, 0) : PIT_TSTATES;
+				if (pit == 0) usage();
+				break;
+			case 'u':
+				uart = true;
+				uartPath = optarg;
+				break;
+			case 'B':
+				baud = strtoull(optarg, NULL, 0);
+				if (baud == 0) usage();
+				break;
+			case 'D':
+				disk = optarg;
+				break;
+			case 'S':
+				sectorSize = atoi(optarg);
+				if (sectorSize != 128 && sectorSize != 512) usage();
+				break;
+			case 'K':
+				banks = optarg ? atoi(optarg) : BANK_COUNT;
+				if (banks < 2 || banks > MAX_BANKS) usage();
+				break;
+			case 'Z':
+				bankSize = strtoul(optarg, NULL, 0);
+				if (bankSize == 0) usage();
+				break;
+			case 'W':
+				if (numWindows == MAX_WINDOWS) usage();
+				windows[numWindows++] = strtoul(optarg, NULL, 0);
+				break;
+			case 'C':
+				clock = strtoull(optarg, NULL, 0);
+				if (clock == 0) usage();
+				break;
+			case 'w':
+				waitStates = atoi(optarg);
+				if (waitStates < 0 || waitStates > UINT8_MAX) usage();
+				break;
+			case 'j':
+				workers = atoi(optarg);
+				if (workers < 1) usage();
+				break;
+			default:
+				usage();
+		}
+	}
+
+	if (manifest) {
+		// Programs in the manifest are taken as they are, not from asm/
+		if (optind != argc || profile || save || restore || checkpoint || numDevices || pic || pit || dma || uart || disk || banks || clock) usage();
+
+		batch_opts_t opts = { mode, jit, waitStates, workers };
+		return runBatch(manifest, &opts);
 	}
 
+	// A restored machine carries on from the snapshot instead of loading a program
+	if (optind != argc - (restore ? 0 : 1)) usage();
+
 	// Add assembly files are in asm/
 	// Append it
 
-	size_t len = strlen(argv[1]);
-	char* filename = (char*) malloc(sizeof(char) * (len + 4 + 1));
-	sprintf(filename, "asm/%s", argv[1]);
+	char* filename = NULL;
+	if (!restore) {
+		size_t len = strlen(argv[optind]);
+		filename = (char*) malloc(sizeof(char) * (len + 4 + 1));
+		sprintf(filename, "asm/%s", argv[optind]);
+	}
+
+	machine_t* m = m80_create();
+	if (!m) {
+		fprintf(stderr, "Could not map memory for the machine\n");
+		exit(-1);
+	}
+	m->mode = mode;
+	m80_set_wait_states(m, waitStates);
+	if (clock) m80_set_clock(m, clock);
+
+	// Translated blocks run out of the block cache, so only in fast mode
+	if (jit && mode == FAST_MODE && !initJIT(m)) {
+		fprintf(stderr, "Host code translation is not supported here, interpreting\n");
+	}
+	if (profile) m->profile = (pair_profile_t*) calloc(1, sizeof(pair_profile_t));
+
+	// Devices loaded after may take the console's ports over
+	m80_attach_console(m, STDIN_FILENO, STDOUT_FILENO);
+	if (pic) m80_attach_pic(m, PIC_PORT);
+	if (pit) m80_attach_pit(m, PIT_PORT, pit);
+	if (dma) m80_attach_dma(m, DMA_PORT);
+
+	// The line rate is timed against the clock the run is kept to
+	uint64_t bitTstates = (clock ? clock : UART_CPU_HZ) / baud;
+	if (uart && m80_attach_uart(m, UART_PORT, uartPath, bitTstates ? bitTstates : 1) != 0) exit(-1);
+	// A window where most programs would have one unless they were put elsewhere
+	if (!numWindows) windows[numWindows++] = BANK_WINDOW;
+	if (banks && m80_attach_banks(m, BANK_PORT, windows, numWindows, bankSize, banks) != 0) exit(-1);
+	if (disk && m80_attach_disk(m, DISK_PORT, disk, sectorSize) != 0) exit(-1);
+
+	for (int i = 0; i < numDevices; i++) {
+		// Anything after the first colon is for the plugin
+		char* args = strchr(devices[i], ':');
+		if (args) *args++ = '\0';
 
-	initMachine();
+		if (m80_load_device(m, devices[i], args) != 0) exit(-1);
+	}
 
-	printf("Welcome to %s, ", guest.name);
+	printf("Welcome to %s, ", m->name);
 	printf("8080 Intel Processor\n");
 	printf("Loaded up with 64KB RAM\n");
 
-	uint16_t entry = loadAEF(filename);
-	int ret = runAEF(entry);
+	int ret;
+	if (restore) {
+		printf("Restoring snapshot\n");
+		if (m80_restore(m, restore) != 0) exit(-1);
+
+		if (checkpoint && m80_checkpoint(m, checkpoint, interval) != 0) exit(-1);
+
+		printf("Resuming\n");
+		// The console writes past stdio, so anything printed so far goes first
+		fflush(stdout);
+		ret = m80_resume(m);
+	} else {
+		printf("Loading AEF executable\n");
+		uint16_t entry;
+		if (m80_load(m, filename, &entry) != 0) exit(-1);
+
+		if (checkpoint && m80_checkpoint(m, checkpoint, interval) != 0) exit(-1);
+
+		printf("Running AEF executable\n");
+		fflush(stdout);
+		ret = m80_run(m, entry);
+	}
 
 	printf("Finished running\n");
+	dumpProc(m);
+
+	if (save && m80_save(m, save) != 0) ret = -1;
+
+	if (m->profile) reportPairs(m->profile, stdout);
+
+	m80_destroy(m);
+	free(filename);
+	free(devices);
 
 	return ret;
 }
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "blockcache.h"
+#include "instr-stages.h"
+#include "machine.h"
+#include "jit.h"
+
+
+#define HASH(pc) ((pc) & (BLOCK_BUCKETS - 1))
+#define PAGE(addr) ((uint16_t) (addr) >> MEM_PAGE_SHIFT)
+#define DDD(opcode) ((opcode >> 3) & 0x7) // Destination register field
+
+
+static bool endsBlock(opcode_t op) {
+	switch (op) {
+		case OP_JMP:
+		case OP_JCC:
+		case OP_CALL:
+		case OP_CCC:
+		case OP_RET:
+		case OP_RCC:
+		case OP_RST:
+		case OP_PCHL:
+		case OP_IN: // A device may raise an interrupt, taken straight after
+		case OP_OUT:
+		case OP_HLT:
+		case OP_ADR:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/**
+ * Gets whether the instruction changes nothing outside the registers and flags. Reads
+ * of memory and of devices are quiet, run again they give the same until something else changes.
+ */
+static bool isQuiet(const insn_t* insn) {
+	switch (insn->op) {
+		case OP_STAX: case OP_STA: case OP_SHLD: case OP_LDAX_STAX:
+		case OP_PUSH: case OP_CALL: case OP_CCC: case OP_RST: case OP_XTHL:
+		case OP_OUT: case OP_EI: case OP_DI: case OP_HLT: case OP_ADR:
+			return false;
+		case OP_MOV: case OP_MVI: case OP_INR: case OP_DCR:
+			return DDD(insn->opcode) != REG_M;
+		default:
+			return true;
+	}
+}
+
+/**
+ * Gets the page the block's last byte is on.
+ */
+static uint8_t lastPage(const block_t* blk) {
+	return PAGE(blk->end - 1);
+}
+
+static void linkPage(machine_t* m, block_t* blk, uint8_t page, int which) {
+	block_cache_t* cache = m->cache;
+
+	blk->pageNext[which] = cache->pages[page];
+	cache->pages[page] = blk;
+	m->mem->codePage[page] = true;
+	updatePage(m->mem, page);
+}
+
+static void unlinkPage(machine_t* m, block_t* blk, uint8_t page) {
+	block_cache_t* cache = m->cache;
+
+	// Each block in the list is linked through the field for whichever of its pages this is
+	block_t** link = &cache->pages[page];
+	while (*link != blk) {
+		block_t* curr = *link;
+		link = &curr->pageNext[PAGE(curr->start) == page ? 0 : 1];
+	}
+	*link = blk->pageNext[PAGE(blk->start) == page ? 0 : 1];
+
+	if (!cache->pages[page]) {
+		m->mem->codePage[page] = false;
+		updatePage(m->mem, page);
+	}
+}
+
+static void unlinkHash(machine_t* m, block_t* blk) {
+	block_t** link = &m->cache->buckets[HASH(blk->start)];
+	while (*link != blk) link = &(*link)->hashNext;
+	*link = blk->hashNext;
+}
+
+/**
+ * Drops the block from the cache, putting it back in the free list.
+ */
+static void dropBlock(machine_t* m, block_t* blk) {
+	unlinkHash(m, blk);
+	unlinkPage(m, blk, PAGE(blk->start));
+	if (lastPage(blk) != PAGE(blk->start)) unlinkPage(m, blk, lastPage(blk));
+
+	blk->valid = false;
+	blk->hashNext = m->cache->free;
+	m->cache->free = blk;
+}
+
+void initBlocks(machine_t* m) {
+	if (m->cache) return;
+
+	m->cache = (block_cache_t*) malloc(sizeof(block_cache_t));
+	flushBlocks(m);
+}
+
+void flushBlocks(machine_t* m) {
+	block_cache_t* cache = m->cache;
+
+	// Nothing has been cached yet
+	if (!cache) return;
+
+	for (int i = 0; i < BLOCK_BUCKETS; i++) cache->buckets[i] = NULL;
+	for (int i = 0; i < MEM_PAGES; i++) {
+		cache->pages[i] = NULL;
+		m->mem->codePage[i] = false;
+		updatePage(m->mem, i);
+	}
+
+	cache->free = NULL;
+	for (int i = MAX_BLOCKS - 1; i >= 0; i--) {
+		cache->pool[i].valid = false;
+		cache->pool[i].hashNext = cache->free;
+		cache->free = &cache->pool[i];
+	}
+
+	flushJIT(m);
+}
+
+/**
+ * Decodes the block starting at the address, adding it to the cache.
+ */
+static block_t* translateBlock(machine_t* m, uint16_t pc) {
+	block_cache_t* cache = m->cache;
+
+	if (!cache->free) flushBlocks(m);
+
+	block_t* blk = cache->free;
+	cache->free = blk->hashNext;
+
+	blk->start = pc;
+	blk->count = 0;
+	blk->succ[0] = NULL;
+	blk->succ[1] = NULL;
+	blk->hits = 0;
+	blk->native = NULL;
+
+	uint16_t addr = pc;
+	bool enabling = false;
+	while (blk->count < BLOCK_MAX_INSNS) {
+		insn_t* insn = &blk->insns[blk->count];
+		uint16_t next = decodeAt(m, addr, insn);
+
+		// Interrupts come in after the instruction following an EI, so the two are kept together
+		if (insn->op == OP_EI && blk->count == BLOCK_MAX_INSNS - 1) break;
+
+		// Common pairs run as one instruction, saving a dispatch
+		if (blk->count == 0 || !fuseInsns(insn - 1, insn)) blk->count++;
+
+		// Stop short of wrapping around the top of memory
+		bool wraps = next < addr;
+		addr = next;
+
+		if (endsBlock(insn->op) || wraps || enabling) break;
+		enabling = insn->op == OP_EI;
+	}
+	blk->end = addr;
+	blk->valid = true;
+
+	// Fused pairs are looked at whole, only LDAX_STAX has a half that writes
+	blk->quiet = true;
+	for (int i = 0; i < blk->count; i++) blk->quiet = blk->quiet && isQuiet(&blk->insns[i]);
+
+	blk->hashNext = cache->buckets[HASH(pc)];
+	cache->buckets[HASH(pc)] = blk;
+
+	linkPage(m, blk, PAGE(blk->start), 0);
+	if (lastPage(blk) != PAGE(blk->start)) linkPage(m, blk, lastPage(blk), 1);
+
+	return blk;
+}
+
+static block_t* lookupBlock(machine_t* m, uint16_t pc) {
+	block_t* blk = m->cache->buckets[HASH(pc)];
+	while (blk && blk->start != pc) blk = blk->hashNext;
+
+	return blk ? blk : translateBlock(m, pc);
+}
+
+block_t* nextBlock(machine_t* m, block_t* prev) {
+	uint16_t pc = m->proc->PC;
+
+	if (!prev) return lookupBlock(m, pc);
+
+	int which = (pc == prev->end) ? 0 : 1;
+
+	block_t* succ = prev->succ[which];
+	if (succ && succ->valid && succ->start == pc) return succ;
+
+	succ = lookupBlock(m, pc);
+	prev->succ[which] = succ;
+
+	return succ;
+}
+
+void invalidateCode(machine_t* m, uint16_t addr) {
+	block_t* blk = m->cache->pages[PAGE(addr)];
+
+	while (blk) {
+		block_t* next = blk->pageNext[PAGE(blk->start) == PAGE(addr) ? 0 : 1];
+
+		// Only the blocks actually covering the address, data may share a page with code
+		if ((uint16_t) (addr - blk->start) < (uint16_t) (blk->end - blk->start)) dropBlock(m, blk);
+
+		blk = next;
+	}
+}
+
+void invalidatePage(machine_t* m, uint8_t page) {
+	while (m->cache->pages[page]) dropBlock(m, m->cache->pages[page]);
+}
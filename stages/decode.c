@@ -0,0 +1,433 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "instr-stages.h"
+#include "machine.h"
+#include "hardware.h"
+
+
+/**
+ * Decoding information for every opcode, indexed by the opcode.
+ * Undocumented opcodes (marked *) are decoded as the instructions they alias on the 8080, with
+ * the same size and T-states.
+ */
+static const insn_info_t decodeTable[256] = {
+	{ OP_NOP, 1, 4 },     // 0x00 NOP
+	{ OP_LXI, 3, 10 },    // 0x01 LXI B
+	{ OP_STAX, 1, 7 },    // 0x02 STAX B
+	{ OP_INX, 1, 5 },     // 0x03 INX B
+	{ OP_INR, 1, 5 },     // 0x04 INR B
+	{ OP_DCR, 1, 5 },     // 0x05 DCR B
+	{ OP_MVI, 2, 7 },     // 0x06 MVI B
+	{ OP_RLC, 1, 4 },     // 0x07 RLC
+	{ OP_NOP, 1, 4 },     // 0x08 *NOP
+	{ OP_DAD, 1, 10 },    // 0x09 DAD B
+	{ OP_LDAX, 1, 7 },    // 0x0a LDAX B
+	{ OP_DCX, 1, 5 },     // 0x0b DCX B
+	{ OP_INR, 1, 5 },     // 0x0c INR C
+	{ OP_DCR, 1, 5 },     // 0x0d DCR C
+	{ OP_MVI, 2, 7 },     // 0x0e MVI C
+	{ OP_RRC, 1, 4 },     // 0x0f RRC
+	{ OP_NOP, 1, 4 },     // 0x10 *NOP
+	{ OP_LXI, 3, 10 },    // 0x11 LXI D
+	{ OP_STAX, 1, 7 },    // 0x12 STAX D
+	{ OP_INX, 1, 5 },     // 0x13 INX D
+	{ OP_INR, 1, 5 },     // 0x14 INR D
+	{ OP_DCR, 1, 5 },     // 0x15 DCR D
+	{ OP_MVI, 2, 7 },     // 0x16 MVI D
+	{ OP_RAL, 1, 4 },     // 0x17 RAL
+	{ OP_NOP, 1, 4 },     // 0x18 *NOP
+	{ OP_DAD, 1, 10 },    // 0x19 DAD D
+	{ OP_LDAX, 1, 7 },    // 0x1a LDAX D
+	{ OP_DCX, 1, 5 },     // 0x1b DCX D
+	{ OP_INR, 1, 5 },     // 0x1c INR E
+	{ OP_DCR, 1, 5 },     // 0x1d DCR E
+	{ OP_MVI, 2, 7 },     // 0x1e MVI E
+	{ OP_RAR, 1, 4 },     // 0x1f RAR
+	{ OP_NOP, 1, 4 },     // 0x20 *NOP
+	{ OP_LXI, 3, 10 },    // 0x21 LXI H
+	{ OP_SHLD, 3, 16 },   // 0x22 SHLD
+	{ OP_INX, 1, 5 },     // 0x23 INX H
+	{ OP_INR, 1, 5 },     // 0x24 INR H
+	{ OP_DCR, 1, 5 },     // 0x25 DCR H
+	{ OP_MVI, 2, 7 },     // 0x26 MVI H
+	{ OP_DAA, 1, 4 },     // 0x27 DAA
+	{ OP_NOP, 1, 4 },     // 0x28 *NOP
+	{ OP_DAD, 1, 10 },    // 0x29 DAD H
+	{ OP_LHLD, 3, 16 },   // 0x2a LHLD
+	{ OP_DCX, 1, 5 },     // 0x2b DCX H
+	{ OP_INR, 1, 5 },     // 0x2c INR L
+	{ OP_DCR, 1, 5 },     // 0x2d DCR L
+	{ OP_MVI, 2, 7 },     // 0x2e MVI L
+	{ OP_CMA, 1, 4 },     // 0x2f CMA
+	{ OP_NOP, 1, 4 },     // 0x30 *NOP
+	{ OP_LXI, 3, 10 },    // 0x31 LXI SP
+	{ OP_STA, 3, 13 },    // 0x32 STA
+	{ OP_INX, 1, 5 },     // 0x33 INX SP
+	{ OP_INR, 1, 10 },    // 0x34 INR M
+	{ OP_DCR, 1, 10 },    // 0x35 DCR M
+	{ OP_MVI, 2, 10 },    // 0x36 MVI M
+	{ OP_STC, 1, 4 },     // 0x37 STC
+	{ OP_NOP, 1, 4 },     // 0x38 *NOP
+	{ OP_DAD, 1, 10 },    // 0x39 DAD SP
+	{ OP_LDA, 3, 13 },    // 0x3a LDA
+	{ OP_DCX, 1, 5 },     // 0x3b DCX SP
+	{ OP_INR, 1, 5 },     // 0x3c INR A
+	{ OP_DCR, 1, 5 },     // 0x3d DCR A
+	{ OP_MVI, 2, 7 },     // 0x3e MVI A
+	{ OP_CMC, 1, 4 },     // 0x3f CMC
+	{ OP_MOV, 1, 5 },     // 0x40 MOV B,B
+	{ OP_MOV, 1, 5 },     // 0x41 MOV B,C
+	{ OP_MOV, 1, 5 },     // 0x42 MOV B,D
+	{ OP_MOV, 1, 5 },     // 0x43 MOV B,E
+	{ OP_MOV, 1, 5 },     // 0x44 MOV B,H
+	{ OP_MOV, 1, 5 },     // 0x45 MOV B,L
+	{ OP_MOV, 1, 7 },     // 0x46 MOV B,M
+	{ OP_MOV, 1, 5 },     // 0x47 MOV B,A
+	{ OP_MOV, 1, 5 },     // 0x48 MOV C,B
+	{ OP_MOV, 1, 5 },     // 0x49 MOV C,C
+	{ OP_MOV, 1, 5 },     // 0x4a MOV C,D
+	{ OP_MOV, 1, 5 },     // 0x4b MOV C,E
+	{ OP_MOV, 1, 5 },     // 0x4c MOV C,H
+	{ OP_MOV, 1, 5 },     // 0x4d MOV C,L
+	{ OP_MOV, 1, 7 },     // 0x4e MOV C,M
+	{ OP_MOV, 1, 5 },     // 0x4f MOV C,A
+	{ OP_MOV, 1, 5 },     // 0x50 MOV D,B
+	{ OP_MOV, 1, 5 },     // 0x51 MOV D,C
+	{ OP_MOV, 1, 5 },     // 0x52 MOV D,D
+	{ OP_MOV, 1, 5 },     // 0x53 MOV D,E
+	{ OP_MOV, 1, 5 },     // 0x54 MOV D,H
+	{ OP_MOV, 1, 5 },     // 0x55 MOV D,L
+	{ OP_MOV, 1, 7 },     // 0x56 MOV D,M
+	{ OP_MOV, 1, 5 },     // 0x57 MOV D,A
+	{ OP_MOV, 1, 5 },     // 0x58 MOV E,B
+	{ OP_MOV, 1, 5 },     // 0x59 MOV E,C
+	{ OP_MOV, 1, 5 },     // 0x5a MOV E,D
+	{ OP_MOV, 1, 5 },     // 0x5b MOV E,E
+	{ OP_MOV, 1, 5 },     // 0x5c MOV E,H
+	{ OP_MOV, 1, 5 },     // 0x5d MOV E,L
+	{ OP_MOV, 1, 7 },     // 0x5e MOV E,M
+	{ OP_MOV, 1, 5 },     // 0x5f MOV E,A
+	{ OP_MOV, 1, 5 },     // 0x60 MOV H,B
+	{ OP_MOV, 1, 5 },     // 0x61 MOV H,C
+	{ OP_MOV, 1, 5 },     // 0x62 MOV H,D
+	{ OP_MOV, 1, 5 },     // 0x63 MOV H,E
+	{ OP_MOV, 1, 5 },     // 0x64 MOV H,H
+	{ OP_MOV, 1, 5 },     // 0x65 MOV H,L
+	{ OP_MOV, 1, 7 },     // 0x66 MOV H,M
+	{ OP_MOV, 1, 5 },     // 0x67 MOV H,A
+	{ OP_MOV, 1, 5 },     // 0x68 MOV L,B
+	{ OP_MOV, 1, 5 },     // 0x69 MOV L,C
+	{ OP_MOV, 1, 5 },     // 0x6a MOV L,D
+	{ OP_MOV, 1, 5 },     // 0x6b MOV L,E
+	{ OP_MOV, 1, 5 },     // 0x6c MOV L,H
+	{ OP_MOV, 1, 5 },     // 0x6d MOV L,L
+	{ OP_MOV, 1, 7 },     // 0x6e MOV L,M
+	{ OP_MOV, 1, 5 },     // 0x6f MOV L,A
+	{ OP_MOV, 1, 7 },     // 0x70 MOV M,B
+	{ OP_MOV, 1, 7 },     // 0x71 MOV M,C
+	{ OP_MOV, 1, 7 },     // 0x72 MOV M,D
+	{ OP_MOV, 1, 7 },     // 0x73 MOV M,E
+	{ OP_MOV, 1, 7 },     // 0x74 MOV M,H
+	{ OP_MOV, 1, 7 },     // 0x75 MOV M,L
+	{ OP_HLT, 1, 7 },     // 0x76 HLT
+	{ OP_MOV, 1, 7 },     // 0x77 MOV M,A
+	{ OP_MOV, 1, 5 },     // 0x78 MOV A,B
+	{ OP_MOV, 1, 5 },     // 0x79 MOV A,C
+	{ OP_MOV, 1, 5 },     // 0x7a MOV A,D
+	{ OP_MOV, 1, 5 },     // 0x7b MOV A,E
+	{ OP_MOV, 1, 5 },     // 0x7c MOV A,H
+	{ OP_MOV, 1, 5 },     // 0x7d MOV A,L
+	{ OP_MOV, 1, 7 },     // 0x7e MOV A,M
+	{ OP_MOV, 1, 5 },     // 0x7f MOV A,A
+	{ OP_ADD, 1, 4 },     // 0x80 ADD B
+	{ OP_ADD, 1, 4 },     // 0x81 ADD C
+	{ OP_ADD, 1, 4 },     // 0x82 ADD D
+	{ OP_ADD, 1, 4 },     // 0x83 ADD E
+	{ OP_ADD, 1, 4 },     // 0x84 ADD H
+	{ OP_ADD, 1, 4 },     // 0x85 ADD L
+	{ OP_ADD, 1, 7 },     // 0x86 ADD M
+	{ OP_ADD, 1, 4 },     // 0x87 ADD A
+	{ OP_ADC, 1, 4 },     // 0x88 ADC B
+	{ OP_ADC, 1, 4 },     // 0x89 ADC C
+	{ OP_ADC, 1, 4 },     // 0x8a ADC D
+	{ OP_ADC, 1, 4 },     // 0x8b ADC E
+	{ OP_ADC, 1, 4 },     // 0x8c ADC H
+	{ OP_ADC, 1, 4 },     // 0x8d ADC L
+	{ OP_ADC, 1, 7 },     // 0x8e ADC M
+	{ OP_ADC, 1, 4 },     // 0x8f ADC A
+	{ OP_SUB, 1, 4 },     // 0x90 SUB B
+	{ OP_SUB, 1, 4 },     // 0x91 SUB C
+	{ OP_SUB, 1, 4 },     // 0x92 SUB D
+	{ OP_SUB, 1, 4 },     // 0x93 SUB E
+	{ OP_SUB, 1, 4 },     // 0x94 SUB H
+	{ OP_SUB, 1, 4 },     // 0x95 SUB L
+	{ OP_SUB, 1, 7 },     // 0x96 SUB M
+	{ OP_SUB, 1, 4 },     // 0x97 SUB A
+	{ OP_SBB, 1, 4 },     // 0x98 SBB B
+	{ OP_SBB, 1, 4 },     // 0x99 SBB C
+	{ OP_SBB, 1, 4 },     // 0x9a SBB D
+	{ OP_SBB, 1, 4 },     // 0x9b SBB E
+	{ OP_SBB, 1, 4 },     // 0x9c SBB H
+	{ OP_SBB, 1, 4 },     // 0x9d SBB L
+	{ OP_SBB, 1, 7 },     // 0x9e SBB M
+	{ OP_SBB, 1, 4 },     // 0x9f SBB A
+	{ OP_ANA, 1, 4 },     // 0xa0 ANA B
+	{ OP_ANA, 1, 4 },     // 0xa1 ANA C
+	{ OP_ANA, 1, 4 },     // 0xa2 ANA D
+	{ OP_ANA, 1, 4 },     // 0xa3 ANA E
+	{ OP_ANA, 1, 4 },     // 0xa4 ANA H
+	{ OP_ANA, 1, 4 },     // 0xa5 ANA L
+	{ OP_ANA, 1, 7 },     // 0xa6 ANA M
+	{ OP_ANA, 1, 4 },     // 0xa7 ANA A
+	{ OP_XRA, 1, 4 },     // 0xa8 XRA B
+	{ OP_XRA, 1, 4 },     // 0xa9 XRA C
+	{ OP_XRA, 1, 4 },     // 0xaa XRA D
+	{ OP_XRA, 1, 4 },     // 0xab XRA E
+	{ OP_XRA, 1, 4 },     // 0xac XRA H
+	{ OP_XRA, 1, 4 },     // 0xad XRA L
+	{ OP_XRA, 1, 7 },     // 0xae XRA M
+	{ OP_XRA, 1, 4 },     // 0xaf XRA A
+	{ OP_ORA, 1, 4 },     // 0xb0 ORA B
+	{ OP_ORA, 1, 4 },     // 0xb1 ORA C
+	{ OP_ORA, 1, 4 },     // 0xb2 ORA D
+	{ OP_ORA, 1, 4 },     // 0xb3 ORA E
+	{ OP_ORA, 1, 4 },     // 0xb4 ORA H
+	{ OP_ORA, 1, 4 },     // 0xb5 ORA L
+	{ OP_ORA, 1, 7 },     // 0xb6 ORA M
+	{ OP_ORA, 1, 4 },     // 0xb7 ORA A
+	{ OP_CMP, 1, 4 },     // 0xb8 CMP B
+	{ OP_CMP, 1, 4 },     // 0xb9 CMP C
+	{ OP_CMP, 1, 4 },     // 0xba CMP D
+	{ OP_CMP, 1, 4 },     // 0xbb CMP E
+	{ OP_CMP, 1, 4 },     // 0xbc CMP H
+	{ OP_CMP, 1, 4 },     // 0xbd CMP L
+	{ OP_CMP, 1, 7 },     // 0xbe CMP M
+	{ OP_CMP, 1, 4 },     // 0xbf CMP A
+	{ OP_RCC, 1, 5 },     // 0xc0 RNZ
+	{ OP_POP, 1, 10 },    // 0xc1 POP B
+	{ OP_JCC, 3, 10 },    // 0xc2 JNZ
+	{ OP_JMP, 3, 10 },    // 0xc3 JMP
+	{ OP_CCC, 3, 11 },    // 0xc4 CNZ
+	{ OP_PUSH, 1, 11 },   // 0xc5 PUSH B
+	{ OP_ADI, 2, 7 },     // 0xc6 ADI
+	{ OP_RST, 1, 11 },    // 0xc7 RST 0
+	{ OP_RCC, 1, 5 },     // 0xc8 RZ
+	{ OP_RET, 1, 10 },    // 0xc9 RET
+	{ OP_JCC, 3, 10 },    // 0xca JZ
+	{ OP_JMP, 3, 10 },    // 0xcb *JMP
+	{ OP_CCC, 3, 11 },    // 0xcc CZ
+	{ OP_CALL, 3, 17 },   // 0xcd CALL
+	{ OP_ACI, 2, 7 },     // 0xce ACI
+	{ OP_RST, 1, 11 },    // 0xcf RST 1
+	{ OP_RCC, 1, 5 },     // 0xd0 RNC
+	{ OP_POP, 1, 10 },    // 0xd1 POP D
+	{ OP_JCC, 3, 10 },    // 0xd2 JNC
+	{ OP_OUT, 2, 10 },    // 0xd3 OUT
+	{ OP_CCC, 3, 11 },    // 0xd4 CNC
+	{ OP_PUSH, 1, 11 },   // 0xd5 PUSH D
+	{ OP_SUI, 2, 7 },     // 0xd6 SUI
+	{ OP_RST, 1, 11 },    // 0xd7 RST 2
+	{ OP_RCC, 1, 5 },     // 0xd8 RC
+	{ OP_RET, 1, 10 },    // 0xd9 *RET
+	{ OP_JCC, 3, 10 },    // 0xda JC
+	{ OP_IN, 2, 10 },     // 0xdb IN
+	{ OP_CCC, 3, 11 },    // 0xdc CC
+	{ OP_CALL, 3, 17 },   // 0xdd *CALL
+	{ OP_SBI, 2, 7 },     // 0xde SBI
+	{ OP_RST, 1, 11 },    // 0xdf RST 3
+	{ OP_RCC, 1, 5 },     // 0xe0 RPO
+	{ OP_POP, 1, 10 },    // 0xe1 POP H
+	{ OP_JCC, 3, 10 },    // 0xe2 JPO
+	{ OP_XTHL, 1, 18 },   // 0xe3 XTHL
+	{ OP_CCC, 3, 11 },    // 0xe4 CPO
+	{ OP_PUSH, 1, 11 },   // 0xe5 PUSH H
+	{ OP_ANI, 2, 7 },     // 0xe6 ANI
+	{ OP_RST, 1, 11 },    // 0xe7 RST 4
+	{ OP_RCC, 1, 5 },     // 0xe8 RPE
+	{ OP_PCHL, 1, 5 },    // 0xe9 PCHL
+	{ OP_JCC, 3, 10 },    // 0xea JPE
+	{ OP_XCHG, 1, 4 },    // 0xeb XCHG
+	{ OP_CCC, 3, 11 },    // 0xec CPE
+	{ OP_CALL, 3, 17 },   // 0xed *CALL
+	{ OP_XRI, 2, 7 },     // 0xee XRI
+	{ OP_RST, 1, 11 },    // 0xef RST 5
+	{ OP_RCC, 1, 5 },     // 0xf0 RP
+	{ OP_POP, 1, 10 },    // 0xf1 POP PSW
+	{ OP_JCC, 3, 10 },    // 0xf2 JP
+	{ OP_DI, 1, 4 },      // 0xf3 DI
+	{ OP_CCC, 3, 11 },    // 0xf4 CP
+	{ OP_PUSH, 1, 11 },   // 0xf5 PUSH PSW
+	{ OP_ORI, 2, 7 },     // 0xf6 ORI
+	{ OP_RST, 1, 11 },    // 0xf7 RST 6
+	{ OP_RCC, 1, 5 },     // 0xf8 RM
+	{ OP_SPHL, 1, 5 },    // 0xf9 SPHL
+	{ OP_JCC, 3, 10 },    // 0xfa JM
+	{ OP_EI, 1, 4 },      // 0xfb EI
+	{ OP_CCC, 3, 11 },    // 0xfc CM
+	{ OP_CALL, 3, 17 },   // 0xfd *CALL
+	{ OP_CPI, 2, 7 },     // 0xfe CPI
+	{ OP_RST, 1, 11 },    // 0xff RST 7
+};
+
+/**
+ * Reads a data byte of the instruction.
+ * @param addr The address of the data byte
+ */
+static uint8_t readData(machine_t* m, uint16_t addr) {
+	if (m->mode == FAST_MODE) return readMem(m, addr, false);
+
+	return readCycle(m, addr, false);
+}
+
+#define DDD(opcode) ((opcode >> 3) & 0x7) // Destination register field
+#define SSS(opcode) (opcode & 0x7) // Source register field
+
+uint8_t busCycles(const insn_t* insn) {
+	bool dstM = DDD(insn->opcode) == REG_M;
+	bool srcM = SSS(insn->opcode) == REG_M;
+
+	// The fetch and the data bytes
+	uint8_t cycles = insn->size;
+
+	switch (insn->op) {
+		case OP_LDAX: case OP_STAX: case OP_LDA: case OP_STA: case OP_IN: case OP_OUT:
+			return cycles + 1;
+		case OP_MOV:
+			return cycles + (dstM || srcM);
+		case OP_MVI:
+			return cycles + dstM;
+		case OP_ADD: case OP_ADC: case OP_SUB: case OP_SBB: case OP_ANA: case OP_XRA: case OP_ORA: case OP_CMP:
+			return cycles + srcM;
+		case OP_INR: case OP_DCR:
+			return cycles + 2 * dstM;
+		case OP_LHLD: case OP_SHLD: case OP_PUSH: case OP_POP: case OP_CALL: case OP_RET: case OP_RST:
+			return cycles + 2;
+		case OP_XTHL:
+			return cycles + 4;
+		default:
+			// Conditional calls and returns add their stack cycles only when taken
+			return cycles;
+	}
+}
+
+void decode(machine_t* m, insn_t* insn) {
+	const insn_info_t* info = &decodeTable[m->proc->IR];
+
+	insn->op = info->op;
+	insn->opcode = m->proc->IR;
+	insn->size = info->size;
+	insn->tstates = info->tstates;
+	insn->tstates2 = 0;
+
+	insn->data = 0x0000;
+
+	// Data bytes are read in as byte 2 into Z and byte 3 into W
+	if (info->size > 1) {
+		m->proc->tempreg[REG_Z] = readData(m, m->proc->PC + 1);
+		insn->data = m->proc->tempreg[REG_Z];
+	}
+	if (info->size > 2) {
+		m->proc->tempreg[REG_W] = readData(m, m->proc->PC + 2);
+		insn->data |= m->proc->tempreg[REG_W] << 8;
+	}
+}
+
+uint16_t decodeAt(machine_t* m, uint16_t addr, insn_t* insn) {
+	uint8_t* const* pages = m->mem->tables[0].read;
+	uint8_t bytes[3];
+	int size = 1;
+
+	for (int i = 0; i < size; i++) {
+		uint16_t at = addr + i;
+		uint8_t* host = pages[at >> MEM_PAGE_SHIFT];
+
+		// Code is only ran out of memory, anything else faults once the block gets to it
+		if (!host) {
+			insn->op = OP_ADR;
+			insn->opcode = 0x00;
+			insn->size = 0;
+			insn->tstates = 0;
+			insn->data = 0x0000;
+			return addr;
+		}
+
+		bytes[i] = host[at & (MEM_PAGE_SIZE - 1)];
+		if (i == 0) size = decodeTable[bytes[0]].size;
+	}
+
+	const insn_info_t* info = &decodeTable[bytes[0]];
+
+	insn->op = info->op;
+	insn->opcode = bytes[0];
+	insn->size = info->size;
+	insn->tstates = info->tstates;
+	insn->tstates2 = 0;
+
+	// Nothing goes over the bus to wait on it, so the wait states are counted up front
+	insn->tstates += busCycles(insn) * m->waitStates;
+
+	insn->data = 0x0000;
+	if (info->size > 1) insn->data = bytes[1];
+	if (info->size > 2) insn->data |= bytes[2] << 8;
+
+	return addr + info->size;
+}
+
+#define OPCODE_JNZ 0xC2
+#define OPCODE_MOV_A_M 0x7E
+#define OPCODE_INX_H 0x23
+
+bool fuseInsns(insn_t* first, const insn_t* second) {
+	opcode_t op;
+
+	// The first of a pair never writes memory, so its code can't change under the second
+	if (first->op == OP_DCR && DDD(first->opcode) != REG_M && second->opcode == OPCODE_JNZ) op = OP_DCR_JNZ;
+	else if (first->opcode == OPCODE_MOV_A_M && second->opcode == OPCODE_INX_H) op = OP_MOV_INX;
+	else if (first->op == OP_LDAX && second->op == OP_STAX) op = OP_LDAX_STAX;
+	else if (first->op == OP_MVI && DDD(first->opcode) != REG_M &&
+			second->op == OP_MVI && DDD(second->opcode) != REG_M) op = OP_MVI_MVI;
+	else return false;
+
+	// The data bytes of both, in the order they are in memory
+	if (first->size > 1) first->data |= second->data << ((first->size - 1) * 8);
+	else first->data = second->data;
+
+	first->op = op;
+	first->opcode2 = second->opcode;
+	first->tstates2 = second->tstates;
+	first->size += second->size;
+	first->tstates += second->tstates;
+
+	return true;
+}
+
+int unfuseInsn(const insn_t* insn, insn_t parts[2]) {
+	if (insn->op < OP_DCR_JNZ) {
+		parts[0] = *insn;
+		return 1;
+	}
+
+	uint8_t opcodes[2] = { insn->opcode, insn->opcode2 };
+	uint16_t data = insn->data;
+
+	for (int i = 0; i < 2; i++) {
+		const insn_info_t* info = &decodeTable[opcodes[i]];
+
+		parts[i].op = info->op;
+		parts[i].opcode = opcodes[i];
+		parts[i].size = info->size;
+		parts[i].opcode2 = 0x00;
+		parts[i].tstates2 = 0;
+
+		// Each takes its own data bytes off the bottom
+		parts[i].data = data & ((1 << ((info->size - 1) * 8)) - 1);
+		data >>= (info->size - 1) * 8;
+	}
+
+	// Taken as decoded, with any wait states
+	parts[0].tstates = insn->tstates - insn->tstates2;
+	parts[1].tstates = insn->tstates2;
+
+	return 2;
+}
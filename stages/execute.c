@@ -0,0 +1,484 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "instr-stages.h"
+#include "machine.h"
+#include "hardware.h"
+#include "flags.h"
+#include "blockcache.h"
+
+
+// GCC and Clang support taking the address of a label, letting each operation
+// be jumped to straight from a table instead of going through a switch's bounds check
+#if defined(__GNUC__)
+#define COMPUTED_GOTO
+#endif
+
+// Every instruction advances the PC past itself and counts its T-states before its operation runs
+#define BEGIN() do { \
+	m->proc->PC += insn->size; \
+	m->proc->cycles += insn->tstates; \
+	opcode = insn->opcode; \
+	data = insn->data; \
+} while (0)
+
+// With computed goto, each operation jumps straight to the next one's, so the
+// branch predictor learns which operation tends to follow which
+#ifdef COMPUTED_GOTO
+#define TARGET(op) L_##op
+#define NEXT do { \
+	if (++insn == end || !*valid) return; \
+	BEGIN(); \
+	goto *dispatch[insn->op]; \
+} while (0)
+#else
+#define TARGET(op) case op
+#define NEXT break
+#endif
+
+#define DDD(opcode) ((opcode >> 3) & 0x7) // Destination register field
+#define SSS(opcode) (opcode & 0x7) // Source register field
+#define RP(opcode) ((opcode >> 4) & 0x3) // Register pair field
+#define CCC(opcode) ((opcode >> 3) & 0x7) // Condition field
+
+#define ACCUM (m->proc->alureg[ACC]) // The accumulator
+
+// Extra T-states taken by a conditional call or return when its condition is met
+#define COND_TAKEN_TSTATES 6
+
+// Along with the wait states of the two stack cycles it adds, counted here in fast mode and by the bus in cycle mode
+#define COND_TAKEN(m) (COND_TAKEN_TSTATES + ((m)->mode == FAST_MODE ? 2 * (m)->waitStates : 0))
+
+
+/**
+ * Reads memory, going through a machine cycle only in cycle mode.
+ * @param addr The address to read
+ * @param stack Whether the address comes from the stack pointer
+ * @return The byte read
+ */
+static uint8_t load(machine_t* m, uint16_t addr, bool stack) {
+	if (m->mode == FAST_MODE) return readMem(m, addr, stack);
+
+	return readCycle(m, addr, stack);
+}
+
+/**
+ * Writes memory, going through a machine cycle only in cycle mode.
+ * @param addr The address to write
+ * @param data The byte to write
+ * @param stack Whether the address comes from the stack pointer
+ */
+static void store(machine_t* m, uint16_t addr, uint8_t data, bool stack) {
+	if (m->mode == FAST_MODE) writeMem(m, addr, data, stack);
+	else writeCycle(m, addr, data, stack);
+}
+
+/**
+ * Reads from the device on the port, going through a machine cycle only in cycle mode.
+ * @param port The port
+ * @return The byte read
+ */
+static uint8_t input(machine_t* m, uint8_t port) {
+	if (m->mode == FAST_MODE) return portIn(m->ports, port);
+
+	return inCycle(m, port);
+}
+
+/**
+ * Writes to the device on the port, going through a machine cycle only in cycle mode.
+ * @param port The port
+ * @param data The byte to write
+ */
+static void output(machine_t* m, uint8_t port, uint8_t data) {
+	if (m->mode == FAST_MODE) portOut(m->ports, port, data);
+	else outCycle(m, port, data);
+}
+
+static uint16_t getPair(machine_t* m, uint8_t rp) {
+	if (rp == PAIR_SP) return m->proc->SP;
+
+	return (m->proc->gpr[rp * 2] << 8) | m->proc->gpr[rp * 2 + 1];
+}
+
+static void setPair(machine_t* m, uint8_t rp, uint16_t val) {
+	if (rp == PAIR_SP) {
+		m->proc->SP = val;
+		return;
+	}
+
+	m->proc->gpr[rp * 2] = val >> 8;
+	m->proc->gpr[rp * 2 + 1] = val & 0xFF;
+}
+
+static uint8_t getReg(machine_t* m, uint8_t r) {
+	if (r == REG_A) return ACCUM;
+	if (r == REG_M) return load(m, getPair(m, PAIR_H), false);
+
+	return m->proc->gpr[r];
+}
+
+static void setReg(machine_t* m, uint8_t r, uint8_t val) {
+	if (r == REG_A) ACCUM = val;
+	else if (r == REG_M) store(m, getPair(m, PAIR_H), val, false);
+	else m->proc->gpr[r] = val;
+}
+
+static void push(machine_t* m, uint16_t val) {
+	m->proc->SP--;
+	store(m, m->proc->SP, val >> 8, true);
+	m->proc->SP--;
+	store(m, m->proc->SP, val & 0xFF, true);
+}
+
+static uint16_t pop(machine_t* m) {
+	uint8_t lo = load(m, m->proc->SP++, true);
+	uint8_t hi = load(m, m->proc->SP++, true);
+
+	return (hi << 8) | lo;
+}
+
+static bool checkCond(machine_t* m, uint8_t cc) {
+	switch (cc) {
+		case C_NZ: return !getZ(m);
+		case C_Z: return getZ(m);
+		case C_NC: return !getCY(m);
+		case C_C: return getCY(m);
+		case C_PO: return !getP(m);
+		case C_PE: return getP(m);
+		case C_P: return !getS(m);
+		default: return getS(m); // C_M
+	}
+}
+
+/**
+ * Runs the operand through the ALU with the accumulator, updating the flags.
+ * @param aluop The operation
+ * @param operand The second operand
+ * @param store Whether the result is written back to the accumulator (false for compares)
+ */
+static void aluAcc(machine_t* m, alu_op_t aluop, uint8_t operand, bool store) {
+	m->proc->alureg[ACC_LATCH] = ACCUM;
+	m->proc->alureg[TEMP] = operand;
+
+	alu(m, aluop, true);
+
+	if (store) ACCUM = DataBus(m);
+}
+
+/**
+ * Runs a single register through the ALU, as done by INR and DCR.
+ * @param aluop The operation
+ * @param r The register
+ */
+static void aluReg(machine_t* m, alu_op_t aluop, uint8_t r) {
+	m->proc->alureg[ACC_LATCH] = getReg(m, r);
+	m->proc->alureg[TEMP] = 0x0;
+
+	alu(m, aluop, true);
+
+	setReg(m, r, DataBus(m));
+}
+
+/**
+ * Takes back the second instruction of a fused pair whose first faulted, so the
+ * program stops right after the instruction that made the access.
+ */
+static void unfuseFault(machine_t* m, const insn_t* insn) {
+	insn_t parts[2];
+	unfuseInsn(insn, parts);
+
+	m->proc->PC -= parts[1].size;
+	m->proc->cycles -= parts[1].tstates;
+}
+
+/**
+ * Executes the instructions from `insn` up to `end`, stopping early if `*valid` gets cleared.
+ */
+static void run(machine_t* m, const insn_t* insn, const insn_t* end, const bool* valid) {
+	uint8_t opcode;
+	uint16_t data;
+
+#ifdef COMPUTED_GOTO
+	static const void* const dispatch[NUM_OPS] = {
+		[OP_NOP] = &&L_OP_NOP, [OP_LXI] = &&L_OP_LXI, [OP_STAX] = &&L_OP_STAX, [OP_INX] = &&L_OP_INX,
+		[OP_INR] = &&L_OP_INR, [OP_DCR] = &&L_OP_DCR, [OP_MVI] = &&L_OP_MVI, [OP_RLC] = &&L_OP_RLC,
+		[OP_RRC] = &&L_OP_RRC, [OP_RAL] = &&L_OP_RAL, [OP_RAR] = &&L_OP_RAR, [OP_DAD] = &&L_OP_DAD,
+		[OP_LDAX] = &&L_OP_LDAX, [OP_DCX] = &&L_OP_DCX, [OP_SHLD] = &&L_OP_SHLD, [OP_LHLD] = &&L_OP_LHLD,
+		[OP_DAA] = &&L_OP_DAA, [OP_CMA] = &&L_OP_CMA, [OP_STA] = &&L_OP_STA, [OP_LDA] = &&L_OP_LDA,
+		[OP_STC] = &&L_OP_STC, [OP_CMC] = &&L_OP_CMC, [OP_MOV] = &&L_OP_MOV, [OP_HLT] = &&L_OP_HLT,
+		[OP_ADD] = &&L_OP_ADD, [OP_ADC] = &&L_OP_ADC, [OP_SUB] = &&L_OP_SUB, [OP_SBB] = &&L_OP_SBB,
+		[OP_ANA] = &&L_OP_ANA, [OP_XRA] = &&L_OP_XRA, [OP_ORA] = &&L_OP_ORA, [OP_CMP] = &&L_OP_CMP,
+		[OP_RCC] = &&L_OP_RCC, [OP_POP] = &&L_OP_POP, [OP_JCC] = &&L_OP_JCC, [OP_JMP] = &&L_OP_JMP,
+		[OP_CCC] = &&L_OP_CCC, [OP_PUSH] = &&L_OP_PUSH, [OP_ADI] = &&L_OP_ADI, [OP_ACI] = &&L_OP_ACI,
+		[OP_SUI] = &&L_OP_SUI, [OP_SBI] = &&L_OP_SBI, [OP_ANI] = &&L_OP_ANI, [OP_XRI] = &&L_OP_XRI,
+		[OP_ORI] = &&L_OP_ORI, [OP_CPI] = &&L_OP_CPI, [OP_RST] = &&L_OP_RST, [OP_RET] = &&L_OP_RET,
+		[OP_CALL] = &&L_OP_CALL, [OP_OUT] = &&L_OP_OUT, [OP_IN] = &&L_OP_IN, [OP_XTHL] = &&L_OP_XTHL,
+		[OP_PCHL] = &&L_OP_PCHL, [OP_XCHG] = &&L_OP_XCHG, [OP_DI] = &&L_OP_DI, [OP_SPHL] = &&L_OP_SPHL,
+		[OP_EI] = &&L_OP_EI, [OP_ADR] = &&L_OP_ADR,
+		[OP_DCR_JNZ] = &&L_OP_DCR_JNZ, [OP_MOV_INX] = &&L_OP_MOV_INX,
+		[OP_LDAX_STAX] = &&L_OP_LDAX_STAX, [OP_MVI_MVI] = &&L_OP_MVI_MVI
+	};
+
+	BEGIN();
+	goto *dispatch[insn->op];
+#else
+	for (;;) {
+	BEGIN();
+	switch (insn->op) {
+#endif
+
+	TARGET(OP_NOP):
+		NEXT;
+	TARGET(OP_LXI):
+		setPair(m, RP(opcode), data);
+		NEXT;
+	TARGET(OP_STAX):
+		store(m, getPair(m, RP(opcode)), ACCUM, false);
+		NEXT;
+	TARGET(OP_INX):
+		setPair(m, RP(opcode), getPair(m, RP(opcode)) + 1);
+		NEXT;
+	TARGET(OP_INR):
+		aluReg(m, INC_OP, DDD(opcode));
+		NEXT;
+	TARGET(OP_DCR):
+		aluReg(m, DEC_OP, DDD(opcode));
+		NEXT;
+	TARGET(OP_MVI):
+		setReg(m, DDD(opcode), data & 0xFF);
+		NEXT;
+	TARGET(OP_RLC):
+		aluAcc(m, RLC_OP, 0x0, true);
+		NEXT;
+	TARGET(OP_RRC):
+		aluAcc(m, RRC_OP, 0x0, true);
+		NEXT;
+	TARGET(OP_RAL):
+		aluAcc(m, RAL_OP, 0x0, true);
+		NEXT;
+	TARGET(OP_RAR):
+		aluAcc(m, RAR_OP, 0x0, true);
+		NEXT;
+	TARGET(OP_DAD): {
+		uint32_t sum = getPair(m, PAIR_H) + getPair(m, RP(opcode));
+		setPair(m, PAIR_H, sum & 0xFFFF);
+		setCY(m, (sum >> 16) & 0x1);
+		NEXT;
+	}
+	TARGET(OP_LDAX):
+		ACCUM = load(m, getPair(m, RP(opcode)), false);
+		NEXT;
+	TARGET(OP_DCX):
+		setPair(m, RP(opcode), getPair(m, RP(opcode)) - 1);
+		NEXT;
+	TARGET(OP_SHLD):
+		store(m, data, m->proc->gpr[REG_L], false);
+		store(m, data + 1, m->proc->gpr[REG_H], false);
+		NEXT;
+	TARGET(OP_LHLD):
+		m->proc->gpr[REG_L] = load(m, data, false);
+		m->proc->gpr[REG_H] = load(m, data + 1, false);
+		NEXT;
+	TARGET(OP_DAA):
+		aluAcc(m, DAA_OP, 0x0, true);
+		NEXT;
+	TARGET(OP_CMA):
+		ACCUM = ~ACCUM;
+		NEXT;
+	TARGET(OP_STA):
+		store(m, data, ACCUM, false);
+		NEXT;
+	TARGET(OP_LDA):
+		ACCUM = load(m, data, false);
+		NEXT;
+	TARGET(OP_STC):
+		setCY(m, true);
+		NEXT;
+	TARGET(OP_CMC):
+		setCY(m, !getCY(m));
+		NEXT;
+	TARGET(OP_MOV):
+		setReg(m, DDD(opcode), getReg(m, SSS(opcode)));
+		NEXT;
+	TARGET(OP_HLT):
+		State(m).statusSigs.HLTA = true;
+		m->proc->status = STAT_HLT;
+		NEXT;
+	TARGET(OP_ADD):
+		aluAcc(m, PLUS_OP, getReg(m, SSS(opcode)), true);
+		NEXT;
+	TARGET(OP_ADC):
+		aluAcc(m, PLUS_CY_OP, getReg(m, SSS(opcode)), true);
+		NEXT;
+	TARGET(OP_SUB):
+		aluAcc(m, MINUS_OP, getReg(m, SSS(opcode)), true);
+		NEXT;
+	TARGET(OP_SBB):
+		aluAcc(m, MINUS_CY_OP, getReg(m, SSS(opcode)), true);
+		NEXT;
+	TARGET(OP_ANA):
+		aluAcc(m, AND_OP, getReg(m, SSS(opcode)), true);
+		NEXT;
+	TARGET(OP_XRA):
+		aluAcc(m, XOR_OP, getReg(m, SSS(opcode)), true);
+		NEXT;
+	TARGET(OP_ORA):
+		aluAcc(m, OR_OP, getReg(m, SSS(opcode)), true);
+		NEXT;
+	TARGET(OP_CMP):
+		aluAcc(m, MINUS_OP, getReg(m, SSS(opcode)), false);
+		NEXT;
+	TARGET(OP_RCC):
+		if (checkCond(m, CCC(opcode))) {
+			m->proc->PC = pop(m);
+			m->proc->cycles += COND_TAKEN(m);
+		}
+		NEXT;
+	TARGET(OP_POP): {
+		uint16_t val = pop(m);
+
+		if (RP(opcode) == PAIR_SP) {
+			// PSW, the fixed bits of the flag word cannot be changed
+			ACCUM = val >> 8;
+			setEflags(m, (val & (FLAG_S | FLAG_Z | FLAG_AC | FLAG_P | FLAG_CY)) | FLAG_1);
+		} else setPair(m, RP(opcode), val);
+		NEXT;
+	}
+	TARGET(OP_JCC):
+		if (checkCond(m, CCC(opcode))) m->proc->PC = data;
+		NEXT;
+	TARGET(OP_JMP):
+		m->proc->PC = data;
+		NEXT;
+	TARGET(OP_CCC):
+		if (checkCond(m, CCC(opcode))) {
+			push(m, m->proc->PC);
+			m->proc->PC = data;
+			m->proc->cycles += COND_TAKEN(m);
+		}
+		NEXT;
+	TARGET(OP_PUSH):
+		if (RP(opcode) == PAIR_SP) push(m, (ACCUM << 8) | getEflags(m));
+		else push(m, getPair(m, RP(opcode)));
+		NEXT;
+	TARGET(OP_ADI):
+		aluAcc(m, PLUS_OP, data, true);
+		NEXT;
+	TARGET(OP_ACI):
+		aluAcc(m, PLUS_CY_OP, data, true);
+		NEXT;
+	TARGET(OP_SUI):
+		aluAcc(m, MINUS_OP, data, true);
+		NEXT;
+	TARGET(OP_SBI):
+		aluAcc(m, MINUS_CY_OP, data, true);
+		NEXT;
+	TARGET(OP_ANI):
+		aluAcc(m, AND_OP, data, true);
+		NEXT;
+	TARGET(OP_XRI):
+		aluAcc(m, XOR_OP, data, true);
+		NEXT;
+	TARGET(OP_ORI):
+		aluAcc(m, OR_OP, data, true);
+		NEXT;
+	TARGET(OP_CPI):
+		aluAcc(m, MINUS_OP, data, false);
+		NEXT;
+	TARGET(OP_RST):
+		push(m, m->proc->PC);
+		m->proc->PC = opcode & 0x38;
+		NEXT;
+	TARGET(OP_RET):
+		m->proc->PC = pop(m);
+		NEXT;
+	TARGET(OP_CALL):
+		push(m, m->proc->PC);
+		m->proc->PC = data;
+		NEXT;
+	TARGET(OP_OUT):
+		output(m, data & 0xFF, ACCUM);
+		NEXT;
+	TARGET(OP_IN):
+		ACCUM = input(m, data & 0xFF);
+		NEXT;
+	TARGET(OP_XTHL): {
+		uint8_t lo = load(m, m->proc->SP, true);
+		uint8_t hi = load(m, m->proc->SP + 1, true);
+		store(m, m->proc->SP, m->proc->gpr[REG_L], true);
+		store(m, m->proc->SP + 1, m->proc->gpr[REG_H], true);
+		m->proc->gpr[REG_L] = lo;
+		m->proc->gpr[REG_H] = hi;
+		NEXT;
+	}
+	TARGET(OP_PCHL):
+		m->proc->PC = getPair(m, PAIR_H);
+		NEXT;
+	TARGET(OP_XCHG): {
+		uint16_t de = getPair(m, PAIR_D);
+		setPair(m, PAIR_D, getPair(m, PAIR_H));
+		setPair(m, PAIR_H, de);
+		NEXT;
+	}
+	TARGET(OP_DI):
+		State(m).ctrSigs.INTE = false;
+		updateInterrupts(m);
+		NEXT;
+	TARGET(OP_SPHL):
+		m->proc->SP = getPair(m, PAIR_H);
+		NEXT;
+	TARGET(OP_EI):
+		State(m).ctrSigs.INTE = true;
+		m->intr->enabledAt = m->proc->cycles;
+		updateInterrupts(m);
+		NEXT;
+	TARGET(OP_ADR):
+		m->proc->status = STAT_ADR;
+		NEXT;
+
+	// Fused pairs, each doing exactly what its two instructions do
+	TARGET(OP_DCR_JNZ):
+		aluReg(m, DEC_OP, DDD(opcode));
+		if (!getZ(m)) m->proc->PC = data;
+		NEXT;
+	TARGET(OP_MOV_INX):
+		ACCUM = load(m, getPair(m, PAIR_H), false);
+		if (m->proc->status != STAT_OK) {
+			unfuseFault(m, insn);
+			NEXT;
+		}
+		setPair(m, PAIR_H, getPair(m, PAIR_H) + 1);
+		NEXT;
+	TARGET(OP_LDAX_STAX):
+		ACCUM = load(m, getPair(m, RP(opcode)), false);
+		if (m->proc->status != STAT_OK) {
+			unfuseFault(m, insn);
+			NEXT;
+		}
+		store(m, getPair(m, RP(insn->opcode2)), ACCUM, false);
+		NEXT;
+	TARGET(OP_MVI_MVI):
+		setReg(m, DDD(opcode), data & 0xFF);
+		setReg(m, DDD(insn->opcode2), data >> 8);
+		NEXT;
+
+#ifndef COMPUTED_GOTO
+		default:
+			m->proc->status = STAT_INS;
+			NEXT;
+	}
+
+	if (++insn == end || !*valid) return;
+	}
+#endif
+}
+
+void execute(machine_t* m, const insn_t* insn) {
+	static const bool always = true;
+
+	run(m, insn, insn + 1, &always);
+}
+
+void executeBlock(machine_t* m, const insn_t* insns, int count, const bool* valid) {
+	run(m, insns, insns + count, valid);
+}
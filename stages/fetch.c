@@ -5,39 +5,47 @@
 #include "machine.h"
 #include "hardware.h"
 
-extern machine_t guest;
 
-void fetch() {
-	State.statusSigs._WO = true;
-	State.statusSigs.M1 = true;
-	State.statusSigs.MEMR = true;
+void fetch(machine_t* m) {
+	if (m->mode == FAST_MODE) {
+		// No status word nor bus, the opcode is read straight out of memory
+		m->proc->IR = readMem(m, m->proc->PC, false);
+		return;
+	}
+
+	State(m).statusSigs.INTA = false;
+	State(m).statusSigs._WO = true;
+	State(m).statusSigs.STACK = false;
+	State(m).statusSigs.OUT = false;
+	State(m).statusSigs.M1 = true;
+	State(m).statusSigs.INP = false;
+	State(m).statusSigs.MEMR = true;
 
-	State.ctrSigs._WR = true;
+	State(m).ctrSigs._WR = true;
 
 	// T1
-	AddrBus = guest.proc->PC;
-	sendStatusToData();
+	AddrBus(m) = m->proc->PC;
+	sendStatusToData(m);
 
-	// printf("AddrBus: 0x%x; DataBus: 0x%x\n", AddrBus, DataBus);
+	// printf("AddrBus: 0x%x; DataBus: 0x%x\n", AddrBus(m), DataBus(m));
 
 	// T2
-	State.ctrSigs.DBIN = true;
-	latchStatus();
+	State(m).ctrSigs.DBIN = true;
+	latchStatus(m);
 
-	// printf("CtrlBus: 0x%x\n", CtrlBus);
+	// printf("CtrlBus: 0x%x\n", CtrlBus(m));
 
-	if (State.statusSigs.HLTA) {
-		// Enter halt state
-		// For now, it means subsequent functions are not ran
-		State.ctrSigs.INTE = true;
-		State.ctrSigs.WAIT = true;
+	if (State(m).statusSigs.HLTA) {
+		// Halted, nothing is fetched until an interrupt brings the processor out
+		State(m).ctrSigs.WAIT = true;
 		return;
 	}
 
 	// Processor entering TW state
-	mem();
+	mem(m);
 
 	// T3
-	State.intdatabus = DataBus;
-	guest.proc->IR = State.intdatabus;
+	State(m).intdatabus = DataBus(m);
+	State(m).ctrSigs.DBIN = false;
+	m->proc->IR = State(m).intdatabus;
 }
\ No newline at end of file
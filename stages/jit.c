@@ -0,0 +1,637 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+#include "instr-stages.h"
+#include "machine.h"
+#include "hardware.h"
+#include "flags.h"
+#include "blockcache.h"
+
+
+#if defined(__x86_64__)
+
+#include <cpuid.h>
+
+// For the length of a block the guest registers live in the host registers the 8086 inherited
+// them as: A in AL, BC in CX, DE in DX, and HL in BX. The flags are kept in AH, where LAHF and
+// SAHF use the same layout as the 8080 flag word, only the auxiliary carry differing for some
+// operations. RDI holds the processor, RSI guest memory, R13 the machine for calls back into
+// the emulator, and R12D counts down the loop budget. EBP, R10 and R11 are scratch.
+
+// Host 8-bit registers
+enum { H_AL, H_CL, H_DL, H_BL, H_AH, H_CH, H_DH, H_BH };
+// Host 16-bit registers
+enum { H_CX = 1, H_DX, H_BX };
+
+// Host register for each register field, M has none
+static const int8_t hostReg[8] = { H_CH, H_CL, H_DH, H_DL, H_BH, H_BL, -1, H_AL };
+// Host register for the B, D, and H pairs
+static const int8_t hostPair[3] = { H_CX, H_DX, H_BX };
+
+#define DDD(opcode) ((opcode >> 3) & 0x7)
+#define SSS(opcode) (opcode & 0x7)
+#define RP(opcode) ((opcode >> 4) & 0x3)
+#define CCC(opcode) ((opcode >> 3) & 0x7)
+
+#define PROC_OFF(field) ((uint32_t) offsetof(proc_t, field))
+#define MACHINE_OFF(field) ((uint32_t) offsetof(machine_t, field))
+#define READ_TABLE_OFF ((uint32_t) offsetof(mem_t, tables[0].read))
+#define WRITE_TABLE_OFF ((uint32_t) offsetof(mem_t, tables[0].write))
+
+// ModRM for [rsi + rbp] followed by its SIB byte
+#define MEM_HL(reg) (((reg) << 3) | 0x4), 0x2E
+
+// An exit out of line at the end of the block, jumped to from where it is taken
+typedef struct pendingExit {
+	size_t at; // The jump to patch
+	uint16_t pc;
+	uint32_t tstates;
+	int ran;
+} pending_exit_t;
+
+typedef struct emitter {
+	uint8_t* code;
+	size_t len;
+	pending_exit_t exits[BLOCK_MAX_INSNS * 2];
+	int numExits;
+} emitter_t;
+
+#define EMIT(e, ...) do { \
+	const uint8_t bytes[] = { __VA_ARGS__ }; \
+	emitBytes(e, bytes, sizeof(bytes)); \
+} while (0)
+
+static void emitBytes(emitter_t* e, const uint8_t* bytes, size_t n) {
+	memcpy(e->code + e->len, bytes, n);
+	e->len += n;
+}
+
+static void emit16(emitter_t* e, uint16_t v) {
+	EMIT(e, v & 0xFF, v >> 8);
+}
+
+static void emit32(emitter_t* e, uint32_t v) {
+	EMIT(e, v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF, v >> 24);
+}
+
+static void emit64(emitter_t* e, uint64_t v) {
+	emit32(e, (uint32_t) v);
+	emit32(e, (uint32_t) (v >> 32));
+}
+
+/**
+ * Emits the ModRM byte and displacement for [rdi + off], a field of the processor.
+ */
+static void emitProc(emitter_t* e, uint8_t reg, uint32_t off) {
+	EMIT(e, 0x80 | (reg << 3) | 0x7);
+	emit32(e, off);
+}
+
+/**
+ * Emits a 32-bit relative jump, returning where its displacement is to be patched.
+ * @param cc The second opcode byte (0x8x) of a conditional jump, 0 for an unconditional one
+ */
+static size_t emitJump(emitter_t* e, uint8_t cc) {
+	if (cc) EMIT(e, 0x0F, cc);
+	else EMIT(e, 0xE9);
+
+	emit32(e, 0);
+	return e->len - 4;
+}
+
+static void patchJump(emitter_t* e, size_t at, size_t target) {
+	int32_t rel = (int32_t) (target - (at + 4));
+	memcpy(e->code + at, &rel, 4);
+}
+
+static void emitCall(emitter_t* e, void* fn) {
+	EMIT(e, 0x48, 0xB8); // mov rax, fn
+	emit64(e, (uint64_t) (uintptr_t) fn);
+	EMIT(e, 0xFF, 0xD0); // call rax
+}
+
+static void emitLoadRegs(emitter_t* e) {
+	for (int r = REG_B; r <= REG_L; r++) {
+		EMIT(e, 0x8A);
+		emitProc(e, hostReg[r], PROC_OFF(gpr) + r);
+	}
+	EMIT(e, 0x8A);
+	emitProc(e, H_AL, PROC_OFF(alureg) + ACC);
+	EMIT(e, 0x8A);
+	emitProc(e, H_AH, PROC_OFF(eflags));
+}
+
+/**
+ * Emits the return to the run loop, writing the registers back with the flags already evaluated.
+ * @param pc The PC to leave
+ * @param tstates T-states not yet counted
+ * @param ran Instructions of the block ran on the last pass
+ */
+static void emitExit(emitter_t* e, uint16_t pc, uint32_t tstates, int ran) {
+	EMIT(e, 0x66, 0xC7);
+	emitProc(e, 0, PROC_OFF(PC));
+	emit16(e, pc);
+
+	if (tstates) {
+		EMIT(e, 0x48, 0x81);
+		emitProc(e, 0, PROC_OFF(cycles));
+		emit32(e, tstates);
+	}
+
+	for (int r = REG_B; r <= REG_L; r++) {
+		EMIT(e, 0x88);
+		emitProc(e, hostReg[r], PROC_OFF(gpr) + r);
+	}
+	EMIT(e, 0x88);
+	emitProc(e, H_AL, PROC_OFF(alureg) + ACC);
+	EMIT(e, 0x88);
+	emitProc(e, H_AH, PROC_OFF(eflags));
+	EMIT(e, 0xC7);
+	emitProc(e, 0, PROC_OFF(lazy.op));
+	emit32(e, FLAGS_NONE);
+
+	EMIT(e, 0xB8); // mov eax, ran
+	emit32(e, ran);
+	EMIT(e, 0x48, 0x83, 0xC4, 0x08); // add rsp, 8
+	EMIT(e, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3); // pop r13, pop r12, pop rbp, pop rbx, ret
+}
+
+/**
+ * Emits the page table lookup for an access to guest memory at EBP, leaving the block before the
+ * instruction making it when the page is not host memory or its stores need tracking, so the
+ * interpreter makes it instead. EBP is left so [RSI + RBP] addresses the byte on the host.
+ * @param write Whether the access is a store
+ * @param pc The PC of the instruction
+ * @param tstates T-states not yet counted before it
+ * @param ran Instructions of the block ran before it
+ */
+static void emitAccessCheck(emitter_t* e, bool write, uint16_t pc, uint32_t tstates, int ran) {
+	EMIT(e, 0x41, 0x89, 0xEB); // mov r11d, ebp
+	EMIT(e, 0x41, 0xC1, 0xEB, MEM_PAGE_SHIFT); // shr r11d, MEM_PAGE_SHIFT
+	EMIT(e, 0x4D, 0x8B, 0x95); // mov r10, [r13 + mem]
+	emit32(e, MACHINE_OFF(mem));
+	EMIT(e, 0x4F, 0x8B, 0x94, 0xDA); // mov r10, [r10 + r11 * 8 + table]
+	emit32(e, write ? WRITE_TABLE_OFF : READ_TABLE_OFF);
+	EMIT(e, 0x4D, 0x85, 0xD2); // test r10, r10
+
+	pending_exit_t* exit = &e->exits[e->numExits++];
+	exit->at = emitJump(e, 0x84); // je
+	exit->pc = pc;
+	exit->tstates = tstates;
+	exit->ran = ran;
+
+	// Rebased on guest memory, as the page's host memory need not be where it is in there
+	EMIT(e, 0x40, 0x0F, 0xB6, 0xED); // movzx ebp, bpl
+	EMIT(e, 0x4C, 0x01, 0xD5); // add rbp, r10
+	EMIT(e, 0x48, 0x29, 0xF5); // sub rbp, rsi
+}
+
+// x86 opcodes for the operation on AL and a register, the memory and immediate forms are at +2 and +4
+static uint8_t aluOpcode(opcode_t op) {
+	switch (op) {
+		case OP_ADD: case OP_ADI: return 0x00;
+		case OP_ADC: case OP_ACI: return 0x10;
+		case OP_SUB: case OP_SUI: return 0x28;
+		case OP_SBB: case OP_SBI: return 0x18;
+		case OP_ANA: case OP_ANI: return 0x20;
+		case OP_XRA: case OP_XRI: return 0x30;
+		case OP_ORA: case OP_ORI: return 0x08;
+		default: return 0x38; // CMP and CPI
+	}
+}
+
+/**
+ * Emits an arithmetic or logical operation on the accumulator, with the address in EBP for M.
+ * @param capture Whether its flags are read before being replaced
+ */
+static void emitAlu(emitter_t* e, const insn_t* insn, bool capture) {
+	opcode_t op = insn->op;
+	uint8_t base = aluOpcode(op);
+	bool imm = op >= OP_ADI;
+	uint8_t src = SSS(insn->opcode);
+
+	if (op == OP_ANA || op == OP_ANI) {
+		// The auxiliary carry is bit 3 of either operand, so the operand goes through EBP
+		if (imm) {
+			EMIT(e, 0xBD); // mov ebp, imm
+			emit32(e, insn->data & 0xFF);
+		} else if (src == REG_M) {
+			EMIT(e, 0x0F, 0xB6, 0x2C, 0x2E); // movzx ebp, byte [rsi + rbp]
+		} else EMIT(e, 0x0F, 0xB6, 0xE8 | hostReg[src]); // movzx ebp, reg
+
+		EMIT(e, 0x41, 0x89, 0xC3, 0x41, 0x09, 0xEB); // mov r11d, eax, or r11d, ebp
+		EMIT(e, 0x40, 0x20, 0xE8); // and al, bpl
+		if (capture) {
+			EMIT(e, 0x9F, 0x80, 0xE4, (uint8_t) ~FLAG_AC); // lahf, and ah, ~AC
+			EMIT(e, 0x41, 0x83, 0xE3, 0x08, 0x41, 0xC1, 0xE3, 0x09); // and r11d, 8, shl r11d, 9
+			EMIT(e, 0x44, 0x09, 0xD8); // or eax, r11d
+		}
+		return;
+	}
+
+	// The carry in is taken from the flag word
+	if (op == OP_ADC || op == OP_ACI || op == OP_SBB || op == OP_SBI) EMIT(e, 0x9E); // sahf
+
+	if (imm) EMIT(e, base + 4, insn->data & 0xFF);
+	else if (src == REG_M) EMIT(e, base + 2, MEM_HL(H_AL));
+	else EMIT(e, base, 0xC0 | (hostReg[src] << 3));
+
+	if (!capture) return;
+
+	EMIT(e, 0x9F); // lahf
+	switch (op) {
+		case OP_SUB: case OP_SUI: case OP_SBB: case OP_SBI: case OP_CMP: case OP_CPI:
+			// x86 sets the auxiliary carry on a borrow, the 8080 on a carry of the complement
+			EMIT(e, 0x80, 0xF4, FLAG_AC); // xor ah, AC
+			break;
+		case OP_XRA: case OP_XRI: case OP_ORA: case OP_ORI:
+			EMIT(e, 0x80, 0xE4, (uint8_t) ~FLAG_AC); // and ah, ~AC
+			break;
+		default:
+			break;
+	}
+}
+
+/**
+ * Checks the instruction can be translated.
+ */
+static bool translatable(const insn_t* insn) {
+	switch (insn->op) {
+		case OP_NOP: case OP_LXI: case OP_INX: case OP_DCX: case OP_DAD:
+		case OP_LDAX: case OP_STAX: case OP_LDA: case OP_STA:
+		case OP_MVI: case OP_MOV: case OP_INR: case OP_DCR:
+		case OP_ADD: case OP_ADC: case OP_SUB: case OP_SBB: case OP_ANA: case OP_XRA: case OP_ORA: case OP_CMP:
+		case OP_ADI: case OP_ACI: case OP_SUI: case OP_SBI: case OP_ANI: case OP_XRI: case OP_ORI: case OP_CPI:
+		case OP_XCHG: case OP_CMA: case OP_STC: case OP_CMC:
+		case OP_JMP: case OP_JCC:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Instructions replacing every flag
+static bool writesFlags(const insn_t* insn) {
+	return (insn->op >= OP_ADD && insn->op <= OP_CMP) || (insn->op >= OP_ADI && insn->op <= OP_CPI);
+}
+
+// Instructions needing the flag word as it is, including those changing only some flags
+static bool readsFlags(const insn_t* insn) {
+	switch (insn->op) {
+		case OP_INR: case OP_DCR: case OP_DAD: case OP_STC: case OP_CMC:
+		case OP_ADC: case OP_ACI: case OP_SBB: case OP_SBI: case OP_JCC:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Instructions that may leave the block before accessing memory
+static bool accessesMemory(const insn_t* insn) {
+	switch (insn->op) {
+		case OP_LDAX: case OP_STAX: case OP_LDA: case OP_STA:
+			return true;
+		case OP_MOV:
+			return DDD(insn->opcode) == REG_M || SSS(insn->opcode) == REG_M;
+		case OP_MVI: case OP_INR: case OP_DCR:
+			return DDD(insn->opcode) == REG_M;
+		default:
+			return insn->op >= OP_ADD && insn->op <= OP_CMP && SSS(insn->opcode) == REG_M;
+	}
+}
+
+static bool writesMemory(const insn_t* insn) {
+	switch (insn->op) {
+		case OP_STAX: case OP_STA:
+			return true;
+		case OP_MOV: case OP_MVI: case OP_INR: case OP_DCR:
+			return DDD(insn->opcode) == REG_M;
+		default:
+			return false;
+	}
+}
+
+/**
+ * Emits the address the instruction accesses into EBP.
+ */
+static void emitAddr(emitter_t* e, const insn_t* insn) {
+	switch (insn->op) {
+		case OP_LDAX: case OP_STAX:
+			EMIT(e, 0x0F, 0xB7, 0xE8 | hostPair[RP(insn->opcode)]); // movzx ebp, pair
+			break;
+		case OP_LDA: case OP_STA:
+			EMIT(e, 0xBD); // mov ebp, addr
+			emit32(e, insn->data);
+			break;
+		default:
+			EMIT(e, 0x0F, 0xB7, 0xE8 | H_BX); // movzx ebp, bx
+			break;
+	}
+}
+
+/**
+ * Emits the jump at the end of a block, looping straight back when it targets the block itself.
+ */
+static void emitBranch(emitter_t* e, const block_t* blk, size_t entry, uint16_t target, uint32_t tstates) {
+	if (target != blk->start) {
+		emitExit(e, target, tstates, blk->count);
+		return;
+	}
+
+	EMIT(e, 0x48, 0x81);
+	emitProc(e, 0, PROC_OFF(cycles));
+	emit32(e, tstates);
+
+	// A device timer can come due partway through the budget, so the loop stops at the next event too
+	EMIT(e, 0x4D, 0x8B, 0x95); // mov r10, [r13 + nextEvent]
+	emit32(e, (uint32_t) offsetof(machine_t, nextEvent));
+	EMIT(e, 0x4C, 0x39);
+	emitProc(e, 2, PROC_OFF(cycles)); // cmp [cycles], r10
+	size_t due = emitJump(e, 0x83); // jae
+
+	EMIT(e, 0x41, 0xFF, 0xCC); // dec r12d
+	patchJump(e, emitJump(e, 0x85), entry); // jnz
+	patchJump(e, due, e->len);
+
+	// Out of budget, the run loop gets to check for anything it needs to
+	emitExit(e, blk->start, 0, blk->count);
+}
+
+/**
+ * Translates the leading instructions of the block the translator supports.
+ * @return The host code, or NULL if the first instruction is not supported
+ */
+static native_block_t translate(block_t* blk, jit_buf_t* buf) {
+	// Fused pairs are translated as the instructions they were made of
+	insn_t insns[BLOCK_MAX_INSNS * 2];
+	int owner[BLOCK_MAX_INSNS * 2]; // The block instruction each came from
+	int count = 0;
+
+	int n = 0;
+	while (n < blk->count) {
+		insn_t parts[2];
+		int k = unfuseInsn(&blk->insns[n], parts);
+
+		bool ok = true;
+		for (int j = 0; j < k; j++) ok = ok && translatable(&parts[j]);
+		if (!ok) break;
+
+		for (int j = 0; j < k; j++) {
+			insns[count] = parts[j];
+			owner[count++] = n;
+		}
+		n++;
+	}
+	if (n == 0 || buf->used + JIT_MAX_BLOCK_CODE > buf->size) return NULL;
+
+	// The flags from an operation are only evaluated when something reads them before they are replaced,
+	// leaving before an access to memory counting as reading them from before the instruction
+	bool capture[BLOCK_MAX_INSNS * 2];
+	bool live = true;
+	bool exits = false;
+	for (int i = count - 1; i >= 0; i--) {
+		const insn_t* insn = &insns[i];
+
+		capture[i] = live;
+
+		if (writesFlags(insn)) live = false;
+		if (readsFlags(insn)) live = true;
+
+		exits = exits || accessesMemory(insn);
+		if (exits && (i == 0 || owner[i - 1] != owner[i])) {
+			live = true;
+			exits = false;
+		}
+	}
+
+	emitter_t e = { buf->code + buf->used, 0, { { 0 } }, 0 };
+
+	// Keeps the stack 16 byte aligned for calls
+	EMIT(&e, 0x53, 0x55, 0x41, 0x54, 0x41, 0x55); // push rbx, rbp, r12, r13
+	EMIT(&e, 0x48, 0x83, 0xEC, 0x08); // sub rsp, 8
+	EMIT(&e, 0x49, 0x89, 0xD5); // mov r13, rdx
+	EMIT(&e, 0x41, 0xBC); // mov r12d, budget
+	emit32(&e, JIT_LOOP_BUDGET);
+
+	// Evaluates any pending flags before taking the flag word
+	EMIT(&e, 0x83);
+	emitProc(&e, 7, PROC_OFF(lazy.op));
+	EMIT(&e, FLAGS_NONE);
+	size_t ready = emitJump(&e, 0x84); // je
+	EMIT(&e, 0x56, 0x57, 0x4C, 0x89, 0xEF); // push rsi, rdi, mov rdi, r13
+	emitCall(&e, getEflags);
+	EMIT(&e, 0x5F, 0x5E); // pop rdi, rsi
+	patchJump(&e, ready, e.len);
+
+	emitLoadRegs(&e);
+	size_t entry = e.len;
+
+	uint16_t pc = blk->start;
+	uint32_t tstates = 0;
+	uint16_t startPc = pc;
+	uint32_t startTstates = 0;
+
+	for (int i = 0; i < count; i++) {
+		const insn_t* insn = &insns[i];
+		uint8_t opcode = insn->opcode;
+		uint8_t ddd = DDD(opcode);
+		uint8_t sss = SSS(opcode);
+		uint8_t rp = RP(opcode);
+
+		// The interpreter takes over from the start of a fused pair, its first half running again
+		if (i == 0 || owner[i - 1] != owner[i]) {
+			startPc = pc;
+			startTstates = tstates;
+		}
+
+		pc += insn->size;
+		tstates += insn->tstates;
+
+		if (accessesMemory(insn)) {
+			emitAddr(&e, insn);
+			emitAccessCheck(&e, writesMemory(insn), startPc, startTstates, owner[i]);
+		}
+
+		switch (insn->op) {
+			case OP_NOP:
+				break;
+			case OP_LXI:
+				if (rp == PAIR_SP) {
+					EMIT(&e, 0x66, 0xC7);
+					emitProc(&e, 0, PROC_OFF(SP));
+				} else EMIT(&e, 0x66, 0xB8 + hostPair[rp]);
+				emit16(&e, insn->data);
+				break;
+			case OP_INX:
+			case OP_DCX: {
+				uint8_t ext = (insn->op == OP_INX) ? 0 : 1;
+				if (rp == PAIR_SP) {
+					EMIT(&e, 0x66, 0xFF);
+					emitProc(&e, ext, PROC_OFF(SP));
+				} else EMIT(&e, 0x66, 0xFF, 0xC0 | (ext << 3) | hostPair[rp]);
+				break;
+			}
+			case OP_DAD:
+				if (rp == PAIR_SP) {
+					EMIT(&e, 0x66, 0x03);
+					emitProc(&e, H_BX, PROC_OFF(SP));
+				} else EMIT(&e, 0x66, 0x01, 0xC0 | (hostPair[rp] << 3) | H_BX);
+
+				// Only the carry changes
+				EMIT(&e, 0x19, 0xED); // sbb ebp, ebp
+				EMIT(&e, 0x80, 0xE4, (uint8_t) ~FLAG_CY); // and ah, ~CY
+				EMIT(&e, 0x81, 0xE5); // and ebp, CY in AH
+				emit32(&e, FLAG_CY << 8);
+				EMIT(&e, 0x09, 0xE8); // or eax, ebp
+				break;
+			// Memory is addressed through EBP, set up by the access check
+			case OP_LDAX:
+			case OP_LDA:
+				EMIT(&e, 0x8A, MEM_HL(H_AL));
+				break;
+			case OP_STAX:
+			case OP_STA:
+				EMIT(&e, 0x88, MEM_HL(H_AL));
+				break;
+			case OP_MVI:
+				if (ddd == REG_M) EMIT(&e, 0xC6, MEM_HL(0), insn->data & 0xFF);
+				else EMIT(&e, 0xB0 + hostReg[ddd], insn->data & 0xFF);
+				break;
+			case OP_MOV:
+				if (ddd == REG_M) EMIT(&e, 0x88, MEM_HL(hostReg[sss]));
+				else if (sss == REG_M) EMIT(&e, 0x8A, MEM_HL(hostReg[ddd]));
+				else if (ddd != sss) EMIT(&e, 0x88, 0xC0 | (hostReg[sss] << 3) | hostReg[ddd]);
+				break;
+			case OP_INR:
+			case OP_DCR: {
+				// The carry is left as it is, as x86 does
+				uint8_t ext = (insn->op == OP_INR) ? 0 : 1;
+				EMIT(&e, 0x9E); // sahf
+				if (ddd == REG_M) EMIT(&e, 0xFE, MEM_HL(ext));
+				else EMIT(&e, 0xFE, 0xC0 | (ext << 3) | hostReg[ddd]);
+				EMIT(&e, 0x9F); // lahf
+				if (insn->op == OP_DCR) EMIT(&e, 0x80, 0xF4, FLAG_AC);
+				break;
+			}
+			case OP_XCHG:
+				EMIT(&e, 0x66, 0x87, 0xD3); // xchg bx, dx
+				break;
+			case OP_CMA:
+				EMIT(&e, 0xF6, 0xD0); // not al
+				break;
+			case OP_STC:
+				EMIT(&e, 0x80, 0xCC, FLAG_CY); // or ah, CY
+				break;
+			case OP_CMC:
+				EMIT(&e, 0x80, 0xF4, FLAG_CY); // xor ah, CY
+				break;
+			case OP_JMP:
+				emitBranch(&e, blk, entry, insn->data, tstates);
+				break;
+			case OP_JCC: {
+				static const uint8_t condFlag[4] = { FLAG_Z, FLAG_CY, FLAG_P, FLAG_S };
+				uint8_t cond = CCC(opcode);
+
+				EMIT(&e, 0xF6, 0xC4, condFlag[cond >> 1]); // test ah, flag
+				// Odd conditions are taken when the flag is set, so fall through when it is clear
+				size_t notTaken = emitJump(&e, (cond & 0x1) ? 0x84 : 0x85);
+				emitBranch(&e, blk, entry, insn->data, tstates);
+				patchJump(&e, notTaken, e.len);
+				emitExit(&e, pc, tstates, blk->count);
+				break;
+			}
+			default:
+				emitAlu(&e, insn, capture[i]);
+				break;
+		}
+	}
+
+	// Stopped at an instruction left to the interpreter
+	const insn_t* last = &insns[count - 1];
+	if (last->op != OP_JMP && last->op != OP_JCC) emitExit(&e, pc, tstates, n);
+
+	for (int i = 0; i < e.numExits; i++) {
+		const pending_exit_t* exit = &e.exits[i];
+
+		patchJump(&e, exit->at, e.len);
+		emitExit(&e, exit->pc, exit->tstates, exit->ran);
+	}
+
+	native_block_t native = (native_block_t) (buf->code + buf->used);
+	buf->used += e.len;
+
+	return native;
+}
+
+static bool hostSupported() {
+	unsigned int eax, ebx, ecx, edx;
+
+	// LAHF and SAHF are optional in 64-bit mode
+	if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx)) return false;
+
+	return ecx & 0x1;
+}
+
+bool initJIT(machine_t* m) {
+	if (!hostSupported()) return false;
+
+	void* code = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED) return false;
+
+	m->jit = (jit_buf_t*) malloc(sizeof(jit_buf_t));
+	m->jit->code = (uint8_t*) code;
+	m->jit->size = JIT_BUFFER_SIZE;
+	m->jit->used = 0;
+
+	return true;
+}
+
+void freeJIT(machine_t* m) {
+	if (!m->jit) return;
+
+	munmap(m->jit->code, m->jit->size);
+	free(m->jit);
+	m->jit = NULL;
+}
+
+#else
+
+// Only x86-64 hosts are translated for, everything stays with the interpreter
+
+static native_block_t translate(block_t* blk, jit_buf_t* buf) {
+	return NULL;
+}
+
+bool initJIT(machine_t* m) {
+	return false;
+}
+
+void freeJIT(machine_t* m) {
+}
+
+#endif
+
+void flushJIT(machine_t* m) {
+	// The blocks are all dropped along with their host code, so the memory is simply reused
+	if (m->jit) m->jit->used = 0;
+}
+
+bool runJIT(machine_t* m, block_t* blk) {
+	if (!blk->native) {
+		if (blk->hits == JIT_THRESHOLD || ++blk->hits < JIT_THRESHOLD) return false;
+
+		blk->native = translate(blk, m->jit);
+		if (!blk->native) return false;
+	}
+
+	int ran = blk->native(m->proc, m->mem->ram, m);
+
+	// The rest of the block is interpreted, unless it wrote over its own code
+	if (ran < blk->count && blk->valid) executeBlock(m, blk->insns + ran, blk->count - ran, &blk->valid);
+
+	return true;
+}
@@ -0,0 +1,31 @@
+#include <stdio.h>
+
+#include "m80.h"
+
+// Test device for a DMA channel, filling blocks written to memory with the alphabet and writing
+// blocks read from memory out to stderr, a line each. Writing a channel to its port requests it.
+
+#define REQUEST_PORT 0x60
+#define DMA_CHANNEL 2
+
+
+static void blockIn(void* ctx, uint8_t* buf, uint16_t len) {
+	for (int i = 0; i < len; i++) buf[i] = 'a' + i % 26;
+}
+
+static void blockOut(void* ctx, const uint8_t* buf, uint16_t len) {
+	fwrite(buf, 1, len, stderr);
+	fputc('\n', stderr);
+}
+
+static void requestOut(void* ctx, uint8_t port, uint8_t data) {
+	m80_request_dma((machine_t*) ctx, data);
+}
+
+void* m80_device_init(machine_t* m, const char* args, int abi) {
+	if (m80_attach_dma_channel(m, DMA_CHANNEL, blockIn, blockOut, NULL) != 0) return NULL;
+
+	m80_attach_port(m, REQUEST_PORT, NULL, requestOut, m);
+
+	return m;
+}
@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// The host end of the USART for the test programs. Connects to the emulator's socket once it is
+// listening, sends the text, then writes what comes back to stdout until the emulator is gone.
+
+#define CONNECT_TRIES 200
+#define CONNECT_WAIT 10000 // Microseconds between tries
+
+
+int main(int argc, char** argv) {
+	if (argc != 3) {
+		fprintf(stderr, "usage: echo socket text\n");
+		return -1;
+	}
+
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+
+	// The emulator may not have started listening yet
+	int fd = -1;
+	for (int i = 0; i < CONNECT_TRIES && fd == -1; i++) {
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+			close(fd);
+			fd = -1;
+			usleep(CONNECT_WAIT);
+		}
+	}
+	if (fd == -1) {
+		perror(argv[1]);
+		return -1;
+	}
+
+	size_t len = strlen(argv[2]);
+	if (write(fd, argv[2], len) != (ssize_t) len) {
+		perror(argv[1]);
+		close(fd);
+		return -1;
+	}
+
+	char buf[256];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0) fwrite(buf, 1, n, stdout);
+	putchar('\n');
+
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "machine.h"
+#include "mem.h"
+#include "console.h"
+#include "bank.h"
+
+#define RESULT 0x2000
+#define INPUT 0x2001
+
+// Adds one to the input byte and stores it as the result
+static const uint8_t program[] = {
+	0xae, 'A', 'E', 'F', 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, // Entry
+	0x08, 0x00, // Size
+	0x3a, 0x01, 0x20, // LDA INPUT
+	0x3c, // INR A
+	0x32, 0x00, 0x20, // STA RESULT
+	0x76 // HLT
+};
+
+#define MACHINE_PORT 0x10
+
+// Writes a character to the console, then to a port handed the machine
+static const uint8_t consoleProgram[] = {
+	0xae, 'A', 'E', 'F', 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, // Entry
+	0x07, 0x00, // Size
+	0x3e, 'c', // MVI A,'c'
+	0xd3, 0x01, // OUT CONSOLE_DATA_PORT
+	0xd3, MACHINE_PORT, // OUT MACHINE_PORT
+	0x76 // HLT
+};
+
+static int failures = 0;
+
+static void expect(const char* what, int actual, int expected) {
+	if (actual == expected) return;
+
+	printf("%s is %d, expected %d!\n", what, actual, expected);
+	failures++;
+}
+
+static uint8_t peek(machine_t* m, uint16_t addr) {
+	uint8_t data;
+	copyFromMem(m, addr, &data, 1);
+	return data;
+}
+
+static void poke(machine_t* m, uint16_t addr, uint8_t data) {
+	copyToMem(m, addr, &data, 1);
+}
+
+static int machineWrites = 0;
+
+static void machineOut(void* ctx, uint8_t port, uint8_t data) {
+	machineWrites++;
+}
+
+static void writeProgram(char* path, const uint8_t* bytes, size_t len) {
+	int fd = mkstemp(path);
+	if (fd == -1 || write(fd, bytes, len) != len) {
+		printf("Could not write the test program!\n");
+		exit(1);
+	}
+	close(fd);
+}
+
+static machine_t* load(const char* path, uint16_t* entry) {
+	machine_t* m = m80_create();
+	if (!m || m80_load(m, path, entry) != 0) {
+		printf("Could not load %s!\n", path);
+		exit(1);
+	}
+	return m;
+}
+
+/**
+ * Forks a loaded machine and checks that what either writes, or runs, stays out of the other.
+ */
+static void testFork(const char* path) {
+	uint16_t entry;
+	machine_t* parent = load(path, &entry);
+	poke(parent, INPUT, 1);
+
+	machine_t* child = m80_fork(parent);
+	if (!child) {
+		printf("Could not fork!\n");
+		exit(1);
+	}
+	expect("Forked input", peek(child, INPUT), 1);
+
+	poke(child, INPUT, 10);
+	expect("Parent input after the child wrote", peek(parent, INPUT), 1);
+	poke(parent, INPUT, 20);
+	expect("Child input after the parent wrote", peek(child, INPUT), 10);
+
+	m80_run(child, entry);
+	expect("Child result", peek(child, RESULT), 11);
+	expect("Parent result after the child ran", peek(parent, RESULT), 0);
+
+	m80_run(parent, entry);
+	expect("Parent result", peek(parent, RESULT), 21);
+	expect("Child result after the parent ran", peek(child, RESULT), 11);
+
+	// A second fork starts from where the parent is now, the first one's writes nowhere to be seen
+	machine_t* second = m80_fork(parent);
+	expect("Second fork's input", peek(second, INPUT), 20);
+	expect("Second fork's result", peek(second, RESULT), 21);
+	expect("Forked status", second->proc->status, STAT_HLT);
+
+	m80_destroy(second);
+	m80_destroy(child);
+	expect("Parent result once the forks are gone", peek(parent, RESULT), 21);
+	m80_destroy(parent);
+}
+
+/**
+ * Runs a machine again and again from a baseline, checking it is put back each time.
+ */
+static void testBaseline(const char* path) {
+	uint16_t entry;
+	machine_t* m = load(path, &entry);
+	expect("Reset without a baseline", m80_reset_baseline(m), -1);
+
+	poke(m, INPUT, 5);
+	m80_set_baseline(m);
+
+	uint64_t cycles = 0;
+	for (int run = 0; run < 3; run++) {
+		m80_run(m, entry);
+		expect("Result from the baseline", peek(m, RESULT), 6);
+		expect("Status from the baseline", m->proc->status, STAT_HLT);
+		if (run == 0) cycles = m80_cycles(m);
+		expect("T-states from the baseline", m80_cycles(m) == cycles, 1);
+
+		// Writes since the baseline are undone too
+		poke(m, 0x6000, 0xFF);
+		expect("Reset to the baseline", m80_reset_baseline(m), 0);
+		expect("Result after the reset", peek(m, RESULT), 0);
+		expect("Written after the baseline", peek(m, 0x6000), 0);
+		expect("Input after the reset", peek(m, INPUT), 5);
+		expect("T-states after the reset", m80_cycles(m), 0);
+	}
+
+	// A fork starts without a baseline, and its own does not touch the parent's
+	machine_t* child = m80_fork(m);
+	expect("Fork's reset without a baseline", m80_reset_baseline(child), -1);
+	poke(child, INPUT, 7);
+	m80_set_baseline(child);
+	m80_run(child, entry);
+	m80_reset_baseline(child);
+	m80_run(child, entry);
+	expect("Fork's result from its baseline", peek(child, RESULT), 8);
+
+	m80_run(m, entry);
+	expect("Parent's result beside the fork", peek(m, RESULT), 6);
+
+	m80_destroy(child);
+	m80_destroy(m);
+}
+
+/**
+ * Runs a fork that writes to its console and to a port handed the machine, checking the parent's
+ * console and device are left as they were.
+ */
+static void testConsole(const char* path) {
+	int out[2];
+	if (pipe(out) != 0) {
+		printf("Could not make a pipe!\n");
+		exit(1);
+	}
+	// Output not written out shows as nothing to read, rather than waiting for it
+	fcntl(out[0], F_SETFL, O_NONBLOCK);
+
+	uint16_t entry;
+	machine_t* parent = load(path, &entry);
+	m80_attach_console(parent, -1, out[1]);
+	m80_attach_port(parent, MACHINE_PORT, NULL, machineOut, parent);
+	console_t* console = parent->console;
+
+	machine_t* child = m80_fork(parent);
+	expect("Fork has a console of its own", child->console != NULL && child->console != console, 1);
+
+	m80_run(child, entry);
+	expect("Parent's console held after the fork wrote", console->tx.tail, 0);
+	expect("Parent's console machine", console->m == parent, 1);
+	expect("Parent's device written by the fork", machineWrites, 0);
+
+	// The fork's output goes to the same host file
+	char c = 0;
+	expect("Fork's output read", read(out[0], &c, 1), 1);
+	expect("Fork's output", c, 'c');
+	m80_destroy(child);
+
+	m80_run(parent, entry);
+	expect("Parent's device written by the parent", machineWrites, 1);
+
+	m80_destroy(parent);
+	close(out[0]);
+	close(out[1]);
+}
+
+static machine_t* loadBanked(const char* path, uint16_t* entry) {
+	machine_t* m = load(path, entry);
+	uint16_t window = BANK_WINDOW;
+	if (m80_attach_banks(m, BANK_PORT, &window, 1, BANK_SIZE, BANK_COUNT) != 0) {
+		printf("Could not attach banks!\n");
+		exit(1);
+	}
+	return m;
+}
+
+/**
+ * Saves a machine with a line raised and a bank switched in, and checks a machine restored from
+ * it has both, with the pending interrupt worked out again.
+ */
+static void testSnapshot(const char* path) {
+	char snap[] = "/tmp/m80-snapXXXXXX";
+	int fd = mkstemp(snap);
+	if (fd == -1) {
+		printf("Could not make a snapshot file!\n");
+		exit(1);
+	}
+	close(fd);
+
+	uint16_t entry;
+	machine_t* m = loadBanked(path, &entry);
+	switchBank(m, 0, 5);
+	poke(m, BANK_WINDOW, 0x55);
+	m80_raise_irq(m, 3);
+	State(m).ctrSigs.INTE = true;
+	expect("Save", m80_save(m, snap), 0);
+
+	machine_t* restored = loadBanked(path, &entry);
+	expect("Restore", m80_restore(restored, snap), 0);
+	expect("Restored bank", restored->banks->windows[0].bank, 5);
+	expect("Restored window", peek(restored, BANK_WINDOW), 0x55);
+	expect("Restored lines", restored->intr->request, 1 << 3);
+	expect("Restored interrupt pending", restored->intr->pending, 1);
+
+	// The bank's own place in the RAM was never written
+	switchBank(restored, 0, 0);
+	expect("Window's RAM after the restore", peek(restored, BANK_WINDOW), 0);
+
+	m80_destroy(restored);
+	m80_destroy(m);
+	unlink(snap);
+}
+
+int main(int argc, char const* argv[]) {
+	char path[] = "/tmp/m80-forkXXXXXX";
+	writeProgram(path, program, sizeof(program));
+	testFork(path);
+	testBaseline(path);
+	testSnapshot(path);
+	unlink(path);
+
+	char consolePath[] = "/tmp/m80-forkXXXXXX";
+	writeProgram(consolePath, consoleProgram, sizeof(consoleProgram));
+	testConsole(consolePath);
+	unlink(consolePath);
+
+	if (failures) {
+		printf("%d fork, baseline and snapshot checks failed!\n", failures);
+		return 1;
+	}
+
+	printf("Forks, baselines and snapshots are as expected!\n");
+
+	return 0;
+}
@@ -0,0 +1,24 @@
+#include <stdlib.h>
+
+#include "m80.h"
+
+// Test device for the interrupt lines, raising the line written to one port and lowering the
+// line written to the next
+
+#define RAISE_PORT 0x10
+#define LOWER_PORT 0x11
+
+
+static void lineOut(void* ctx, uint8_t port, uint8_t data) {
+	machine_t* m = (machine_t*) ctx;
+
+	if (port == RAISE_PORT) m80_raise_irq(m, data);
+	else m80_lower_irq(m, data);
+}
+
+void* m80_device_init(machine_t* m, const char* args, int abi) {
+	m80_attach_port(m, RAISE_PORT, NULL, lineOut, m);
+	m80_attach_port(m, LOWER_PORT, NULL, lineOut, m);
+
+	return m;
+}
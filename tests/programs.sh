@@ -0,0 +1,94 @@
+#!/bin/sh
+# Runs the test programs in asm/, checking each finishes with the registers and status it
+# expects. A program's source says how it is run in its header comments:
+#
+#   ; run: <flags>       Flags for emu
+#   ; input: <text>      Typed at the console, with printf escapes
+#   ; send: <text>       Sent to the USART, attached on a socket, and what comes back is checked too
+#   ; image XXXX: <hex>  Bytes of a disk image attached for the run, the rest of it zeroed
+#   ; expect: <text>     A line of the output has this in it, as many as are needed
+#
+# Sources without an expect line are not test programs. Each is put together from the bytes
+# listed against its instructions, so they build without an assembler. Run from the top of
+# the tree, after make.
+
+bin=tests/bin
+failed=0
+ran=0
+
+mkdir -p $bin
+
+# Gets the text of each of the source's directives of the kind
+directive() {
+	sed -n "s/^; $1: //p" "$2"
+}
+
+# Turns lines of an address then hex bytes into printf escapes for bytes 0 up to the last listed,
+# those not listed being 0. With aef set, the bytes are put after an AEF header entered at 0.
+escapes() {
+	awk -v aef="$1" '
+		function hex(s,    v, i) {
+			v = 0
+			for (i = 1; i <= length(s); i++) v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+			return v
+		}
+		{
+			addr = hex(substr($1, 1, 4))
+			for (i = 2; i <= NF; i++) {
+				bytes[addr] = hex($i)
+				if (addr >= size) size = addr + 1
+				addr++
+			}
+		}
+		END {
+			if (aef) printf "\\256AEF\\0\\0\\0\\0\\0\\0\\%03o\\%03o", size % 256, int(size / 256)
+			for (addr = 0; addr < size; addr++) printf "\\%03o", bytes[addr]
+		}'
+}
+
+for src in asm/*.s; do
+	expects=$(directive expect $src)
+	[ -n "$expects" ] || continue
+
+	name=$(basename $src .s)
+	out=$bin/$name.out
+	flags=$(directive run $src)
+	send=$(directive send $src)
+	ran=$((ran + 1))
+
+	printf "$(sed -n 's/^[^;].*; \([0-9a-f]\{4\}:.*\)$/\1/p' $src | escapes 1)" > $bin/$name
+
+	if grep -q "^; image " $src; then
+		printf "$(sed -n 's/^; image //p' $src | escapes)" > $bin/$name.img
+		flags="$flags --disk=$bin/$name.img"
+	fi
+
+	if [ -n "$send" ]; then
+		flags="$flags --uart=$bin/$name.sock"
+		tests/echo $bin/$name.sock "$send" > $bin/$name.echo &
+	fi
+
+	# The emulator looks for programs in asm/
+	printf "$(directive input $src)" | ./emu $flags ../$bin/$name > $out 2>&1
+
+	if [ -n "$send" ]; then
+		wait
+		cat $bin/$name.echo >> $out
+	fi
+
+	missing=$(echo "$expects" | while IFS= read -r expect; do
+		grep -qF -- "$expect" $out || echo "$expect"
+	done)
+	if [ -n "$missing" ]; then
+		echo "$src did not finish as expected, missing:"
+		echo "$missing" | sed 's/^/    /'
+		echo "Its output is in $out"
+		failed=$((failed + 1))
+	fi
+done
+
+if [ $failed -ne 0 ]; then
+	echo "$failed of $ran programs did not finish as expected!"
+	exit 1
+fi
+echo "All $ran programs finished as expected!"
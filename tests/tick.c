@@ -0,0 +1,53 @@
+#include <stdlib.h>
+
+#include "m80.h"
+
+// Test device for timers, raising line 2 every so many thousand T-states once started
+
+#define PERIOD_PORT 0x12 // Starts the ticks, the thousands of T-states between them written
+#define STOP_PORT 0x13
+#define TICK_IRQ 2
+
+
+typedef struct tick {
+	machine_t* m;
+	int timer;
+	uint64_t period;
+} tick_t;
+
+static void tick(void* ctx, uint64_t at) {
+	tick_t* t = (tick_t*) ctx;
+
+	m80_raise_irq(t->m, TICK_IRQ);
+	m80_set_timer(t->m, t->timer, at + t->period);
+}
+
+static void tickOut(void* ctx, uint8_t port, uint8_t data) {
+	tick_t* t = (tick_t*) ctx;
+
+	if (port == PERIOD_PORT) {
+		t->period = data * 1000ULL;
+		m80_set_timer(t->m, t->timer, m80_cycles(t->m) + t->period);
+	} else {
+		m80_stop_timer(t->m, t->timer);
+	}
+}
+
+void* m80_device_init(machine_t* m, const char* args, int abi) {
+	tick_t* t = (tick_t*) calloc(1, sizeof(tick_t));
+	t->m = m;
+	t->timer = m80_add_timer(m, tick, t);
+	if (t->timer == -1) {
+		free(t);
+		return NULL;
+	}
+
+	m80_attach_port(m, PERIOD_PORT, NULL, tickOut, t);
+	m80_attach_port(m, STOP_PORT, NULL, tickOut, t);
+
+	return t;
+}
+
+void m80_device_free(void* device) {
+	free(device);
+}